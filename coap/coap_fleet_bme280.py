@@ -0,0 +1,346 @@
+"""Load generator that simulates a fleet of BME280 sensor nodes.
+
+Copyright (c) 2024 Koen Vervloesem
+
+SPDX-License-Identifier: MIT
+"""
+import argparse
+import asyncio
+import json
+import random
+import resource
+import socket
+import sqlite3
+import struct
+import time
+
+try:
+    import cbor2
+except ImportError:
+    cbor2 = None
+
+COAP_PORT = 5683
+
+COAP_VERSION = 1
+COAP_TYPE_CON = 0
+COAP_TYPE_NON = 1
+COAP_TYPE_ACK = 2
+COAP_CODE_PUT = 0x03
+COAP_OPTION_URI_PATH = 11
+COAP_OPTION_CONTENT_FORMAT = 12
+COAP_PAYLOAD_MARKER = 0xFF
+
+CONTENT_FORMAT_JSON = 50
+CONTENT_FORMAT_CBOR = 60
+
+# Integer keys of the CBOR sensor reports
+CBOR_KEY_ID = 0
+CBOR_KEY_TEMP = 1
+CBOR_KEY_PRESS = 2
+CBOR_KEY_HUM = 3
+CBOR_KEY_SEQ = 10
+CBOR_KEY_BOOT = 11
+
+# EUI-64 of the first virtual node, the others count up from it
+FIRST_EUI64 = 0xF4CE36F000000000
+
+PERCENTILES = (50, 75, 90, 99, 99.9, 99.99, 100)
+
+
+def encode_request(mid, confirmable, content_format, payload):
+    """Encode a PUT request to the sensor resource like the nodes do."""
+    message_type = COAP_TYPE_CON if confirmable else COAP_TYPE_NON
+    header = struct.pack(
+        ">BBH", COAP_VERSION << 6 | message_type << 4, COAP_CODE_PUT, mid
+    )
+    uri_path = b"sensor"
+    # Option deltas and lengths below 13 fit in one byte.
+    options = bytes([COAP_OPTION_URI_PATH << 4 | len(uri_path)]) + uri_path
+    options += bytes(
+        [(COAP_OPTION_CONTENT_FORMAT - COAP_OPTION_URI_PATH) << 4 | 1, content_format]
+    )
+    return header + options + bytes([COAP_PAYLOAD_MARKER]) + payload
+
+
+class Stats:
+    """Counters and latencies of all virtual nodes."""
+
+    def __init__(self):
+        self.sent = {CONTENT_FORMAT_JSON: 0, CONTENT_FORMAT_CBOR: 0}
+        self.acked = 0
+        self.lost = 0
+        self.late = 0
+        self.duplicates = 0
+        self.dropped = 0
+        self.latencies = []
+
+
+class VirtualNode(asyncio.DatagramProtocol):
+    """A BME280 node that sends a report every interval from its own port.
+
+    Confirmable reports are matched with their ACK by message ID to measure
+    the latency. An ACK for a report that was already acknowledged counts as
+    a duplicate, one after the timeout as late; the report itself was
+    counted as lost then.
+    """
+
+    def __init__(self, eui64, interval, cbor, confirmable, timeout, loss, stats):
+        self.eui64 = eui64
+        self.interval = interval
+        self.cbor = cbor
+        self.confirmable = confirmable
+        self.timeout = timeout
+        self.loss = loss
+        self.stats = stats
+        self.transport = None
+        self.mid = random.randrange(2**16)
+        self.pending = {}
+        self.acked = set()
+        self.boot = random.randrange(2**32)
+        self.seq = 0
+        self.sent = 0
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        if len(data) < 4 or (data[0] >> 4) & 0x3 != COAP_TYPE_ACK:
+            return
+        mid = struct.unpack(">H", data[2:4])[0]
+        sent = self.pending.pop(mid, None)
+        if sent is not None:
+            self.stats.latencies.append(time.perf_counter() - sent)
+            self.stats.acked += 1
+            self.acked.add(mid)
+        elif mid in self.acked:
+            self.stats.duplicates += 1
+        else:
+            self.stats.late += 1
+
+    def expire(self, mid):
+        """Count a report without ACK as lost."""
+        if self.pending.pop(mid, None) is not None:
+            self.stats.lost += 1
+
+    def payload(self):
+        """Return a report with readings that drift a bit per node."""
+        temp = 2000 + self.eui64 % 500 + random.randrange(-20, 21)
+        press = 101325 + random.randrange(-100, 101)
+        hum = 4500 + random.randrange(-200, 201)
+        if self.cbor:
+            report = {
+                CBOR_KEY_ID: self.eui64.to_bytes(8, "big"),
+                CBOR_KEY_TEMP: temp,
+                CBOR_KEY_PRESS: press,
+                CBOR_KEY_HUM: hum,
+                CBOR_KEY_SEQ: self.seq,
+                CBOR_KEY_BOOT: self.boot,
+            }
+            return CONTENT_FORMAT_CBOR, cbor2.dumps(report)
+        report = {
+            "id": f"{self.eui64:016X}",
+            "temp": temp / 100,
+            "press": press / 100,
+            "hum": hum / 100,
+            "seq": self.seq,
+            "boot": self.boot,
+        }
+        return CONTENT_FORMAT_JSON, json.dumps(report).encode()
+
+    def send(self):
+        """Send one report, or drop it on the way with the loss probability."""
+        self.mid = (self.mid + 1) % 2**16
+        self.acked.discard(self.mid)
+        content_format, payload = self.payload()
+        self.seq += 1
+        if random.random() < self.loss:
+            self.stats.dropped += 1
+            return
+        datagram = encode_request(self.mid, self.confirmable, content_format, payload)
+        if self.confirmable:
+            self.pending[self.mid] = time.perf_counter()
+            asyncio.get_running_loop().call_later(self.timeout, self.expire, self.mid)
+        self.transport.sendto(datagram)
+        self.stats.sent[content_format] += 1
+        self.sent += 1
+
+    async def run(self, until):
+        """Send reports at a random phase in the interval until the deadline."""
+        loop = asyncio.get_running_loop()
+        await asyncio.sleep(random.uniform(0, self.interval))
+        while loop.time() < until:
+            self.send()
+            await asyncio.sleep(self.interval)
+
+
+def raise_file_limit(needed):
+    """Raise the limit of open files for one socket per node if possible."""
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if soft < needed:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (min(needed, hard), hard))
+
+
+def stored_reports(path, nodes, since):
+    """Return the number of samples per node the collector stored since."""
+    db = sqlite3.connect(path, timeout=30)
+    try:
+        rows = db.execute(
+            "SELECT node, COUNT(*) FROM samples WHERE time >= ? GROUP BY node",
+            (since,),
+        ).fetchall()
+    finally:
+        db.close()
+    ids = {f"{node.eui64:016X}" for node in nodes}
+    return {node: count for node, count in rows if node in ids}
+
+
+def print_latencies(latencies):
+    """Show the latency percentiles like HdrHistogram does."""
+    if not latencies:
+        return
+    latencies.sort()
+    print(f"{'Value (ms)':>12} {'Percentile':>12} {'TotalCount':>12}")
+    for percentile in PERCENTILES:
+        count = max(1, round(len(latencies) * percentile / 100))
+        value = latencies[count - 1] * 1000
+        print(f"{value:12.3f} {percentile / 100:12.6f} {count:12}")
+    mean = sum(latencies) / len(latencies)
+    print(f"#[Mean = {mean * 1000:.3f} ms, Max = {latencies[-1] * 1000:.3f} ms]")
+
+
+def print_end_to_end(path, nodes, since):
+    """Compare the reports sent by each node with the ones stored."""
+    stored = stored_reports(path, nodes, since)
+    missing = 0
+    duplicates = 0
+    for node in nodes:
+        count = stored.get(f"{node.eui64:016X}", 0)
+        missing += max(0, node.sent - count)
+        duplicates += max(0, count - node.sent)
+    print(
+        f"{path}: {sum(stored.values())} reports stored, {missing} missing, "
+        f"{duplicates} duplicates"
+    )
+
+
+async def main():
+    """Simulate the nodes and show the statistics."""
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "--host", default="::1", help="address of the collector (default ::1)"
+    )
+    parser.add_argument(
+        "--port", type=int, default=COAP_PORT, help="port of the collector"
+    )
+    parser.add_argument(
+        "--nodes", type=int, default=1000, help="number of nodes (default 1000)"
+    )
+    parser.add_argument(
+        "--interval",
+        type=float,
+        default=5.0,
+        metavar="SECONDS",
+        help="mean interval between two reports of a node (default 5)",
+    )
+    parser.add_argument(
+        "--spread",
+        type=float,
+        default=0.5,
+        metavar="FRACTION",
+        help="interval of each node random within this fraction (default 0.5)",
+    )
+    parser.add_argument(
+        "--cbor",
+        type=float,
+        default=0.5,
+        metavar="FRACTION",
+        help="fraction of the nodes that send CBOR, if cbor2 is installed",
+    )
+    parser.add_argument(
+        "--duration",
+        type=float,
+        default=60.0,
+        metavar="SECONDS",
+        help="time to send reports (default 60)",
+    )
+    parser.add_argument(
+        "--non",
+        action="store_true",
+        help="send non-confirmable reports like the nodes, without latencies",
+    )
+    parser.add_argument(
+        "--timeout",
+        type=float,
+        default=2.0,
+        metavar="SECONDS",
+        help="time after which a report without ACK is lost (default 2)",
+    )
+    parser.add_argument(
+        "--loss",
+        type=float,
+        default=0.0,
+        metavar="FRACTION",
+        help="fraction of the reports to drop, to check the collector's /delivery",
+    )
+    parser.add_argument(
+        "--db",
+        metavar="PATH",
+        help="collector database to count the stored reports of each node in",
+    )
+    args = parser.parse_args()
+
+    if args.cbor > 0 and cbor2 is None:
+        print("cbor2 isn't installed, all nodes send JSON")
+
+    raise_file_limit(args.nodes + 64)
+    loop = asyncio.get_running_loop()
+    stats = Stats()
+    nodes = []
+    for index in range(args.nodes):
+        node = VirtualNode(
+            FIRST_EUI64 + index,
+            args.interval * random.uniform(1 - args.spread, 1 + args.spread),
+            cbor2 is not None and random.random() < args.cbor,
+            not args.non,
+            args.timeout,
+            args.loss,
+            stats,
+        )
+        await loop.create_datagram_endpoint(
+            lambda node=node: node,
+            remote_addr=(args.host, args.port),
+            family=socket.AF_INET6,
+        )
+        nodes.append(node)
+
+    since = time.time()
+    started = time.perf_counter()
+    until = loop.time() + args.duration
+    await asyncio.gather(*(node.run(until) for node in nodes))
+    elapsed = time.perf_counter() - started
+    # Wait for the last ACKs and for the collector to store the last reports.
+    await asyncio.sleep(args.timeout)
+
+    sent = sum(stats.sent.values())
+    print(
+        f"{sent} reports from {args.nodes} nodes in {elapsed:.1f} s "
+        f"({sent / elapsed:.0f} reports/s), "
+        f"{stats.sent[CONTENT_FORMAT_JSON]} JSON, "
+        f"{stats.sent[CONTENT_FORMAT_CBOR]} CBOR, {stats.dropped} dropped"
+    )
+    if not args.non:
+        print(
+            f"{stats.acked} acknowledged, {stats.lost} lost "
+            f"({stats.lost / max(sent, 1):.2%}), {stats.late} late, "
+            f"{stats.duplicates} duplicates"
+        )
+        print_latencies(stats.latencies)
+    if args.db:
+        print_end_to_end(args.db, nodes, since)
+
+    for node in nodes:
+        node.transport.close()
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,308 @@
+"""Simulate a fleet of LED nodes to measure the skew of their actuation.
+
+Copyright (c) 2024 Koen Vervloesem
+
+SPDX-License-Identifier: MIT
+"""
+import argparse
+import asyncio
+import random
+import resource
+import socket
+import struct
+import time
+
+COAP_VERSION = 1
+COAP_TYPE_CON = 0
+COAP_TYPE_ACK = 2
+COAP_CODE_GET = 0x01
+COAP_CODE_PUT = 0x03
+COAP_CODE_CHANGED = 0x44
+COAP_CODE_CONTENT = 0x45
+COAP_CODE_NOT_FOUND = 0x84
+COAP_OPTION_URI_PATH = 11
+COAP_PAYLOAD_MARKER = 0xFF
+
+# Number of time requests to estimate the clock offset of a node
+TIME_SAMPLES = 8
+
+PERCENTILES = (50, 75, 90, 99, 99.9, 99.99, 100)
+
+
+def encode_message(message_type, code, mid, uri_path=b"", payload=b""):
+    """Encode a CoAP message without token, with at most a short Uri-Path."""
+    message = struct.pack(">BBH", COAP_VERSION << 6 | message_type << 4, code, mid)
+    if uri_path:
+        # Option deltas and lengths below 13 fit in one byte.
+        message += bytes([COAP_OPTION_URI_PATH << 4 | len(uri_path)]) + uri_path
+    if payload:
+        message += bytes([COAP_PAYLOAD_MARKER]) + payload
+    return message
+
+
+def decode_message(data):
+    """Decode the code, message ID, Uri-Path and payload of a message."""
+    code = data[1]
+    mid = struct.unpack(">H", data[2:4])[0]
+    uri_path = b""
+    index = 4 + (data[0] & 0xF)
+    number = 0
+    while index < len(data) and data[index] != COAP_PAYLOAD_MARKER:
+        number += data[index] >> 4
+        length = data[index] & 0xF
+        if number == COAP_OPTION_URI_PATH:
+            uri_path = data[index + 1 : index + 1 + length]
+        index += 1 + length
+    return code, mid, uri_path, data[index + 1 :]
+
+
+class VirtualLedNode(asyncio.DatagramProtocol):
+    """An LED node built with APP_SCHEDULE, behind a multi-hop mesh.
+
+    Every message to and from the node takes a random one-way delay, which is
+    what makes commands sent at the same time arrive at different times. The
+    node's scheduling clock runs with its own offset and drift, and it
+    records when it changes its LED in the real time of this host. The timers
+    of the host are coarser than the ones of a node, so a scheduled change
+    counts at the time its timer was set for.
+    """
+
+    def __init__(self, offset, drift, delay):
+        self.offset = offset
+        self.drift = drift
+        self.delay = delay
+        self.transport = None
+        self.actuated = None
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def now(self):
+        """Return the time of the node's scheduling clock in microseconds."""
+        return round((time.perf_counter() * (1 + self.drift) + self.offset) * 1e6)
+
+    def datagram_received(self, data, addr):
+        asyncio.get_running_loop().call_later(
+            random.uniform(0, self.delay), self.handle, data, addr
+        )
+
+    def handle(self, data, addr):
+        """Handle a request when it arrives at the node, like the firmware."""
+        code, mid, uri_path, payload = decode_message(data)
+        if code == COAP_CODE_GET and uri_path == b"time":
+            self.respond(addr, COAP_CODE_CONTENT, mid, str(self.now()).encode())
+        elif code == COAP_CODE_PUT and uri_path == b"led":
+            _, _, at = payload.decode().partition("@")
+            wait = (int(at) - self.now()) / 1e6 / (1 + self.drift) if at else 0
+            self.actuated = time.perf_counter() + max(0, wait)
+            self.respond(addr, COAP_CODE_CHANGED, mid)
+        else:
+            self.respond(addr, COAP_CODE_NOT_FOUND, mid)
+
+    def respond(self, addr, code, mid, payload=b""):
+        """Send a piggybacked response after the delay back to the client."""
+        datagram = encode_message(COAP_TYPE_ACK, code, mid, payload=payload)
+        asyncio.get_running_loop().call_later(
+            random.uniform(0, self.delay), self.transport.sendto, datagram, addr
+        )
+
+
+class Client(asyncio.DatagramProtocol):
+    """Send confirmable requests to the nodes and match their responses."""
+
+    def __init__(self, timeout):
+        self.timeout = timeout
+        self.transport = None
+        self.mid = random.randrange(2**16)
+        self.pending = {}
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        code, mid, _, payload = decode_message(data)
+        future = self.pending.pop(mid, None)
+        if future is not None and not future.done():
+            future.set_result((code, payload))
+
+    async def request(self, addr, code, uri_path, payload=b""):
+        """Send a request and return the code and payload of the response."""
+        self.mid = mid = (self.mid + 1) % 2**16
+        future = asyncio.get_running_loop().create_future()
+        self.pending[mid] = future
+        self.transport.sendto(
+            encode_message(COAP_TYPE_CON, code, mid, uri_path, payload), addr
+        )
+        try:
+            return await asyncio.wait_for(future, self.timeout)
+        finally:
+            self.pending.pop(mid, None)
+
+    async def offset(self, addr, samples):
+        """Estimate the offset of a node's scheduling clock to ours.
+
+        The request with the shortest round trip is the one where the time
+        of the node is the closest to halfway between sending and receiving.
+        """
+        best = None
+        for _ in range(samples):
+            sent = time.perf_counter()
+            _, payload = await self.request(addr, COAP_CODE_GET, b"time")
+            received = time.perf_counter()
+            if best is None or received - sent < best[0]:
+                best = (received - sent, int(payload) / 1e6 - (sent + received) / 2)
+        return best[1]
+
+
+def raise_file_limit(needed):
+    """Raise the limit of open files for one socket per node if possible."""
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if soft < needed:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (min(needed, hard), hard))
+
+
+def print_latencies(latencies):
+    """Show the latency percentiles like HdrHistogram does."""
+    if not latencies:
+        return
+    latencies.sort()
+    print(f"{'Value (ms)':>12} {'Percentile':>12} {'TotalCount':>12}")
+    for percentile in PERCENTILES:
+        count = max(1, round(len(latencies) * percentile / 100))
+        value = latencies[count - 1] * 1000
+        print(f"{value:12.3f} {percentile / 100:12.6f} {count:12}")
+    mean = sum(latencies) / len(latencies)
+    print(f"#[Mean = {mean * 1000:.3f} ms, Max = {latencies[-1] * 1000:.3f} ms]")
+
+
+async def run_changes(client, nodes, addrs, offsets, changes, lead):
+    """Switch the LED of all nodes changes times, and return the skews.
+
+    Without offsets the commands are carried out right away, otherwise they
+    are scheduled lead seconds ahead in the clock of each node.
+    """
+    skews = []
+    state = "0"
+    for _ in range(changes):
+        state = "0" if state == "1" else "1"
+        at = time.perf_counter() + lead
+        payloads = [
+            f"{state}@{round((at + offset) * 1e6)}" if offsets else state
+            for offset in offsets or [0] * len(nodes)
+        ]
+        await asyncio.gather(
+            *(
+                client.request(addr, COAP_CODE_PUT, b"led", payload.encode())
+                for addr, payload in zip(addrs, payloads)
+            )
+        )
+        actuations = [node.actuated for node in nodes]
+        skews.append(max(actuations) - min(actuations))
+        # Change the LEDs one after the other, like a light show would.
+        await asyncio.sleep(max(0, at - time.perf_counter()))
+    return skews
+
+
+async def main():
+    """Simulate the nodes, and compare the skew of direct and scheduled changes."""
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "--nodes", type=int, default=20, help="number of nodes (default 20)"
+    )
+    parser.add_argument(
+        "--changes",
+        type=int,
+        default=50,
+        help="number of changes of the LEDs of all nodes (default 50)",
+    )
+    parser.add_argument(
+        "--delay",
+        type=float,
+        default=0.05,
+        metavar="SECONDS",
+        help="maximum one-way delay of a message through the mesh (default 0.05)",
+    )
+    parser.add_argument(
+        "--lead",
+        type=float,
+        default=0.5,
+        metavar="SECONDS",
+        help="time that scheduled changes are sent ahead (default 0.5)",
+    )
+    parser.add_argument(
+        "--samples",
+        type=int,
+        default=TIME_SAMPLES,
+        help=f"time requests to estimate the offset of a node (default {TIME_SAMPLES})",
+    )
+    parser.add_argument(
+        "--drift",
+        type=float,
+        default=50.0,
+        metavar="PPM",
+        help="maximum drift of a node's clock (default 50)",
+    )
+    parser.add_argument(
+        "--network-time",
+        action="store_true",
+        help="let the nodes share a network time, like APP_SCHEDULE_NETWORK_TIME, "
+        "so the offset of one node is used for all",
+    )
+    parser.add_argument(
+        "--sync-error",
+        type=float,
+        default=100.0,
+        metavar="MICROSECONDS",
+        help="maximum error of the network time of a node (default 100)",
+    )
+    args = parser.parse_args()
+
+    raise_file_limit(args.nodes + 64)
+    loop = asyncio.get_running_loop()
+    network_time = random.uniform(0, 3600)
+    nodes = []
+    addrs = []
+    for _ in range(args.nodes):
+        if args.network_time:
+            node = VirtualLedNode(
+                network_time + random.uniform(-1, 1) * args.sync_error / 1e6,
+                0.0,
+                args.delay,
+            )
+        else:
+            node = VirtualLedNode(
+                random.uniform(0, 3600),
+                random.uniform(-1, 1) * args.drift / 1e6,
+                args.delay,
+            )
+        transport, _ = await loop.create_datagram_endpoint(
+            lambda node=node: node, local_addr=("::1", 0), family=socket.AF_INET6
+        )
+        nodes.append(node)
+        addrs.append(transport.get_extra_info("sockname")[:2])
+    _, client = await loop.create_datagram_endpoint(
+        lambda: Client(4 * args.delay + 1),
+        local_addr=("::1", 0),
+        family=socket.AF_INET6,
+    )
+
+    skews = await run_changes(client, nodes, addrs, None, args.changes, 0)
+    print(f"Changes sent to {args.nodes} nodes at once:")
+    print_latencies(skews)
+
+    if args.network_time:
+        offsets = [await client.offset(addrs[0], args.samples)] * len(nodes)
+    else:
+        offsets = await asyncio.gather(
+            *(client.offset(addr, args.samples) for addr in addrs)
+        )
+    skews = await run_changes(client, nodes, addrs, offsets, args.changes, args.lead)
+    print(
+        f"Changes scheduled {args.lead} s ahead on {args.nodes} nodes in "
+        f"{'the network time' if args.network_time else 'their own clock'}:"
+    )
+    print_latencies(skews)
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
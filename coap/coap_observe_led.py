@@ -0,0 +1,333 @@
+"""CoAP client that observes the LED resource of nodes.
+
+Copyright (c) 2024 Koen Vervloesem
+
+SPDX-License-Identifier: MIT
+"""
+import argparse
+import asyncio
+import socket
+import time
+
+import aiocoap
+from aiocoap.optiontypes import UintOption
+
+PERCENTILES = (50, 75, 90, 99, 99.9, 99.99, 100)
+
+# No-Response option (RFC 7967) that suppresses all responses
+NO_RESPONSE_OPTION = 258
+NO_RESPONSE_ALL = 26
+
+# Number of time requests to estimate the clock offset of a node
+TIME_SAMPLES = 8
+
+
+class LedObserver:
+    """Observe the LED resource of a node and time its notifications.
+
+    Each change that this client makes is matched with the first
+    notification that shows it. A notification shows all changes up to the
+    last one with the state it carries, so changes the node coalesced in one
+    notification are all matched with it.
+    """
+
+    def __init__(self, context, uri, verbose):
+        self.context = context
+        self.uri = uri
+        self.verbose = verbose
+        self.state = "0"
+        self.pending = []
+        self.latencies = []
+        self.notifications = 0
+        self.changes = 0
+        self.waiting = None
+        self.reached = None
+        self.offset = 0.0
+
+    async def observe(self):
+        """Register as observer and handle the notifications."""
+        request = aiocoap.Message(code=aiocoap.GET, uri=self.uri, observe=0)
+        pending = self.context.request(request)
+        response = await pending.response
+        self.state = response.payload.decode()
+        print(f"{self.uri}: {self.state}")
+
+        async for notification in pending.observation:
+            self.notified(notification.payload.decode(), time.perf_counter())
+
+    async def synchronize(self):
+        """Estimate the offset of the node's scheduling clock to ours.
+
+        The request with the shortest round trip is the one where the time
+        of the node is the closest to halfway between sending and receiving.
+        """
+        uri = self.uri.rsplit("/", 1)[0] + "/time"
+        best = None
+        for _ in range(TIME_SAMPLES):
+            sent = time.perf_counter()
+            request = aiocoap.Message(code=aiocoap.GET, uri=uri)
+            response = await self.context.request(request).response
+            received = time.perf_counter()
+            if not response.code.is_successful():
+                raise RuntimeError(f"{uri}: {response.code}")
+            node_time = int(response.payload) / 1e6
+            if best is None or received - sent < best[0]:
+                best = (received - sent, node_time - (sent + received) / 2)
+        self.offset = best[1]
+        print(f"{uri}: offset {self.offset:.6f} s, round trip {best[0] * 1000:.3f} ms")
+
+    def command(self, state, at):
+        """Payload that sets LED 0 at a time of our clock, or right away."""
+        if at is None:
+            return state
+        return f"{state}@{round((at + self.offset) * 1e6)}"
+
+    def notified(self, state, received):
+        """Match a notification with the changes it shows."""
+        self.state = state
+        self.notifications += 1
+        matched = 0
+        for index, (_, expected) in enumerate(self.pending):
+            if expected == state[0]:
+                matched = index + 1
+        for since, _ in self.pending[:matched]:
+            self.latencies.append(received - since)
+        del self.pending[:matched]
+        if self.waiting is not None and state[0] == self.waiting:
+            self.waiting = None
+            self.reached = received
+        if self.verbose:
+            print(
+                f"{self.uri}: {state} "
+                f"({matched} change{'' if matched == 1 else 's'})"
+            )
+
+    async def change(self, count, interval, lead):
+        """Switch LED 0 count times, starting from its state, and remember when.
+
+        With a lead, each change is scheduled that many seconds ahead, and the
+        latency counts from the scheduled time.
+        """
+        state = self.state[0]
+        for _ in range(count):
+            state = "0" if state == "1" else "1"
+            at = time.perf_counter() + lead if lead else None
+            request = aiocoap.Message(
+                code=aiocoap.PUT,
+                uri=self.uri,
+                payload=self.command(state, at).encode(),
+            )
+            self.pending.append((at or time.perf_counter(), state))
+            self.changes += 1
+            await self.context.request(request).response
+            await asyncio.sleep(interval)
+
+
+def group_request(command, message_id):
+    """Build a non-confirmable PUT of LED 0 to the group, without responses."""
+    message = aiocoap.Message(
+        mtype=aiocoap.NON,
+        code=aiocoap.PUT,
+        mid=message_id,
+        token=b"",
+        uri_path=("led",),
+        payload=command.encode(),
+    )
+    message.opt.add_option(UintOption(NO_RESPONSE_OPTION, NO_RESPONSE_ALL))
+    return message.encode()
+
+
+async def group_changes(observers, group, count, interval, lead, timeout):
+    """Switch LED 0 of the group count times, and time when each node has it.
+
+    The PUT requests go to the group in one non-confirmable message each, and
+    the notifications of the observed nodes show when they have been carried
+    out. With a lead, the changes are scheduled that many seconds ahead in the
+    network time, which the first node's offset converts to. This only holds
+    for the other nodes if they all schedule in the same network time. The
+    times count from the scheduled time. Returns the times until the first and
+    the last node showed each change, and the number of nodes that missed a
+    change.
+    """
+    host, _, interface = group.partition("%")
+    address = socket.getaddrinfo(host, aiocoap.COAP_PORT, socket.AF_INET6)[0][4]
+    if interface:
+        address = address[:3] + (socket.if_nametoindex(interface),)
+    sock = socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.IPPROTO_IPV6, socket.IPV6_MULTICAST_HOPS, 8)
+    if interface:
+        sock.setsockopt(socket.IPPROTO_IPV6, socket.IPV6_MULTICAST_IF, address[3])
+
+    first, last = [], []
+    missed = 0
+    state = "0"
+    # The first request puts all nodes in the same state.
+    for message_id in range(count + 1):
+        start = time.perf_counter() + lead if lead else time.perf_counter()
+        for observer in observers:
+            # A node that already has the state doesn't notify it.
+            observer.waiting = None if observer.state[0] == state else state
+            observer.reached = None if observer.waiting else start
+        command = observers[0].command(state, start if lead else None)
+        sock.sendto(group_request(command, message_id), address)
+
+        deadline = start + timeout
+        while (
+            any(observer.waiting for observer in observers)
+            and time.perf_counter() < deadline
+        ):
+            await asyncio.sleep(0.001)
+        reached = [
+            observer.reached - start
+            for observer in observers
+            if observer.reached is not None
+        ]
+        if message_id and reached:
+            first.append(min(reached))
+            last.append(max(reached))
+        if message_id:
+            missed += len(observers) - len(reached)
+        state = "0" if state == "1" else "1"
+        await asyncio.sleep(interval)
+
+    sock.close()
+    return first, last, missed
+
+
+def print_latencies(latencies):
+    """Show the latency percentiles like HdrHistogram does."""
+    if not latencies:
+        return
+    latencies.sort()
+    print(f"{'Value (ms)':>12} {'Percentile':>12} {'TotalCount':>12}")
+    for percentile in PERCENTILES:
+        count = max(1, round(len(latencies) * percentile / 100))
+        value = latencies[count - 1] * 1000
+        print(f"{value:12.3f} {percentile / 100:12.6f} {count:12}")
+    mean = sum(latencies) / len(latencies)
+    print(f"#[Mean = {mean * 1000:.3f} ms, Max = {latencies[-1] * 1000:.3f} ms]")
+
+
+async def main():
+    """Observe the nodes, and change their LEDs to time the notifications."""
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "uris",
+        nargs="+",
+        metavar="URI",
+        help="LED resource of a node, e.g. coap://[fd00::1]/led",
+    )
+    parser.add_argument(
+        "--changes",
+        type=int,
+        default=0,
+        metavar="N",
+        help="switch LED 0 of each node N times and show the notification latency",
+    )
+    parser.add_argument(
+        "--group",
+        metavar="ADDRESS",
+        help="switch LED 0 with --changes PUT requests to this multicast group "
+        "instead, and show the time until the first and the last node have it, "
+        "e.g. ff03::1:10%%wpan0 on the border router (set APP_OBSERVE_HOLDOFF "
+        "to 0 on the nodes for this)",
+    )
+    parser.add_argument(
+        "--lead",
+        type=float,
+        default=0.0,
+        metavar="SECONDS",
+        help="schedule each change this long ahead on nodes built with "
+        "APP_SCHEDULE, and time the notifications from the scheduled time",
+    )
+    parser.add_argument(
+        "--network-time",
+        action="store_true",
+        help="the nodes are built with APP_SCHEDULE_NETWORK_TIME, so they share "
+        "one scheduling clock, which --group with --lead requires",
+    )
+    parser.add_argument(
+        "--interval",
+        type=float,
+        default=1.0,
+        metavar="SECONDS",
+        help="time between two changes (default 1)",
+    )
+    parser.add_argument(
+        "--timeout",
+        type=float,
+        default=5.0,
+        metavar="SECONDS",
+        help="time to wait for the last notifications (default 5)",
+    )
+    parser.add_argument(
+        "--verbose",
+        action="store_true",
+        help="show every notification",
+    )
+    args = parser.parse_args()
+    if args.group and args.lead and not args.network_time:
+        # One group request carries one time for all nodes, and their uptimes
+        # differ.
+        parser.error("--group with --lead requires --network-time")
+
+    context = await aiocoap.Context.create_client_context()
+    observers = [
+        LedObserver(context, uri, args.verbose or not args.changes)
+        for uri in args.uris
+    ]
+    observing = [asyncio.create_task(observer.observe()) for observer in observers]
+    if not args.changes:
+        await asyncio.gather(*observing)
+        return
+
+    # Let the registrations go through before the first change.
+    await asyncio.sleep(1)
+    if args.lead:
+        await asyncio.gather(*(observer.synchronize() for observer in observers))
+    if args.group:
+        first, last, missed = await group_changes(
+            observers,
+            args.group,
+            args.changes,
+            args.interval,
+            args.lead,
+            args.timeout,
+        )
+        print(
+            f"{args.changes} group changes on {len(observers)} nodes, "
+            f"{missed} times a node missed one"
+        )
+        print("Time until the first node has the change:")
+        print_latencies(first)
+        print("Time until all nodes have the change:")
+        print_latencies(last)
+        for task in observing:
+            task.cancel()
+        await context.shutdown()
+        return
+
+    await asyncio.gather(
+        *(
+            observer.change(args.changes, args.interval, args.lead)
+            for observer in observers
+        )
+    )
+    await asyncio.sleep(args.timeout)
+
+    changes = sum(observer.changes for observer in observers)
+    notifications = sum(observer.notifications for observer in observers)
+    latencies = [latency for observer in observers for latency in observer.latencies]
+    print(
+        f"{changes} changes on {len(observers)} nodes, {notifications} "
+        f"notifications, {changes - len(latencies)} changes not notified"
+    )
+    print_latencies(latencies)
+
+    for task in observing:
+        task.cancel()
+    await context.shutdown()
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
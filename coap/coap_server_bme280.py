@@ -4,37 +4,1411 @@ Copyright (c) 2024 Koen Vervloesem
 
 SPDX-License-Identifier: MIT
 """
+import argparse
 import asyncio
+import collections
 import json
+import ipaddress
 import logging
+import multiprocessing
+import os
+import socket
+import sqlite3
+import struct
+import tempfile
+import time
+from datetime import datetime
 
 import aiocoap
-from aiocoap import resource
+import cbor2
+import ifaddr
+from aiocoap import interfaces, resource
+from aiocoap.optiontypes import BlockOption
+from zeroconf import IPVersion, ServiceInfo
+from zeroconf.asyncio import AsyncZeroconf
 
 logging.basicConfig(level=logging.INFO)
 logging.getLogger("coap-server-bme280").setLevel(logging.DEBUG)
 
+COLLECTOR_SERVICE = "_bme280-coll._udp.local."
+COAP_PORT = 5683
+
+CONTENT_FORMAT_JSON = 50
+CONTENT_FORMAT_CBOR = 60
+
+# Integer keys of the CBOR sensor reports
+CBOR_KEY_ID = 0
+CBOR_KEY_TEMP = 1
+CBOR_KEY_PRESS = 2
+CBOR_KEY_HUM = 3
+CBOR_KEY_TIMESTAMP = 4
+CBOR_KEY_UPTIME = 5
+CBOR_KEY_SAMPLES = 6
+CBOR_KEY_SENSORS = 7
+CBOR_KEY_COUNT = 8
+CBOR_KEY_STATS = 9
+CBOR_KEY_SEQ = 10
+CBOR_KEY_BOOT = 11
+
+# Record header in the sensor/history representation: sequence number, boot
+# count and uptime in ms, followed by the temperature in 0.01 °C, pressure in
+# Pa and humidity in 0.01 % of each sensor
+HISTORY_HEADER = ">III"
+HISTORY_READINGS = "iii"
+# Largest block size (1024 bytes), the node picks a smaller one for its link.
+HISTORY_BLOCK_SZX = 6
+
+# Reports waiting for the database writer; more are dropped.
+INGEST_QUEUE_SIZE = 10000
+# Maximum number of reports committed in one transaction
+INGEST_BATCH_SIZE = 500
+# Seconds between two logs of the ingest metrics
+INGEST_METRICS_INTERVAL = 10
+# Number of simulated nodes for --bench
+BENCH_NODES = 300
+# CoAP port, sending processes and source ports per process of --bench-workers
+BENCH_PORT = 5699
+BENCH_SENDERS = 4
+BENCH_SOCKETS = 64
+
+INGEST_SCHEMA = """
+CREATE TABLE IF NOT EXISTS samples (
+    node TEXT, sensor INTEGER, time REAL, temp REAL, press REAL, hum REAL
+);
+CREATE TABLE IF NOT EXISTS stats (
+    node TEXT, sensor INTEGER, channel TEXT, time REAL, count INTEGER,
+    min REAL, max REAL, mean REAL, stddev REAL
+);
+CREATE INDEX IF NOT EXISTS samples_node_time ON samples (node, time);
+CREATE INDEX IF NOT EXISTS stats_node_time ON stats (node, time);
+"""
+STATS_CHANNELS = ("temp", "press", "hum")
+
+# Raw samples kept per node, 2 hours at the default sample interval
+SERIES_RAW_SAMPLES = 1440
+# Resolution in seconds and number of buckets kept of each rollup
+SERIES_ROLLUPS = ((60, 1440), (3600, 31 * 24), (86400, 366))
+# Names of the resolutions in the res= query, 0 is the raw samples.
+SERIES_RESOLUTIONS = {"raw": 0, "1m": 60, "1h": 3600, "1d": 86400}
+# Time span of a query without from=, and points of a query without res=
+SERIES_DEFAULT_SPAN = 3600
+SERIES_MAX_POINTS = 720
+
+# Readings of a node in the database: its samples, and the means of its
+# statistics windows like report_samples() does, one row per sensor.
+SERIES_READINGS = """
+WITH readings AS (
+    SELECT time, sensor, temp, press, hum FROM samples WHERE node = :node
+    UNION ALL
+    SELECT time, sensor,
+        MAX(CASE channel WHEN 'temp' THEN mean END),
+        MAX(CASE channel WHEN 'press' THEN mean END),
+        MAX(CASE channel WHEN 'hum' THEN mean END)
+    FROM stats WHERE node = :node GROUP BY time, sensor
+)
+"""
+
+# Number of recent sequence numbers per node to detect duplicates in
+DELIVERY_WINDOW = 1024
+
+
+def decode_cbor(payload):
+    """Decode a CBOR sensor report to the same fields as a JSON one.
+
+    The integer values are in 0.01 °C, Pa and 0.01 %.
+    """
+    report = cbor2.loads(payload)
+    header = {"id": report[CBOR_KEY_ID].hex().upper()}
+    if CBOR_KEY_SEQ in report:
+        header["seq"] = report[CBOR_KEY_SEQ]
+        header["boot"] = report[CBOR_KEY_BOOT]
+    if CBOR_KEY_STATS in report:
+        return {
+            **header,
+            "ts": report[CBOR_KEY_TIMESTAMP],
+            "up": report[CBOR_KEY_UPTIME],
+            "n": report[CBOR_KEY_COUNT],
+            "stats": [
+                [value / 100 for value in stats] for stats in report[CBOR_KEY_STATS]
+            ],
+        }
+    if CBOR_KEY_SAMPLES in report:
+        # Samples of an earlier boot come without the uptime of the report.
+        if CBOR_KEY_UPTIME in report:
+            header["up"] = report[CBOR_KEY_UPTIME]
+        return {
+            **header,
+            "ts": report[CBOR_KEY_TIMESTAMP],
+            "samples": [
+                [delta, *(value / 100 for value in values)]
+                for delta, *values in report[CBOR_KEY_SAMPLES]
+            ],
+        }
+    if CBOR_KEY_SENSORS in report:
+        return {
+            **header,
+            "sensors": {
+                str(index): [value / 100 for value in values]
+                for index, values in report[CBOR_KEY_SENSORS].items()
+            },
+        }
+    return {
+        **header,
+        "temp": report[CBOR_KEY_TEMP] / 100,
+        "press": report[CBOR_KEY_PRESS] / 100,
+        "hum": report[CBOR_KEY_HUM] / 100,
+    }
+
+
+def group_readings(values):
+    """Group a flat list of values in (temp, press, hum) per sensor index."""
+    return [tuple(values[i : i + 3]) for i in range(0, len(values), 3)]
+
+
+def report_readings(payload):
+    """Return the (temp, press, hum) readings of a report per sensor index."""
+    if "sensors" in payload:
+        return [
+            tuple(payload["sensors"][index])
+            for index in sorted(payload["sensors"], key=int)
+        ]
+    return [(payload["temp"], payload["press"], payload["hum"])]
+
+
+def unpack_batch(payload, received):
+    """Unpack a batch report to a list of (time, readings) samples.
+
+    The readings are (temp, press, hum) tuples per sensor index. The
+    device's uptime when sending the report is matched to the time the
+    report was received to convert the uptime of each sample to a time.
+    A report of samples from an earlier boot of the device has no uptime,
+    so the time of its samples is None.
+    """
+    samples = []
+    timestamp = payload["ts"]
+    for delta, *values in payload["samples"]:
+        timestamp += delta
+        if "up" in payload:
+            age = ((payload["up"] - timestamp) % 2**32) / 1000
+            samples.append((received - age, group_readings(values)))
+        else:
+            samples.append((None, group_readings(values)))
+    return samples
+
+
+def decode_payload(request):
+    """Decode the payload of a sensor report based on its Content-Format."""
+    if request.opt.content_format == CONTENT_FORMAT_CBOR:
+        return "CBOR", decode_cbor(request.payload)
+    return "JSON", json.loads(request.payload)
+
+
+def is_integer(value):
+    """Return whether a decoded value is an integer, and not a boolean."""
+    return isinstance(value, int) and not isinstance(value, bool)
+
+
+def is_number(value):
+    """Return whether a decoded value is an integer or a float."""
+    return is_integer(value) or isinstance(value, float)
+
+
+def is_uint32(value):
+    return is_integer(value) and 0 <= value < 2**32
+
+
+def check_numbers(values, count, name):
+    """Check that a decoded value is a non-empty list of numbers in groups of
+    count."""
+    if (
+        not isinstance(values, list)
+        or not values
+        or len(values) % count
+        or not all(is_number(value) for value in values)
+    ):
+        raise ValueError(f"{name} must be a list of numbers in groups of {count}")
+
+
+def check_report(payload):
+    """Check the fields and their types of a decoded sensor report.
+
+    Raises ValueError with the reason if a required field is missing or has
+    the wrong type, so the report can be refused before it's stored.
+    """
+    if not isinstance(payload, dict):
+        raise ValueError("report must be a map")
+    if not isinstance(payload.get("id"), str) or not payload["id"]:
+        raise ValueError("id must be a non-empty string")
+    if ("seq" in payload or "boot" in payload) and not (
+        is_uint32(payload.get("seq")) and is_uint32(payload.get("boot"))
+    ):
+        raise ValueError("seq and boot must be 32-bit unsigned integers")
+
+    if "stats" in payload:
+        fields = ("ts", "up", "n")
+    elif "samples" in payload:
+        # Samples of an earlier boot come without the uptime of the report.
+        fields = ("ts", "up") if "up" in payload else ("ts",)
+    else:
+        fields = ()
+    for field in fields:
+        if not is_uint32(payload.get(field)):
+            raise ValueError(f"{field} must be a 32-bit unsigned integer")
+
+    if "stats" in payload:
+        stats = payload["stats"]
+        if not isinstance(stats, list) or not stats or len(stats) % 3:
+            raise ValueError("stats must be a list of 3 channels per sensor")
+        for channel in stats:
+            check_numbers(channel, 4, "stats")
+    elif "samples" in payload:
+        if not isinstance(payload["samples"], list) or not payload["samples"]:
+            raise ValueError("samples must be a non-empty list")
+        for sample in payload["samples"]:
+            if not isinstance(sample, list) or not sample or not is_uint32(sample[0]):
+                raise ValueError("sample must start with a time delta in ms")
+            check_numbers(sample[1:], 3, "sample")
+    elif "sensors" in payload:
+        sensors = payload["sensors"]
+        if not isinstance(sensors, dict) or not sensors:
+            raise ValueError("sensors must be a non-empty map")
+        for index, readings in sensors.items():
+            if not isinstance(index, str) or not index.isdigit():
+                raise ValueError("sensor index must be a number")
+            if not isinstance(readings, list) or len(readings) != 3:
+                raise ValueError("sensor readings must be temp, press and hum")
+            check_numbers(readings, 3, "sensor readings")
+    else:
+        for field in ("temp", "press", "hum"):
+            if not is_number(payload.get(field)):
+                raise ValueError(f"{field} must be a number")
+
+
+def print_readings(readings, indent=""):
+    """Show the (temp, press, hum) readings of each sensor."""
+    for index, (temp, press, hum) in enumerate(readings):
+        if len(readings) > 1:
+            print(f"{indent}- Sensor {index}")
+            sensor_indent = indent + "  "
+        else:
+            sensor_indent = indent
+        print(f"{sensor_indent}- Temperature : {temp:.2f} °C")
+        print(f"{sensor_indent}- Pressure    : {press:.2f} hPa")
+        print(f"{sensor_indent}- Humidity    : {hum:.2f} %")
+
+
+def print_stats(payload, received):
+    """Show the min/max/mean/stddev of each channel of each sensor."""
+    age = ((payload["up"] - payload["ts"]) % 2**32) / 1000
+    print(
+        f"- Window      : {payload['n']} samples since "
+        f"{datetime.fromtimestamp(received - age):%H:%M:%S}"
+    )
+    sensors = group_readings(payload["stats"])
+    for index, (temp, press, hum) in enumerate(sensors):
+        if len(sensors) > 1:
+            print(f"- Sensor {index}")
+            indent = "  "
+        else:
+            indent = ""
+        for name, unit, (low, high, mean, stddev) in (
+            ("Temperature", "°C", temp),
+            ("Pressure   ", "hPa", press),
+            ("Humidity   ", "%", hum),
+        ):
+            print(
+                f"{indent}- {name} : {mean:.2f} ± {stddev:.2f} {unit} "
+                f"({low:.2f} .. {high:.2f})"
+            )
+
+
+def print_payload(payload, received, size, payload_format):
+    """Show the sensor measurements in a decoded report."""
+    print(payload["id"])
+    if "stats" in payload:
+        print_stats(payload, received)
+    elif "samples" in payload:
+        for timestamp, readings in unpack_batch(payload, received):
+            if timestamp is None:
+                print("- Unknown time, earlier boot")
+            else:
+                print(f"- {datetime.fromtimestamp(timestamp):%H:%M:%S}")
+            print_readings(readings, "  ")
+    else:
+        print_readings(report_readings(payload))
+    if "seq" in payload:
+        print(f"- Sequence    : {payload['seq']} (boot {payload['boot']:08X})")
+    print(f"- Payload     : {size} bytes {payload_format}")
+
+
+def print_report(message):
+    """Decode and show the sensor measurements in a CoAP message."""
+    payload_format, payload = decode_payload(message)
+    print_payload(payload, time.time(), len(message.payload), payload_format)
+
+
+def report_samples(payload, received):
+    """Return the (time, readings) samples of a report.
+
+    A statistics report counts as one sample with the means of the window,
+    at the start of the window.
+    """
+    if "stats" in payload:
+        age = ((payload["up"] - payload["ts"]) % 2**32) / 1000
+        means = [stats[2] for stats in payload["stats"]]
+        return [(received - age, group_readings(means))]
+    if "samples" in payload:
+        return unpack_batch(payload, received)
+    return [(received, report_readings(payload))]
+
+
+def sample_rows(payload, received):
+    """Return the (node, sensor, time, temp, press, hum) rows of a report.
+
+    The time of a sample from an earlier boot is unknown, and stored as NULL.
+    """
+    samples = report_samples(payload, received)
+    return [
+        (payload["id"], index, timestamp, temp, press, hum)
+        for timestamp, readings in samples
+        for index, (temp, press, hum) in enumerate(readings)
+    ]
+
+
+def stats_rows(payload, received):
+    """Return the rows of a statistics report, one per sensor channel."""
+    age = ((payload["up"] - payload["ts"]) % 2**32) / 1000
+    channels = len(STATS_CHANNELS)
+    return [
+        (
+            payload["id"],
+            index // channels,
+            STATS_CHANNELS[index % channels],
+            received - age,
+            payload["n"],
+            *stats,
+        )
+        for index, stats in enumerate(payload["stats"])
+    ]
+
+
+class Rollup:
+    """Minimum, mean and maximum of each value per bucket of fixed duration.
+
+    Only the buckets in the last span are kept, so the memory is bounded.
+    Samples that arrive late, like the ones a node forwards from its log,
+    still end up in their own bucket if that is in the span.
+    """
+
+    def __init__(self, resolution, buckets):
+        self.resolution = resolution
+        self.span = resolution * buckets
+        self.buckets = {}
+        self.newest = None
+
+    def add(self, timestamp, values):
+        """Add the values of a sample to its bucket."""
+        start = int(timestamp - timestamp % self.resolution)
+        bucket = self.buckets.get(start)
+        if bucket is None:
+            if self.newest is not None and start <= self.newest - self.span:
+                return
+            bucket = self.buckets[start] = [0, [[0, value, value] for value in values]]
+            if self.newest is None or start > self.newest:
+                self.newest = start
+                self.prune()
+        bucket[0] += 1
+        for stats, value in zip(bucket[1], values):
+            stats[0] += value
+            stats[1] = min(stats[1], value)
+            stats[2] = max(stats[2], value)
+
+    def prune(self):
+        """Remove the buckets that fell out of the span."""
+        oldest = self.newest - self.span
+        for start in [start for start in self.buckets if start <= oldest]:
+            del self.buckets[start]
+
+    def query(self, start, end):
+        """Return the [start, count, min, mean, max, ...] rows in the range.
+
+        A bucket that starts before the range but overlaps it is included.
+        """
+        return [
+            [
+                bucket_start,
+                count,
+                *(
+                    value
+                    for total, low, high in stats
+                    for value in (low, round(total / count, 2), high)
+                ),
+            ]
+            for bucket_start, (count, stats) in sorted(self.buckets.items())
+            if start - self.resolution < bucket_start < end
+        ]
+
+
+class TimeSeries:
+    """Recent samples of one node in a ring buffer, and their rollups."""
+
+    def __init__(self):
+        self.raw = collections.deque(maxlen=SERIES_RAW_SAMPLES)
+        self.rollups = {
+            resolution: Rollup(resolution, buckets)
+            for resolution, buckets in SERIES_ROLLUPS
+        }
+        self.sensors = 1
+
+    def add(self, timestamp, readings):
+        """Add the (temp, press, hum) readings of each sensor at a time."""
+        values = [value for reading in readings for value in reading]
+        self.sensors = len(readings)
+        self.raw.append((timestamp, values))
+        for rollup in self.rollups.values():
+            rollup.add(timestamp, values)
+
+    def query_raw(self, start, end):
+        """Return the [time, temp, press, hum, ...] rows in the range."""
+        return [
+            [round(timestamp, 3), *values]
+            for timestamp, values in sorted(self.raw, key=lambda sample: sample[0])
+            if start <= timestamp < end
+        ]
+
+    def auto_resolution(self, start, end):
+        """Pick the finest resolution with at most SERIES_MAX_POINTS points.
+
+        The raw samples only qualify if none of the range was dropped from the
+        ring buffer yet.
+        """
+        complete = len(self.raw) < self.raw.maxlen or (
+            min(timestamp for timestamp, _ in self.raw) <= start
+        )
+        if complete and len(self.query_raw(start, end)) <= SERIES_MAX_POINTS:
+            return 0
+        for resolution in self.rollups:
+            if (end - start) / resolution <= SERIES_MAX_POINTS:
+                return resolution
+        return max(self.rollups)
+
+    def columns(self, resolution):
+        return series_columns(self.sensors, resolution)
+
+    def query(self, start, end, resolution):
+        """Return the rows in the range at a resolution."""
+        if resolution == 0:
+            return self.query_raw(start, end)
+        return self.rollups[resolution].query(start, end)
+
+
+def series_columns(sensors, resolution):
+    """Return the names of the columns of the rows at a resolution."""
+    names = [
+        name if sensors == 1 else f"{index}.{name}"
+        for index in range(sensors)
+        for name in STATS_CHANNELS
+    ]
+    if resolution == 0:
+        return ["time", *names]
+    return [
+        "time",
+        "n",
+        *(f"{name}.{stat}" for name in names for stat in ("min", "mean", "max")),
+    ]
+
+
+class DatabaseSeries:
+    """Samples of one node in the database, with the interface of TimeSeries.
+
+    The rollups are computed by the query, over all samples in the database,
+    so they have no span.
+    """
+
+    def __init__(self, db, node):
+        self.db = db
+        self.node = node
+        (sensors,) = db.execute(
+            f"{SERIES_READINGS} SELECT MAX(sensor) FROM readings", {"node": node}
+        ).fetchone()
+        self.sensors = 0 if sensors is None else sensors + 1
+
+    def query_raw(self, start, end):
+        """Return the [time, temp, press, hum, ...] rows in the range."""
+        rows = {}
+        for timestamp, _, *values in self.db.execute(
+            f"{SERIES_READINGS} SELECT * FROM readings "
+            "WHERE time >= :start AND time < :end ORDER BY time, sensor",
+            {"node": self.node, "start": start, "end": end},
+        ):
+            rows.setdefault(timestamp, [round(timestamp, 3)]).extend(values)
+        return list(rows.values())
+
+    def auto_resolution(self, start, end):
+        """Pick the finest resolution with at most SERIES_MAX_POINTS points."""
+        (count,) = self.db.execute(
+            f"{SERIES_READINGS} SELECT COUNT(DISTINCT time) FROM readings "
+            "WHERE time >= :start AND time < :end",
+            {"node": self.node, "start": start, "end": end},
+        ).fetchone()
+        if count <= SERIES_MAX_POINTS:
+            return 0
+        for resolution, _ in SERIES_ROLLUPS:
+            if (end - start) / resolution <= SERIES_MAX_POINTS:
+                return resolution
+        return SERIES_ROLLUPS[-1][0]
+
+    def columns(self, resolution):
+        return series_columns(self.sensors, resolution)
+
+    def query(self, start, end, resolution):
+        """Return the rows in the range at a resolution, like Rollup.query()."""
+        if resolution == 0:
+            return self.query_raw(start, end)
+        rows = {}
+        for bucket_start, _, count, *values in self.db.execute(
+            f"{SERIES_READINGS} SELECT CAST(time / :res AS INTEGER) * :res AS bucket, "
+            "sensor, COUNT(*), MIN(temp), AVG(temp), MAX(temp), MIN(press), "
+            "AVG(press), MAX(press), MIN(hum), AVG(hum), MAX(hum) FROM readings "
+            "WHERE time > :start - :res AND time < :end + :res "
+            "GROUP BY bucket, sensor HAVING bucket > :start - :res AND bucket < :end "
+            "ORDER BY bucket, sensor",
+            {"node": self.node, "start": start, "end": end, "res": resolution},
+        ):
+            row = rows.setdefault(bucket_start, [bucket_start, count])
+            row.extend(
+                round(value, 2) if index % 3 == 1 else value
+                for index, value in enumerate(values)
+            )
+        return list(rows.values())
+
+
+class SeriesResource(resource.Resource):
+    """CoAP resource with the recent samples of one node.
+
+    GET /sensor/<id>?from=<time>&to=<time>&res=<raw|1m|1h|1d> returns JSON
+    with the column names and a row per sample or per bucket. The times are
+    Unix times; the range defaults to the last hour and the resolution to
+    the finest one with at most SERIES_MAX_POINTS rows.
+    """
+
+    def __init__(self, node, series):
+        super().__init__()
+        self.node = node
+        self.series = series
+
+    async def render_get(self, request):
+        """Handle CoAP GET request and return the samples in the range."""
+        return series_response(self.node, self.series, request)
+
+
+def series_response(node, series, request):
+    """Return the response to a GET request of the samples of a node."""
+    query = dict(
+        option.split("=", 1) for option in request.opt.uri_query if "=" in option
+    )
+    try:
+        end = float(query.get("to", time.time()))
+        start = float(query.get("from", end - SERIES_DEFAULT_SPAN))
+        if "res" in query:
+            resolution = SERIES_RESOLUTIONS[query["res"]]
+        else:
+            resolution = series.auto_resolution(start, end)
+    except (ValueError, KeyError):
+        return aiocoap.Message(
+            code=aiocoap.BAD_REQUEST,
+            payload=b"from and to are Unix times, res is raw, 1m, 1h or 1d",
+        )
+
+    report = {
+        "id": node,
+        "res": resolution,
+        "columns": series.columns(resolution),
+        "rows": series.query(start, end, resolution),
+    }
+    return aiocoap.Message(
+        payload=json.dumps(report, separators=(",", ":")).encode(),
+        content_format=CONTENT_FORMAT_JSON,
+    )
+
+
+class DatabaseSeriesResource(resource.Resource, interfaces.PathCapable):
+    """CoAP resources with the samples of all nodes in the database.
+
+    With several worker processes, the reports of a node only reach one of
+    them, so none has all series in memory. GET /sensor/<id> then reads the
+    samples that all workers stored in the shared database, in the same
+    format as SeriesResource.
+    """
+
+    def __init__(self, path):
+        super().__init__()
+        self.db = sqlite3.connect(path, timeout=30, check_same_thread=False)
+        self.lock = asyncio.Lock()
+
+    def respond(self, node, request):
+        series = DatabaseSeries(self.db, node)
+        if series.sensors == 0:
+            return aiocoap.Message(code=aiocoap.NOT_FOUND)
+        return series_response(node, series, request)
+
+    async def render_get(self, request):
+        """Handle CoAP GET request of /sensor/<id> and return its samples."""
+        if len(request.opt.uri_path) != 1:
+            return aiocoap.Message(code=aiocoap.NOT_FOUND)
+        async with self.lock:
+            return await asyncio.to_thread(
+                self.respond, request.opt.uri_path[0], request
+            )
+
+
+class SeriesStore:
+    """In-memory time series of all nodes, each served as /sensor/<id>."""
+
+    def __init__(self, site):
+        self.site = site
+        self.series = {}
+
+    def add(self, payload, received):
+        """Add the samples of a decoded report to the series of its node.
+
+        Samples of an unknown time can't be placed in a series, so they're
+        only in the database.
+        """
+        node = payload["id"]
+        series = self.series.get(node)
+        if series is None:
+            series = self.series[node] = TimeSeries()
+            self.site.add_resource(["sensor", node], SeriesResource(node, series))
+        for timestamp, readings in report_samples(payload, received):
+            if timestamp is not None:
+                series.add(timestamp, readings)
+
+
+class Delivery:
+    """Delivery counters of the sequence numbered reports of one node.
+
+    A gap in the sequence numbers counts as lost reports until a late report
+    fills it, which then counts as reordered. A report seen before counts as
+    a duplicate, as does one more than DELIVERY_WINDOW reports late, which
+    can't be told apart from one. A new boot ID counts as a reboot; the
+    reports of the new boot before the first one received are lost. For the
+    first boot seen, the collector doesn't know where the node started, so
+    it only counts the gaps after the first report received.
+    """
+
+    def __init__(self):
+        self.boot = None
+        self.base = 0
+        self.top = 0
+        self.window = 0
+        self.received = 0
+        self.lost = 0
+        self.reordered = 0
+        self.duplicates = 0
+        self.reboots = 0
+
+    def add(self, boot, seq):
+        """Count a report with the given boot ID and sequence number."""
+        if boot != self.boot:
+            if self.boot is None:
+                self.base = seq
+            else:
+                self.reboots += 1
+                self.lost += seq
+                self.base = 0
+            self.boot = boot
+            self.top = seq
+            self.window = 1
+            self.received += 1
+            return
+
+        ahead = (seq - self.top) % 2**32
+        if 0 < ahead < 2**31:
+            self.lost += ahead - 1
+            # A jump of up to 2**31 would make a huge integer of the shifted
+            # window, so one beyond the window just starts a new one.
+            if ahead < DELIVERY_WINDOW:
+                self.window = (self.window << ahead | 1) & (2**DELIVERY_WINDOW - 1)
+            else:
+                self.window = 1
+            self.top = seq
+            self.received += 1
+            return
+
+        behind = (self.top - seq) % 2**32
+        if behind >= DELIVERY_WINDOW or self.window >> behind & 1:
+            self.duplicates += 1
+            return
+        self.window |= 1 << behind
+        self.received += 1
+        self.reordered += 1
+        # A report below the first one received is less than behind below it.
+        below = (self.base - seq) % 2**32
+        if 0 < below < behind:
+            # The reports between it and the first one received are lost.
+            self.lost += below - 1
+            self.base = seq
+        else:
+            self.lost -= 1
+
+    def ratio(self):
+        """Return the fraction of the sent reports that were received."""
+        return self.received / max(self.received + self.lost, 1)
+
+    def as_dict(self):
+        """Return the counters, and the last boot ID and sequence number."""
+        counters = {} if self.boot is None else {"boot": self.boot, "seq": self.top}
+        return {
+            **counters,
+            "received": self.received,
+            "lost": self.lost,
+            "reordered": self.reordered,
+            "duplicates": self.duplicates,
+            "reboots": self.reboots,
+            "ratio": round(self.ratio(), 4),
+        }
+
+
+class DeliveryResource(resource.Resource):
+    """CoAP resource with the delivery counters of all nodes.
+
+    GET /delivery returns JSON with the counters of each node and their
+    sum. With several worker processes, each worker only counts the nodes
+    whose reports it receives.
+    """
+
+    def __init__(self, tracker):
+        super().__init__()
+        self.tracker = tracker
+
+    async def render_get(self, request):
+        """Handle CoAP GET request and return the delivery counters."""
+        report = {
+            "total": self.tracker.total().as_dict(),
+            "nodes": {
+                node: delivery.as_dict()
+                for node, delivery in sorted(self.tracker.nodes.items())
+            },
+        }
+        return aiocoap.Message(
+            payload=json.dumps(report, separators=(",", ":")).encode(),
+            content_format=CONTENT_FORMAT_JSON,
+        )
+
+
+class DeliveryTracker:
+    """Delivery counters of all nodes that send sequence numbers."""
+
+    def __init__(self):
+        self.nodes = {}
+
+    def add(self, payload):
+        """Count a decoded report in the order it arrived."""
+        if "seq" not in payload:
+            return
+        delivery = self.nodes.get(payload["id"])
+        if delivery is None:
+            delivery = self.nodes[payload["id"]] = Delivery()
+        delivery.add(payload["boot"], payload["seq"])
+
+    def total(self):
+        """Return the sum of the counters of all nodes."""
+        total = Delivery()
+        for delivery in self.nodes.values():
+            total.received += delivery.received
+            total.lost += delivery.lost
+            total.reordered += delivery.reordered
+            total.duplicates += delivery.duplicates
+            total.reboots += delivery.reboots
+        return total
+
+    async def log_metrics(self):
+        """Log the delivery counters of all nodes periodically."""
+        while True:
+            await asyncio.sleep(INGEST_METRICS_INTERVAL)
+            total = self.total()
+            logging.info(
+                "Delivery %s: %d nodes, %d received, %d lost (ratio %.4f), "
+                "%d reordered, %d duplicates, %d reboots",
+                multiprocessing.current_process().name,
+                len(self.nodes),
+                total.received,
+                total.lost,
+                total.ratio(),
+                total.reordered,
+                total.duplicates,
+                total.reboots,
+            )
+
+
+class Ingest:
+    """Store decoded sensor reports in SQLite in batches.
+
+    The CoAP handler only decodes a report and puts it in a bounded queue,
+    so it never waits for the disk. A writer task takes the queued reports
+    in batches and commits each batch in one transaction in a worker thread.
+    The database is in WAL mode, so it can be read while it's written, and
+    several worker processes can share it. The reports are also added to
+    the in-memory time series, if there is a store for them.
+    """
+
+    def __init__(self, path, verbose=False, store=None):
+        self.queue = asyncio.Queue(maxsize=INGEST_QUEUE_SIZE)
+        self.verbose = verbose
+        self.store = store
+        self.db = sqlite3.connect(path, timeout=30, check_same_thread=False)
+        self.db.execute("PRAGMA journal_mode=WAL")
+        self.db.execute("PRAGMA synchronous=NORMAL")
+        self.db.executescript(INGEST_SCHEMA)
+        self.queued = 0
+        self.stored = 0
+        self.dropped = 0
+        self.failed = 0
+        self.max_depth = 0
+
+    def submit(self, report):
+        """Queue a (received, size, format, payload) report for the writer."""
+        try:
+            self.queue.put_nowait(report)
+        except asyncio.QueueFull:
+            self.dropped += 1
+            return
+        self.queued += 1
+        self.max_depth = max(self.max_depth, self.queue.qsize())
+
+    def write(self, reports):
+        """Commit a batch of reports in one transaction."""
+        samples = []
+        stats = []
+        for received, _, _, payload in reports:
+            if "stats" in payload:
+                stats.extend(stats_rows(payload, received))
+            else:
+                samples.extend(sample_rows(payload, received))
+        with self.db:
+            self.db.executemany(
+                "INSERT INTO samples VALUES (?, ?, ?, ?, ?, ?)", samples
+            )
+            self.db.executemany(
+                "INSERT INTO stats VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", stats
+            )
+
+    async def run(self):
+        """Write the queued reports to the database as they come in."""
+        while True:
+            reports = [await self.queue.get()]
+            while len(reports) < INGEST_BATCH_SIZE and not self.queue.empty():
+                reports.append(self.queue.get_nowait())
+
+            # A batch that fails, because of data that got past the checks or
+            # a database that stays locked, is logged and dropped, so the
+            # writer keeps running.
+            try:
+                await asyncio.to_thread(self.write, reports)
+            except Exception:
+                logging.exception("Failed to store %d reports", len(reports))
+                self.failed += len(reports)
+            else:
+                self.stored += len(reports)
+                for received, size, payload_format, payload in reports:
+                    try:
+                        if self.store is not None:
+                            self.store.add(payload, received)
+                        if self.verbose:
+                            print_payload(payload, received, size, payload_format)
+                    except Exception:
+                        logging.exception("Failed to add report of %s", payload["id"])
+            finally:
+                for _ in reports:
+                    self.queue.task_done()
+
+    async def log_metrics(self):
+        """Log the queue depth and the ingest rate periodically."""
+        stored = self.stored
+        started = time.monotonic()
+        while True:
+            await asyncio.sleep(INGEST_METRICS_INTERVAL)
+            now = time.monotonic()
+            logging.info(
+                "Ingest %s: %.0f reports/s, queue depth %d (max %d) of %d, "
+                "%d stored, %d dropped, %d failed",
+                multiprocessing.current_process().name,
+                (self.stored - stored) / (now - started),
+                self.queue.qsize(),
+                self.max_depth,
+                INGEST_QUEUE_SIZE,
+                self.stored,
+                self.dropped,
+                self.failed,
+            )
+            stored = self.stored
+            started = now
+            self.max_depth = 0
+
 
 class Sensor(resource.Resource):
     """CoAP resource for a sensor."""
 
+    def __init__(self, ingest, tracker=None):
+        super().__init__()
+        self.ingest = ingest
+        self.tracker = tracker
+
     async def render_put(self, request):
-        """Handle CoAP PUT request and process sensor measurement."""
-        payload = json.loads(request.payload)
-        print(payload["id"])
-        print(f"- Temperature : {payload['temp']} °C")
-        print(f"- Pressure    : {payload['press']} hPa")
-        print(f"- Humidity    : {payload['hum']} %")
+        """Handle CoAP PUT request and queue the sensor measurement.
+
+        A report that can't be decoded, or that misses a required field or
+        has one of the wrong type, is answered with 4.00 Bad Request.
+        """
+        try:
+            payload_format, payload = decode_payload(request)
+            check_report(payload)
+        except (ValueError, KeyError, TypeError, AttributeError) as error:
+            logging.warning("Invalid sensor report: %s", error)
+            return aiocoap.Message(
+                code=aiocoap.BAD_REQUEST, payload=str(error).encode()
+            )
+
+        if self.tracker is not None:
+            self.tracker.add(payload)
+        self.ingest.submit((time.time(), len(request.payload), payload_format, payload))
         return aiocoap.Message(no_response=True)
 
 
-async def main():
-    """Create a CoAP resource and start the server."""
+def synthetic_reports(count):
+    """Create single-sensor reports of BENCH_NODES nodes, half of them CBOR."""
+    messages = []
+    for i in range(count):
+        node = (0xF4CE360000000000 + i % BENCH_NODES).to_bytes(8, "big")
+        temp, press, hum = 2150 + i % 50, 101325 + i % 200, 4500 + i % 300
+        if i % 2:
+            payload = cbor2.dumps(
+                {
+                    CBOR_KEY_ID: node,
+                    CBOR_KEY_TEMP: temp,
+                    CBOR_KEY_PRESS: press,
+                    CBOR_KEY_HUM: hum,
+                }
+            )
+            content_format = CONTENT_FORMAT_CBOR
+        else:
+            report = {
+                "id": node.hex().upper(),
+                "temp": temp / 100,
+                "press": press / 100,
+                "hum": hum / 100,
+            }
+            payload = json.dumps(report, separators=(",", ":")).encode()
+            content_format = CONTENT_FORMAT_JSON
+        messages.append(
+            aiocoap.Message(
+                code=aiocoap.PUT, payload=payload, content_format=content_format
+            )
+        )
+    return messages
+
+
+async def bench(count):
+    """Replay synthetic reports through the ingest pipeline and show the rate.
+
+    The reports go through the CoAP handler, including decoding, into a
+    temporary database. The event loop is yielded after each report, like
+    between two datagrams.
+    """
+    messages = synthetic_reports(count)
+    with tempfile.TemporaryDirectory() as directory:
+        ingest = Ingest(f"{directory}/bench.db")
+        sensor = Sensor(ingest)
+        writer = asyncio.create_task(ingest.run())
+
+        started = time.perf_counter()
+        for message in messages:
+            await sensor.render_put(message)
+            await asyncio.sleep(0)
+        await ingest.queue.join()
+        elapsed = time.perf_counter() - started
+
+        writer.cancel()
+        ingest.db.close()
+
+    print(
+        f"{ingest.stored} reports stored in {elapsed:.2f} s "
+        f"({ingest.stored / elapsed:.0f} reports/s), "
+        f"{ingest.dropped} dropped, max queue depth {ingest.max_depth}"
+    )
+
+
+async def observe(context, uri):
+    """Observe the sensor resource of a node and show its notifications."""
+    request = aiocoap.Message(code=aiocoap.GET, uri=uri, observe=0)
+    pending = context.request(request)
+
+    response = await pending.response
+    if response.payload:
+        print_report(response)
+
+    async for notification in pending.observation:
+        print_report(notification)
+
+
+def routable_ipv6_addresses():
+    """Return the routable IPv6 addresses of this host's interfaces.
+
+    Thread nodes can only reach the collector via the border router, so
+    link-local addresses are of no use to them.
+    """
+    addresses = []
+    for adapter in ifaddr.get_adapters():
+        for ip in adapter.ips:
+            if not ip.is_IPv6:
+                continue
+            address = ipaddress.IPv6Address(ip.ip[0])
+            if not (address.is_link_local or address.is_loopback):
+                addresses.append(str(address))
+    return addresses
+
+
+async def register_collector():
+    """Register the collector service with mDNS.
+
+    The border router's discovery proxy makes it available to the Thread
+    nodes with DNS-SD as _bme280-coll._udp.default.service.arpa.
+    """
+    hostname = socket.gethostname()
+    info = ServiceInfo(
+        COLLECTOR_SERVICE,
+        f"{hostname}.{COLLECTOR_SERVICE}",
+        port=COAP_PORT,
+        parsed_addresses=routable_ipv6_addresses(),
+        server=f"{hostname}.local.",
+    )
+    aiozc = AsyncZeroconf(ip_version=IPVersion.V6Only)
+    await aiozc.async_register_service(info)
+    logging.info(
+        "Registered %s at %s", info.name, ", ".join(info.parsed_addresses())
+    )
+    return aiozc, info
+
+
+async def fetch_transfer(context, uri, start, block_sizes):
+    """Download one transfer of the sample log of a node block by block.
+
+    The first block fixes the window of records of the transfer, and its
+    ETag holds the first and the end sequence number of the window. The
+    other blocks ask for that window explicitly, so they don't shift when
+    the node logs a new sample during the transfer.
+    """
+    payload = b""
+    block = BlockOption.BlockwiseTuple(0, False, HISTORY_BLOCK_SZX)
+    query = "" if start is None else f"?from={start}"
+
+    while True:
+        request = aiocoap.Message(code=aiocoap.GET, uri=uri + query)
+        request.opt.block2 = block
+        response = await context.request(request, handle_blockwise=False).response
+        if not response.code.is_successful():
+            raise RuntimeError(f"{uri}: {response.code}")
+
+        payload += response.payload
+        received = response.opt.block2
+        if received is None:
+            break
+        block_sizes.add(received.size)
+        if not received.more:
+            break
+        if received.block_number == 0:
+            first, end = struct.unpack(">II", response.opt.etag)
+            query = f"?from={first}&to={end}"
+        block = BlockOption.BlockwiseTuple(
+            received.block_number + 1, False, received.size_exponent
+        )
+
+    return payload
+
+
+async def fetch_history(context, uri, start, sensors):
+    """Download the sample log of a node and show the rate.
+
+    A transfer has at most APP_HISTORY_TRANSFER_RECORDS records of the node,
+    so the next one asks for the records after the last one received. A
+    transfer that is shorter than the longest one reached the end of the
+    log; the samples that the node logs after that are left for the next
+    download.
+    """
+    payload = b""
+    block_sizes = set()
+    record = struct.Struct(HISTORY_HEADER + HISTORY_READINGS * sensors)
+    longest = 0
+    started = time.perf_counter()
+
+    while True:
+        transfer = await fetch_transfer(context, uri, start, block_sizes)
+        payload += transfer
+        if len(transfer) < max(longest, record.size):
+            break
+        longest = len(transfer)
+        start = record.unpack_from(transfer, len(transfer) - record.size)[0] + 1
+
+    elapsed = time.perf_counter() - started
+    records = list(record.iter_unpack(payload))
+    # Records with boot count 0 were overwritten in the node's log.
+    samples = [record for record in records if record[1]]
+    for seq, boot, uptime, *values in samples:
+        readings = " | ".join(
+            f"{temp / 100:6.2f} °C {press / 100:7.2f} hPa {hum / 100:6.2f} %"
+            for temp, press, hum in group_readings(values)
+        )
+        print(f"{seq:>8} boot {boot:<3} {uptime / 1000:>10.1f} s {readings}")
+    print(
+        f"{uri}: {len(samples)} samples ({len(records) - len(samples)} lost), "
+        f"{len(payload)} bytes in {elapsed:.2f} s "
+        f"({len(payload) / elapsed:.0f} bytes/s), "
+        f"block sizes {', '.join(str(size) for size in sorted(block_sizes))}"
+    )
+
+
+async def serve(path, verbose, bind=None, shared=False):
+    """Run the CoAP server and store the reports it receives.
+
+    A worker that shares the database with others serves the series of the
+    nodes from the database instead of from memory.
+    """
     root = resource.Site()
-    root.add_resource(["sensor"], Sensor())
+    if shared:
+        ingest = Ingest(path, verbose)
+        root.add_resource(["sensor"], DatabaseSeriesResource(path))
+    else:
+        ingest = Ingest(path, verbose, SeriesStore(root))
+    tracker = DeliveryTracker()
+    root.add_resource(["sensor"], Sensor(ingest, tracker))
+    root.add_resource(["delivery"], DeliveryResource(tracker))
+
+    await aiocoap.Context.create_server_context(root, bind=bind)
+    await asyncio.gather(ingest.run(), ingest.log_metrics(), tracker.log_metrics())
+
+
+def run_worker(path, verbose, port):
+    """Run a server process that shares the CoAP port with the others."""
+    # aiocoap sets SO_REUSEPORT on its server socket if this is set.
+    os.environ["AIOCOAP_REUSE_PORT"] = "1"
+    asyncio.run(serve(path, verbose, ("::", port), shared=True))
+
+
+def start_workers(count, path, verbose=False, port=COAP_PORT):
+    """Start server processes that bind the same CoAP port.
+
+    The kernel spreads the datagrams over their sockets by a hash of the
+    source address and port, so all reports of a node go to the same worker.
+    The workers share the SQLite database.
+    """
+    # Create the database before the workers race to do it.
+    Ingest(path).db.close()
+    workers = [
+        multiprocessing.Process(
+            target=run_worker,
+            args=(path, verbose, port),
+            name=f"worker-{index}",
+            daemon=True,
+        )
+        for index in range(count)
+    ]
+    for worker in workers:
+        worker.start()
+    return workers
+
+
+def bench_datagrams(count):
+    """Encode synthetic reports as NON PUT requests to the sensor resource.
+
+    The message IDs only repeat per source port after 65536 messages, so the
+    server doesn't drop any as duplicates.
+    """
+    datagrams = []
+    for index, message in enumerate(synthetic_reports(count)):
+        message.mtype = aiocoap.NON
+        message.mid = (index // BENCH_SOCKETS) % 2**16
+        message.token = b""
+        message.opt.uri_path = ("sensor",)
+        datagrams.append(message.encode())
+    return datagrams
+
+
+def send_datagrams(datagrams, port):
+    """Send datagrams to the collector over loopback from many source ports."""
+    sockets = [
+        socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+        for _ in range(BENCH_SOCKETS)
+    ]
+    for index, datagram in enumerate(datagrams):
+        sockets[index % BENCH_SOCKETS].sendto(datagram, ("::1", port))
+
+
+def count_stored(path):
+    """Return the number of samples in the database."""
+    db = sqlite3.connect(path, timeout=30)
+    try:
+        return db.execute("SELECT COUNT(*) FROM samples").fetchone()[0]
+    finally:
+        db.close()
+
+
+async def bench_workers(max_workers, count):
+    """Measure the ingest rate over loopback with 1 to max_workers workers.
+
+    Each round sends count reports as fast as BENCH_SENDERS processes can,
+    more than the workers can take, and measures how fast they're stored
+    until the count stops increasing. Reports that overflow the socket
+    buffers are lost, which is why the count of stored reports is shown.
+    """
+    datagrams = bench_datagrams(count)
+    chunk = -(-count // BENCH_SENDERS)
+    rates = []
+
+    for workers in range(1, max_workers + 1):
+        with tempfile.TemporaryDirectory() as directory:
+            path = f"{directory}/bench.db"
+            servers = start_workers(workers, path, port=BENCH_PORT)
+            await asyncio.sleep(2)
+
+            senders = [
+                multiprocessing.Process(
+                    target=send_datagrams,
+                    args=(datagrams[i : i + chunk], BENCH_PORT),
+                )
+                for i in range(0, count, chunk)
+            ]
+            started = time.perf_counter()
+            for sender in senders:
+                sender.start()
+
+            stored = 0
+            last_change = started
+            while any(sender.is_alive() for sender in senders) or (
+                time.perf_counter() - last_change < 1
+            ):
+                await asyncio.sleep(0.25)
+                now_stored = await asyncio.to_thread(count_stored, path)
+                if now_stored != stored:
+                    stored = now_stored
+                    last_change = time.perf_counter()
+
+            for process in senders + servers:
+                process.terminate()
+                process.join()
+
+        rates.append(stored / (last_change - started))
+        print(
+            f"{workers} worker(s): {stored} of {count} reports stored, "
+            f"{rates[-1]:.0f} reports/s, speedup {rates[-1] / rates[0]:.2f}"
+        )
+
+
+async def main():
+    """Create a CoAP resource and start the server, or observe nodes."""
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "--observe",
+        nargs="+",
+        metavar="URI",
+        help="observe the sensor resource of nodes, e.g. coap://[fd00::1]/sensor",
+    )
+    parser.add_argument(
+        "--history",
+        nargs="+",
+        metavar="URI",
+        help="download the sample log of nodes, e.g. coap://[fd00::1]/sensor/history",
+    )
+    parser.add_argument(
+        "--from",
+        dest="start",
+        type=int,
+        metavar="SEQ",
+        help="download the sample log from this sequence number on",
+    )
+    parser.add_argument(
+        "--sensors",
+        type=int,
+        default=1,
+        metavar="N",
+        help="number of BME280 sensors on the nodes in the sample log (default 1)",
+    )
+    parser.add_argument(
+        "--db",
+        default="bme280.db",
+        metavar="PATH",
+        help="SQLite database to store the reports in (default bme280.db)",
+    )
+    parser.add_argument(
+        "--verbose",
+        action="store_true",
+        help="show every stored report",
+    )
+    parser.add_argument(
+        "--bench",
+        type=int,
+        metavar="COUNT",
+        help="replay COUNT synthetic reports and show the ingest rate, or "
+        "send COUNT reports per round with --bench-workers (default 200000)",
+    )
+    parser.add_argument(
+        "--workers",
+        type=int,
+        default=1,
+        metavar="N",
+        help="run N server processes that share the CoAP port (default 1); "
+        "they serve GET /sensor/<id> from the database",
+    )
+    parser.add_argument(
+        "--bench-workers",
+        type=int,
+        metavar="N",
+        help="measure the ingest rate over loopback with 1 to N workers",
+    )
+    parser.add_argument(
+        "--no-register",
+        action="store_true",
+        help=f"don't register the {COLLECTOR_SERVICE} service with mDNS",
+    )
+    args = parser.parse_args()
+
+    if args.bench_workers:
+        await bench_workers(args.bench_workers, args.bench or 200000)
+        return
+
+    if args.bench:
+        await bench(args.bench)
+        return
+
+    if args.history:
+        context = await aiocoap.Context.create_client_context()
+        for uri in args.history:
+            await fetch_history(context, uri, args.start, args.sensors)
+        return
+
+    if args.observe:
+        context = await aiocoap.Context.create_client_context()
+        await asyncio.gather(*(observe(context, uri) for uri in args.observe))
+        return
+
+    if args.workers > 1:
+        workers = start_workers(args.workers, args.db, args.verbose)
+        running = asyncio.gather(
+            *(asyncio.to_thread(worker.join) for worker in workers)
+        )
+    else:
+        running = serve(args.db, args.verbose)
+
+    if args.no_register:
+        await running
+        return
 
-    await aiocoap.Context.create_server_context(root)
-    await asyncio.get_running_loop().create_future()
+    aiozc, info = await register_collector()
+    try:
+        await running
+    finally:
+        await aiozc.async_unregister_service(info)
+        await aiozc.async_close()
 
 
 if __name__ == "__main__":
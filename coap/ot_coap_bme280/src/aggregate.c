@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "aggregate.h"
+
+void aggregate_add(struct aggregate *agg, const struct sensor_sample *sample) {
+  if (agg->count == 0) {
+    agg->start = sample->timestamp;
+  }
+  agg->count++;
+
+  for (size_t i = 0; i < REPORT_SENSOR_COUNT; i++) {
+    const struct sensor_report *report = &sample->report[i];
+    struct sensor_stats *stats = &agg->sensor[i];
+
+    channel_stats_add(&stats->temp, agg->count, report_temp_centi(report));
+    channel_stats_add(&stats->press, agg->count, report_press_pa(report));
+    channel_stats_add(&stats->hum, agg->count, report_hum_centi(report));
+  }
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "channel_stats.h"
+#include "report.h"
+
+/* Statistics of the temperature, pressure and humidity of a sensor */
+struct sensor_stats {
+  struct channel_stats temp;
+  struct channel_stats press;
+  struct channel_stats hum;
+};
+
+/* Statistics of all sensors over a reporting window */
+struct aggregate {
+  /* Uptime in milliseconds of the first sample in the window */
+  uint32_t start;
+  uint32_t count;
+  struct sensor_stats sensor[REPORT_SENSOR_COUNT];
+};
+
+/* Add a sample to the window, in units of 0.01 °C, Pa and 0.01 %. */
+void aggregate_add(struct aggregate *agg, const struct sensor_sample *sample);
+
+/* Mean, rounded half away from zero */
+static inline int32_t aggregate_mean(const struct aggregate *agg,
+                                     const struct channel_stats *stats) {
+  return channel_stats_mean(stats, agg->count);
+}
+
+/* Sample standard deviation, rounded, or 0 for less than two samples */
+static inline int32_t aggregate_stddev(const struct aggregate *agg,
+                                       const struct channel_stats *stats) {
+  return channel_stats_stddev(stats, agg->count);
+}
+
+static inline uint32_t aggregate_count(const struct aggregate *agg) {
+  return agg->count;
+}
+
+static inline void aggregate_clear(struct aggregate *agg) { agg->count = 0; }
+
+#endif /* AGGREGATE_H_ */
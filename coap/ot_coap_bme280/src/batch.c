@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "batch.h"
+
+void batch_add(struct sample_batch *batch, const struct sensor_sample *sample) {
+  size_t tail = (batch->head + batch->count) % CONFIG_APP_BATCH_SIZE;
+
+  batch->samples[tail] = *sample;
+  if (batch_is_full(batch)) {
+    batch->head = (batch->head + 1) % CONFIG_APP_BATCH_SIZE;
+  } else {
+    batch->count++;
+  }
+}
+
+const struct sensor_sample *batch_get(const struct sample_batch *batch,
+                                      size_t i) {
+  return &batch->samples[(batch->head + i) % CONFIG_APP_BATCH_SIZE];
+}
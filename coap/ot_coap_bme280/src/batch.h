@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "report.h"
+
+/*
+ * Ring buffer with the last CONFIG_APP_BATCH_SIZE samples. If the batch is
+ * full, a new sample overwrites the oldest one.
+ */
+struct sample_batch {
+  struct sensor_sample samples[CONFIG_APP_BATCH_SIZE];
+  size_t head;
+  size_t count;
+};
+
+void batch_add(struct sample_batch *batch, const struct sensor_sample *sample);
+
+/* Get the i-th sample in the batch, starting from the oldest one. */
+const struct sensor_sample *batch_get(const struct sample_batch *batch,
+                                      size_t i);
+
+static inline size_t batch_count(const struct sample_batch *batch) {
+  return batch->count;
+}
+
+static inline bool batch_is_full(const struct sample_batch *batch) {
+  return batch->count == CONFIG_APP_BATCH_SIZE;
+}
+
+static inline void batch_clear(struct sample_batch *batch) {
+  batch->count = 0;
+}
+
+#endif /* BATCH_H_ */
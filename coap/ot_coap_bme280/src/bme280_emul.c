@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Emulator of a BME280 on an emulated I2C bus, such as the one of native_sim.
+ * Zephyr has no BME280 emulator, so this one implements just the registers
+ * that the BME280 driver uses: the chip ID, soft reset, status, control and
+ * calibration registers and the measurement registers.
+ *
+ * The calibration data is the example of the BMP280 datasheet, with typical
+ * humidity coefficients. Each forced measurement returns about 25 °C plus
+ * 1 °C per instance, with a triangle of 1 °C over an hour of default samples
+ * so report-on-change has something to report, about 1007 hPa and 42 %.
+ */
+
+#define DT_DRV_COMPAT bosch_bme280
+
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#define BME280_EMUL_REG_CALIB00 0x88
+#define BME280_EMUL_REG_CHIP_ID 0xd0
+#define BME280_EMUL_REG_RESET 0xe0
+#define BME280_EMUL_REG_CALIB26 0xe1
+#define BME280_EMUL_REG_CTRL_HUM 0xf2
+#define BME280_EMUL_REG_CTRL_MEAS 0xf4
+#define BME280_EMUL_REG_CONFIG 0xf5
+#define BME280_EMUL_REG_DATA 0xf7
+
+#define BME280_EMUL_CHIP_ID 0x60
+#define BME280_EMUL_RESET_CMD 0xb6
+#define BME280_EMUL_MODE_MASK 0x03
+
+/* Raw ADC values, about 3175 per °C for the temperature */
+#define BME280_EMUL_ADC_TEMP 519888
+#define BME280_EMUL_ADC_TEMP_PER_DEGREE 3175
+#define BME280_EMUL_ADC_PRESS 415148
+#define BME280_EMUL_ADC_HUM 27300
+
+/* Measurements per period of the temperature triangle */
+#define BME280_EMUL_PERIOD 720
+
+/*
+ * Calibration registers 0x88 to 0xa1: dig_T1 to dig_T3 and dig_P1 to dig_P9
+ * as little-endian 16-bit values, a reserved byte and dig_H1.
+ */
+static const uint8_t calib00[] = {
+    0x70, 0x6b, 0x43, 0x67, 0x18, 0xfc, 0x7d, 0x8e, 0x43, 0xd6,
+    0xd0, 0x0b, 0x27, 0x0b, 0x8c, 0x00, 0xf9, 0xff, 0x8c, 0x3c,
+    0xf8, 0xc6, 0x70, 0x17, 0x00, 0x4b};
+
+/*
+ * Calibration registers 0xe1 to 0xe7: dig_H2 = 370, dig_H3 = 0, dig_H4 = 309
+ * and dig_H5 = 50 as 12-bit values sharing register 0xe5, and dig_H6 = 30.
+ */
+static const uint8_t calib26[] = {0x72, 0x01, 0x00, 0x13, 0x25, 0x03, 0x1e};
+
+struct bme280_emul_cfg {
+  /* Offset of the temperature in °C */
+  uint8_t offset;
+};
+
+struct bme280_emul_data {
+  uint8_t regs[256];
+  /* Register of the next read or write */
+  uint8_t reg;
+  uint32_t measurements;
+};
+
+static void bme280_emul_reset(struct bme280_emul_data *data) {
+  memset(data->regs, 0, sizeof(data->regs));
+  memcpy(&data->regs[BME280_EMUL_REG_CALIB00], calib00, sizeof(calib00));
+  memcpy(&data->regs[BME280_EMUL_REG_CALIB26], calib26, sizeof(calib26));
+  data->regs[BME280_EMUL_REG_CHIP_ID] = BME280_EMUL_CHIP_ID;
+}
+
+/*
+ * Fill the measurement registers with 20-bit pressure and temperature and
+ * 16-bit humidity values. The measurement is done at once, so the status
+ * register never shows a measurement in progress.
+ */
+static void bme280_emul_measure(struct bme280_emul_data *data,
+                                const struct bme280_emul_cfg *cfg) {
+  uint8_t *p_regs = &data->regs[BME280_EMUL_REG_DATA];
+  uint32_t phase = data->measurements++ % BME280_EMUL_PERIOD;
+  uint32_t rise = MIN(phase, BME280_EMUL_PERIOD - phase);
+  uint32_t temp = BME280_EMUL_ADC_TEMP +
+                  cfg->offset * BME280_EMUL_ADC_TEMP_PER_DEGREE +
+                  rise * BME280_EMUL_ADC_TEMP_PER_DEGREE /
+                      (BME280_EMUL_PERIOD / 2);
+
+  sys_put_be24(BME280_EMUL_ADC_PRESS << 4, &p_regs[0]);
+  sys_put_be24(temp << 4, &p_regs[3]);
+  sys_put_be16(BME280_EMUL_ADC_HUM, &p_regs[6]);
+}
+
+/*
+ * The first byte of a write is the register address, and further bytes are
+ * written from there. A read continues from the last address. Both
+ * increment the address with each byte.
+ */
+static int bme280_emul_transfer(const struct emul *target,
+                                struct i2c_msg *msgs, int num_msgs,
+                                int addr) {
+  struct bme280_emul_data *data = target->data;
+  const struct bme280_emul_cfg *cfg = target->cfg;
+
+  ARG_UNUSED(addr);
+
+  for (int i = 0; i < num_msgs; i++) {
+    if ((msgs[i].flags & I2C_MSG_READ) != 0) {
+      for (uint32_t j = 0; j < msgs[i].len; j++) {
+        msgs[i].buf[j] = data->regs[data->reg++];
+      }
+      continue;
+    }
+
+    if (msgs[i].len == 0) {
+      continue;
+    }
+    data->reg = msgs[i].buf[0];
+    for (uint32_t j = 1; j < msgs[i].len; j++) {
+      uint8_t reg = data->reg++;
+
+      if (reg == BME280_EMUL_REG_RESET) {
+        if (msgs[i].buf[j] == BME280_EMUL_RESET_CMD) {
+          bme280_emul_reset(data);
+        }
+      } else if (reg == BME280_EMUL_REG_CTRL_MEAS) {
+        data->regs[reg] = msgs[i].buf[j];
+        /* A forced measurement returns to sleep mode when done. */
+        if ((msgs[i].buf[j] & BME280_EMUL_MODE_MASK) != 0) {
+          bme280_emul_measure(data, cfg);
+        }
+        if ((msgs[i].buf[j] & BME280_EMUL_MODE_MASK) !=
+            BME280_EMUL_MODE_MASK) {
+          data->regs[reg] &= ~BME280_EMUL_MODE_MASK;
+        }
+      } else if (reg == BME280_EMUL_REG_CTRL_HUM ||
+                 reg == BME280_EMUL_REG_CONFIG) {
+        data->regs[reg] = msgs[i].buf[j];
+      }
+    }
+  }
+
+  return 0;
+}
+
+static const struct i2c_emul_api bme280_emul_api = {
+    .transfer = bme280_emul_transfer,
+};
+
+static int bme280_emul_init(const struct emul *target,
+                            const struct device *parent) {
+  ARG_UNUSED(parent);
+
+  bme280_emul_reset(target->data);
+
+  return 0;
+}
+
+#define BME280_EMUL(n)                                                         \
+  static struct bme280_emul_data bme280_emul_data_##n;                         \
+  static const struct bme280_emul_cfg bme280_emul_cfg_##n = {.offset = n};     \
+  EMUL_DT_INST_DEFINE(n, bme280_emul_init, &bme280_emul_data_##n,             \
+                      &bme280_emul_cfg_##n, &bme280_emul_api, NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(BME280_EMUL)
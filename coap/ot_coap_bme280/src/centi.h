@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CENTI_H_
+#define CENTI_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Convert a value of val1 units and val2 millionths to an integer in units
+ * of divisor millionths, rounded half away from zero. Both parts have the
+ * sign of the value, like in a struct sensor_value. This only uses integer
+ * arithmetic.
+ */
+static inline int32_t centi_scale(int32_t val1, int32_t val2,
+                                  int32_t divisor) {
+  int32_t rounding = val2 < 0 ? -divisor / 2 : divisor / 2;
+
+  return val1 * (1000000 / divisor) + (val2 + rounding) / divisor;
+}
+
+/*
+ * Format an integer in hundredths as a decimal number with 2 decimal places,
+ * without floating-point support in printf.
+ */
+#define CENTI_FMT "%s%u.%02u"
+#define CENTI_ARGS(value) CENTI_SIGN_ARGS(value, (value) < 0)
+
+/*
+ * Same, with the sign of the value before it was rounded, so a negative
+ * value that rounds to zero is printed as -0.00 like %.2f does.
+ */
+#define CENTI_SIGN_ARGS(value, negative)                                       \
+  (negative) ? "-" : "", (unsigned int)abs(value) / 100,                       \
+      (unsigned int)abs(value) % 100
+
+#endif /* CENTI_H_ */
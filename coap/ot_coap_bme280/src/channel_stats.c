@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "channel_stats.h"
+
+void channel_stats_add(struct channel_stats *stats, uint32_t count,
+                       int32_t value) {
+  int64_t diff;
+
+  if (count == 1) {
+    stats->min = value;
+    stats->max = value;
+    stats->first = value;
+    stats->sum = 0;
+    stats->sum_sq = 0;
+    return;
+  }
+
+  if (value < stats->min) {
+    stats->min = value;
+  }
+  if (value > stats->max) {
+    stats->max = value;
+  }
+
+  diff = (int64_t)value - stats->first;
+  stats->sum += diff;
+  stats->sum_sq += (uint64_t)(diff * diff);
+}
+
+int32_t channel_stats_mean(const struct channel_stats *stats, uint32_t count) {
+  int64_t total;
+  int64_t quotient;
+  int64_t remainder;
+
+  if (count == 0) {
+    return 0;
+  }
+
+  total = (int64_t)stats->first * count + stats->sum;
+  quotient = total / count;
+  remainder = total % count;
+  if (2 * (remainder < 0 ? -remainder : remainder) >= count) {
+    quotient += total < 0 ? -1 : 1;
+  }
+
+  return (int32_t)quotient;
+}
+
+/* Largest integer whose square is at most value */
+static uint64_t isqrt(uint64_t value) {
+  uint64_t root = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+
+  while (bit > value) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return root;
+}
+
+/*
+ * With the sum split as quotient * count + remainder, the sum of squared
+ * differences from the mean is
+ *
+ *   sum_sq - sum^2 / count
+ *     = sum_sq - quotient * sum - quotient * remainder - remainder^2 / count
+ *
+ * without the overflow of sum^2. The standard deviation rounded to the
+ * nearest integer is (floor(sqrt(4 * variance)) + 1) / 2, and
+ * floor(sqrt(x)) only depends on floor(x), so the fraction of
+ * remainder^2 / count only has to be accounted for in the floor of
+ * 4 * variance.
+ */
+int32_t channel_stats_stddev(const struct channel_stats *stats,
+                             uint32_t count) {
+  int64_t quotient;
+  int64_t remainder;
+  int64_t squares;
+  uint64_t remainder_sq;
+
+  if (count < 2) {
+    return 0;
+  }
+
+  quotient = stats->sum / count;
+  remainder = stats->sum % count;
+  squares =
+      (int64_t)stats->sum_sq - quotient * stats->sum - quotient * remainder;
+  remainder_sq = (uint64_t)(remainder * remainder);
+
+  /* 4 * (squares - remainder_sq / count), rounded down */
+  squares = 4 * squares - (int64_t)(4 * remainder_sq / count);
+  if (4 * remainder_sq % count != 0) {
+    squares--;
+  }
+  if (squares <= 0) {
+    return 0;
+  }
+
+  return (int32_t)((isqrt((uint64_t)squares / (count - 1)) + 1) / 2);
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CHANNEL_STATS_H_
+#define CHANNEL_STATS_H_
+
+#include <stdint.h>
+
+/*
+ * Running statistics of one channel in constant memory, with integer
+ * arithmetic only. The sums are kept of the differences from the first
+ * sample, so they stay small while the readings hardly change, and the sum
+ * of squares doesn't lose precision over long windows like a floating-point
+ * one does. A window of 2^28 samples that differ by up to 80000 from the
+ * first one still fits.
+ */
+struct channel_stats {
+  int32_t min;
+  int32_t max;
+  int32_t first;
+  int64_t sum;
+  uint64_t sum_sq;
+};
+
+/* Add the value of sample number count, counting from 1. */
+void channel_stats_add(struct channel_stats *stats, uint32_t count,
+                       int32_t value);
+
+/* Mean of count samples, rounded half away from zero */
+int32_t channel_stats_mean(const struct channel_stats *stats, uint32_t count);
+
+/*
+ * Sample standard deviation of count samples, rounded to the nearest
+ * integer, or 0 for less than two samples
+ */
+int32_t channel_stats_stddev(const struct channel_stats *stats,
+                             uint32_t count);
+
+#endif /* CHANNEL_STATS_H_ */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "deadband.h"
+
+#include <stdlib.h>
+
+static struct sensor_sample last_reported;
+static bool has_reported;
+
+static bool exceeds(int32_t value, int32_t reference, int32_t deadband) {
+  return abs(value - reference) >= deadband;
+}
+
+static bool report_exceeds(const struct sensor_report *now,
+                           const struct sensor_report *last) {
+  return exceeds(report_temp_centi(now), report_temp_centi(last),
+                 CONFIG_APP_DEADBAND_TEMP) ||
+         exceeds(report_press_pa(now), report_press_pa(last),
+                 CONFIG_APP_DEADBAND_PRESS) ||
+         exceeds(report_hum_centi(now), report_hum_centi(last),
+                 CONFIG_APP_DEADBAND_HUM);
+}
+
+/* A sample is reported if any of its sensors exceeds a deadband. */
+bool deadband_check(const struct sensor_sample *sample) {
+  if (!has_reported) {
+    return true;
+  }
+
+  if (sample->timestamp - last_reported.timestamp >=
+      CONFIG_APP_HEARTBEAT_INTERVAL) {
+    return true;
+  }
+
+  for (size_t i = 0; i < REPORT_SENSOR_COUNT; i++) {
+    if (report_exceeds(&sample->report[i], &last_reported.report[i])) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void deadband_commit(const struct sensor_sample *sample) {
+  last_reported = *sample;
+  has_reported = true;
+}
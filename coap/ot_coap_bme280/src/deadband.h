@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef DEADBAND_H_
+#define DEADBAND_H_
+
+#include <stdbool.h>
+
+#include "report.h"
+
+/*
+ * Check whether a sample has to be reported: if one of its channels changed
+ * more than its deadband since the last reported sample, or if nothing has
+ * been reported for CONFIG_APP_HEARTBEAT_INTERVAL milliseconds.
+ */
+bool deadband_check(const struct sensor_sample *sample);
+
+/* Remember a sample as the last reported one. */
+void deadband_commit(const struct sensor_sample *sample);
+
+#endif /* DEADBAND_H_ */
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "discovery.h"
+
+#include <openthread/dns_client.h>
+#include <openthread/ip6.h>
+#include <openthread/thread.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+#include <zephyr/sys/util.h>
+
+LOG_MODULE_DECLARE(ot_coap_bme280);
+
+/* Refresh the cached collector when less than 1/8 of its TTL is left. */
+#define REFRESH_FRACTION 8
+
+static struct {
+  bool valid;
+  bool query_pending;
+  otIp6Address addr;
+  uint16_t port;
+  int64_t refresh_time;
+  int64_t expiry_time;
+  int64_t next_attempt;
+} collector;
+
+static void discovery_failed(const char *p_step, otError error) {
+  LOG_WRN("Collector %s failed: %s", p_step, otThreadErrorToString(error));
+  collector.query_pending = false;
+  collector.next_attempt =
+      k_uptime_get() + CONFIG_APP_COLLECTOR_RETRY_INTERVAL * MSEC_PER_SEC;
+}
+
+static void collector_found(const otDnsServiceInfo *p_info) {
+  char addr[OT_IP6_ADDRESS_STRING_SIZE];
+  int64_t ttl_ms = (int64_t)MIN(p_info->mTtl, p_info->mHostAddressTtl) *
+                   MSEC_PER_SEC;
+  int64_t now = k_uptime_get();
+
+  collector.valid = true;
+  collector.query_pending = false;
+  collector.addr = p_info->mHostAddress;
+  collector.port = p_info->mPort;
+  collector.expiry_time = now + ttl_ms;
+  collector.refresh_time = now + ttl_ms - ttl_ms / REFRESH_FRACTION;
+
+  otIp6AddressToString(&collector.addr, addr, sizeof(addr));
+  LOG_INF("Collector at [%s]:%u for %u s", addr, collector.port,
+          MIN(p_info->mTtl, p_info->mHostAddressTtl));
+}
+
+static bool has_host_address(const otDnsServiceInfo *p_info) {
+  otIp6Address unspecified;
+
+  memset(&unspecified, 0, sizeof(unspecified));
+  return !otIp6IsAddressEqual(&p_info->mHostAddress, &unspecified) &&
+         p_info->mHostAddressTtl > 0;
+}
+
+static void resolve_callback(otError error,
+                             const otDnsServiceResponse *p_response,
+                             void *p_context) {
+  otDnsServiceInfo info;
+
+  if (error == OT_ERROR_NONE) {
+    memset(&info, 0, sizeof(info));
+    error = otDnsServiceResponseGetServiceInfo(p_response, &info);
+  }
+  if (error == OT_ERROR_NONE && !has_host_address(&info)) {
+    error = OT_ERROR_NOT_FOUND;
+  }
+  if (error != OT_ERROR_NONE) {
+    discovery_failed("resolution", error);
+    return;
+  }
+
+  collector_found(&info);
+}
+
+static void browse_callback(otError error,
+                            const otDnsBrowseResponse *p_response,
+                            void *p_context) {
+  char label[OT_DNS_MAX_LABEL_SIZE];
+  otDnsServiceInfo info;
+
+  if (error == OT_ERROR_NONE) {
+    /* Just take the first collector that answers. */
+    error = otDnsBrowseResponseGetServiceInstance(p_response, 0, label,
+                                                  sizeof(label));
+  }
+  if (error != OT_ERROR_NONE) {
+    discovery_failed("browse", error);
+    return;
+  }
+
+  /*
+   * The response often has the SRV and AAAA records of the instance as
+   * additional records, which saves a resolve query.
+   */
+  memset(&info, 0, sizeof(info));
+  if (otDnsBrowseResponseGetServiceInfo(p_response, label, &info) ==
+          OT_ERROR_NONE &&
+      has_host_address(&info)) {
+    collector_found(&info);
+    return;
+  }
+
+  error = otDnsClientResolveService(openthread_get_default_instance(), label,
+                                    CONFIG_APP_COLLECTOR_SERVICE,
+                                    resolve_callback, NULL, NULL);
+  if (error != OT_ERROR_NONE) {
+    discovery_failed("resolution", error);
+  }
+}
+
+static void start_discovery(void) {
+  otError error;
+
+  error = otDnsClientBrowse(openthread_get_default_instance(),
+                            CONFIG_APP_COLLECTOR_SERVICE, browse_callback,
+                            NULL, NULL);
+  if (error != OT_ERROR_NONE) {
+    discovery_failed("browse", error);
+    return;
+  }
+
+  collector.query_pending = true;
+  LOG_DBG("Browsing for %s", CONFIG_APP_COLLECTOR_SERVICE);
+}
+
+bool discovery_get_collector(otMessageInfo *p_message_info) {
+  int64_t now = k_uptime_get();
+
+  if (collector.valid && now >= collector.expiry_time) {
+    LOG_INF("Collector address expired");
+    collector.valid = false;
+  }
+
+  if (!collector.query_pending && now >= collector.next_attempt &&
+      (!collector.valid || now >= collector.refresh_time)) {
+    start_discovery();
+  }
+
+  if (!collector.valid) {
+    return false;
+  }
+
+  p_message_info->mPeerAddr = collector.addr;
+  p_message_info->mPeerPort = collector.port;
+  return true;
+}
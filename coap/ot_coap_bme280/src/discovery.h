@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef DISCOVERY_H_
+#define DISCOVERY_H_
+
+#include <openthread/message.h>
+#include <stdbool.h>
+
+/*
+ * Set the peer address and port of the collector discovered with DNS-SD.
+ * The address is cached for the TTL of the DNS records and refreshed in
+ * the background before it expires. Must be called with the OpenThread API
+ * mutex locked.
+ *
+ * Returns false if no collector is known (yet), in which case a new
+ * discovery is started if the retry interval has passed.
+ */
+bool discovery_get_collector(otMessageInfo *p_message_info);
+
+#endif /* DISCOVERY_H_ */
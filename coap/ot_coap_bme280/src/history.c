@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "history.h"
+
+#include <openthread/coap.h>
+#include <openthread/message.h>
+#include <openthread/platform/radio.h>
+#include <openthread/thread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "report.h"
+#include "store.h"
+
+LOG_MODULE_DECLARE(ot_coap_bme280);
+
+/*
+ * Each record in the representation has big-endian 32-bit fields: sequence
+ * number, boot count, uptime in ms, and for each sensor the temperature in
+ * 0.01 °C, pressure in Pa and humidity in 0.01 %. Records that are no longer
+ * in the log have boot count 0.
+ */
+#define HISTORY_RECORD_SIZE (12 + 12 * REPORT_SENSOR_COUNT)
+
+#define HISTORY_QUERY_FROM "from="
+#define HISTORY_QUERY_TO "to="
+#define HISTORY_QUERY_MAX_LEN 16
+
+/*
+ * Records of a transfer: from the sequence number from up to, but not
+ * including, end. The window is fixed by the first block and is the ETag,
+ * and the client asks for the later blocks with from and to queries, so
+ * they don't shift when the log grows during the transfer. The node keeps
+ * no state per transfer, so clients don't get in each other's way.
+ */
+struct history_window {
+  uint32_t from;
+  uint32_t end;
+};
+
+static void history_requested(void *p_context, otMessage *p_message,
+                              const otMessageInfo *p_message_info);
+
+static otCoapResource history_resource = {.mUriPath = "sensor/history",
+                                          .mHandler = history_requested,
+                                          .mContext = NULL,
+                                          .mNext = NULL};
+
+/*
+ * Pick the block size from the signal strength of the request. Larger blocks
+ * are split in more 6LoWPAN fragments, and on a weak link the loss of one
+ * fragment means the whole block has to be sent again. The RSS is only
+ * known for the last hop.
+ */
+static otCoapBlockSzx link_block_szx(const otMessage *p_request) {
+  int8_t rss = otMessageGetRss(p_request);
+
+  if (rss == OT_RADIO_RSSI_INVALID) {
+    return OT_COAP_OPTION_BLOCK_SZX_128;
+  } else if (rss >= -60) {
+    return OT_COAP_OPTION_BLOCK_SZX_512;
+  } else if (rss >= -75) {
+    return OT_COAP_OPTION_BLOCK_SZX_256;
+  } else if (rss >= -85) {
+    return OT_COAP_OPTION_BLOCK_SZX_128;
+  }
+
+  return OT_COAP_OPTION_BLOCK_SZX_64;
+}
+
+/*
+ * Parse the Block2 option and the "from" and "to" queries of the request.
+ * Returns whether the request has a "to" query.
+ */
+static bool parse_request(otMessage *p_message, uint32_t *p_num,
+                          otCoapBlockSzx *p_szx,
+                          struct history_window *p_window) {
+  otCoapOptionIterator iterator;
+  const otCoapOption *p_option;
+  char query[HISTORY_QUERY_MAX_LEN + 1];
+  uint64_t block2;
+  bool has_to = false;
+
+  *p_num = 0;
+  *p_szx = OT_COAP_OPTION_BLOCK_SZX_1024;
+  p_window->from = store_first();
+
+  if (otCoapOptionIteratorInit(&iterator, p_message) != OT_ERROR_NONE) {
+    return false;
+  }
+
+  if (otCoapOptionIteratorGetFirstOptionMatching(
+          &iterator, OT_COAP_OPTION_BLOCK2) != NULL &&
+      otCoapOptionIteratorGetOptionUintValue(&iterator, &block2) ==
+          OT_ERROR_NONE) {
+    *p_num = block2 >> 4;
+    *p_szx = block2 & 0x7;
+  }
+
+  for (p_option = otCoapOptionIteratorGetFirstOptionMatching(
+           &iterator, OT_COAP_OPTION_URI_QUERY);
+       p_option != NULL;
+       p_option = otCoapOptionIteratorGetNextOptionMatching(
+           &iterator, OT_COAP_OPTION_URI_QUERY)) {
+    if (p_option->mLength > HISTORY_QUERY_MAX_LEN ||
+        otCoapOptionIteratorGetOptionValue(&iterator, query) !=
+            OT_ERROR_NONE) {
+      continue;
+    }
+    query[p_option->mLength] = '\0';
+
+    if (strncmp(query, HISTORY_QUERY_FROM, strlen(HISTORY_QUERY_FROM)) == 0) {
+      p_window->from = strtoul(&query[strlen(HISTORY_QUERY_FROM)], NULL, 10);
+    } else if (strncmp(query, HISTORY_QUERY_TO, strlen(HISTORY_QUERY_TO)) ==
+               0) {
+      p_window->end = strtoul(&query[strlen(HISTORY_QUERY_TO)], NULL, 10);
+      has_to = true;
+    }
+  }
+
+  return has_to;
+}
+
+/*
+ * Without a "to" query, the window ends at the head of the log, after at
+ * most CONFIG_APP_HISTORY_TRANSFER_RECORDS records. Returns false if the
+ * window of a "to" query is longer or goes beyond the head.
+ */
+static bool fix_window(struct history_window *p_window, bool has_to) {
+  uint32_t head = store_head();
+  uint32_t count = (int32_t)(head - p_window->from) > 0
+                       ? head - p_window->from
+                       : 0;
+
+  if (!has_to) {
+    p_window->end =
+        p_window->from + MIN(count, CONFIG_APP_HISTORY_TRANSFER_RECORDS);
+    return true;
+  }
+
+  return (int32_t)(p_window->end - p_window->from) >= 0 &&
+         p_window->end - p_window->from <=
+             CONFIG_APP_HISTORY_TRANSFER_RECORDS &&
+         (int32_t)(head - p_window->end) >= 0;
+}
+
+static void encode_record(uint32_t seq, uint8_t *buf) {
+  struct store_record record;
+
+  if (store_read(seq, &record) < 0) {
+    memset(&record, 0, sizeof(record));
+  }
+
+  sys_put_be32(seq, &buf[0]);
+  sys_put_be32(record.boot, &buf[4]);
+  sys_put_be32(record.sample.timestamp, &buf[8]);
+  for (size_t i = 0; i < REPORT_SENSOR_COUNT; i++) {
+    sys_put_be32(report_temp_centi(&record.sample.report[i]), &buf[12]);
+    sys_put_be32(report_press_pa(&record.sample.report[i]), &buf[16]);
+    sys_put_be32(report_hum_centi(&record.sample.report[i]), &buf[20]);
+    buf += 12;
+  }
+}
+
+/*
+ * Append len bytes of the representation of the window from offset on. Only
+ * the records in the block are read from the log, one at a time.
+ */
+static otError append_records(otMessage *p_response,
+                              const struct history_window *p_window,
+                              uint32_t offset, uint32_t len) {
+  uint8_t record[HISTORY_RECORD_SIZE];
+  otError error = OT_ERROR_NONE;
+
+  while (error == OT_ERROR_NONE && len > 0) {
+    uint32_t skip = offset % HISTORY_RECORD_SIZE;
+    uint32_t part = MIN(HISTORY_RECORD_SIZE - skip, len);
+
+    encode_record(p_window->from + offset / HISTORY_RECORD_SIZE, record);
+    error = otMessageAppend(p_response, &record[skip], part);
+    offset += part;
+    len -= part;
+  }
+
+  return error;
+}
+
+/*
+ * Initialize the response with the requested block of the representation,
+ * with 4.00 Bad Request if the window of the queries is invalid, or with
+ * 4.02 Bad Option if the block is beyond its end.
+ */
+static otError init_block_response(otMessage *p_response,
+                                   otMessage *p_request_message,
+                                   otCoapType message_type) {
+  otError error;
+  otCoapBlockSzx szx;
+  struct history_window window;
+  uint32_t num;
+  uint32_t total;
+  uint32_t offset;
+  uint32_t block_size;
+  uint32_t len;
+  uint8_t etag[2 * sizeof(uint32_t)];
+  bool has_to;
+
+  has_to = parse_request(p_request_message, &num, &szx, &window);
+  if (!fix_window(&window, has_to)) {
+    return otCoapMessageInitResponse(p_response, p_request_message,
+                                     message_type, OT_COAP_CODE_BAD_REQUEST);
+  }
+  total = (window.end - window.from) * HISTORY_RECORD_SIZE;
+  offset = num * otCoapBlockSizeFromExponent(szx);
+
+  if (offset > total || (offset == total && num > 0)) {
+    return otCoapMessageInitResponse(p_response, p_request_message,
+                                     message_type, OT_COAP_CODE_BAD_OPTION);
+  }
+
+  /*
+   * A smaller block size than the client asked for is fine, as long as the
+   * block number is adjusted to the same offset (RFC 7959 section 2.4).
+   */
+  szx = MIN(szx, link_block_szx(p_request_message));
+  block_size = otCoapBlockSizeFromExponent(szx);
+  num = offset / block_size;
+  len = MIN(block_size, total - offset);
+
+  error = otCoapMessageInitResponse(p_response, p_request_message,
+                                    message_type, OT_COAP_CODE_CONTENT);
+
+  /* The ETag is the window, which the later blocks ask for. */
+  sys_put_be32(window.from, &etag[0]);
+  sys_put_be32(window.end, &etag[4]);
+  if (error == OT_ERROR_NONE) {
+    error = otCoapMessageAppendOption(p_response, OT_COAP_OPTION_E_TAG,
+                                      sizeof(etag), etag);
+  }
+  if (error == OT_ERROR_NONE) {
+    error = otCoapMessageAppendContentFormatOption(
+        p_response, OT_COAP_OPTION_CONTENT_FORMAT_OCTET_STREAM);
+  }
+  if (error == OT_ERROR_NONE) {
+    error = otCoapMessageAppendBlock2Option(p_response, num,
+                                            offset + len < total, szx);
+  }
+  if (error == OT_ERROR_NONE && num == 0) {
+    error = otCoapMessageAppendUintOption(p_response, OT_COAP_OPTION_SIZE2,
+                                          total);
+  }
+  if (error == OT_ERROR_NONE && len > 0) {
+    error = otCoapMessageSetPayloadMarker(p_response);
+  }
+  if (error == OT_ERROR_NONE && len > 0) {
+    error = append_records(p_response, &window, offset, len);
+  }
+
+  return error;
+}
+
+static void history_send_response(otMessage *p_request_message,
+                                  const otMessageInfo *p_message_info) {
+  otError error;
+  otMessage *p_response;
+  otCoapType message_type;
+  otInstance *p_instance = openthread_get_default_instance();
+
+  p_response = otCoapNewMessage(p_instance, NULL);
+  if (p_response == NULL) {
+    LOG_ERR("Failed to create message for CoAP Response");
+    return;
+  }
+
+  if (otCoapMessageGetType(p_request_message) == OT_COAP_TYPE_CONFIRMABLE) {
+    message_type = OT_COAP_TYPE_ACKNOWLEDGMENT;
+  } else {
+    message_type = OT_COAP_TYPE_NON_CONFIRMABLE;
+  }
+
+  error = init_block_response(p_response, p_request_message, message_type);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to build CoAP Response: %s", otThreadErrorToString(error));
+    otMessageFree(p_response);
+    return;
+  }
+
+  error = otCoapSendResponse(p_instance, p_response, p_message_info);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to send CoAP Response: %s", otThreadErrorToString(error));
+    otMessageFree(p_response);
+  }
+}
+
+static void history_requested(void *p_context, otMessage *p_message,
+                              const otMessageInfo *p_message_info) {
+  if (otCoapMessageGetCode(p_message) != OT_COAP_CODE_GET) {
+    return;
+  }
+
+  history_send_response(p_message, p_message_info);
+}
+
+void history_init(void) {
+  otCoapAddResource(openthread_get_default_instance(), &history_resource);
+  LOG_INF("CoAP sensor history resource started");
+}
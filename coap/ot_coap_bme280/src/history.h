@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+/*
+ * Add the sensor/history resource to the CoAP service. A GET request
+ * returns the sample log, with block-wise transfer (RFC 7959) in blocks of
+ * at most 512 bytes.
+ */
+void history_init(void);
+
+#endif /* HISTORY_H_ */
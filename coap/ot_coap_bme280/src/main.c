@@ -9,94 +9,443 @@
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/net/openthread.h>
+#include <zephyr/sys/spsc_lockfree.h>
+
+#include "aggregate.h"
+#include "batch.h"
+#include "deadband.h"
+#include "history.h"
+#include "observe.h"
+#include "publish.h"
+#include "radio_stats.h"
+#include "report.h"
+#include "schedule.h"
+#include "sensor_pm.h"
+#include "store.h"
 
 LOG_MODULE_REGISTER(ot_coap_bme280, LOG_LEVEL_DBG);
 
-#define SEND_TO_ADDR "ff03::1"
+#define SAMPLE_STACK_SIZE 1024
+#define SAMPLE_PRIORITY 5
+#define PUBLISH_STACK_SIZE 2048
+#define PUBLISH_PRIORITY 7
+#define PUBLISH_RETRY_DELAY 500
 
-static void send_sensor_request(const struct device *dev) {
-  char json_buf[100];
-  otError error = OT_ERROR_NONE;
-  otInstance *p_instance = openthread_get_default_instance();
-  otMessage *p_message;
-  otMessageInfo message_info;
-  otExtAddress eui64;
-  char eui64_id[25] = "\0";
-  char buf[3];
-  struct sensor_value temp, press, hum;
-
-  otPlatRadioGetIeeeEui64(p_instance, eui64.m8);
-  for (uint8_t i = 0; i < 8; i++) {
-    snprintk(buf, sizeof(buf), "%02X", eui64.m8[i]);
-    strcat(eui64_id, buf);
-  }
-
-  memset(&message_info, 0, sizeof(message_info));
-  otIp6AddressFromString(SEND_TO_ADDR, &message_info.mPeerAddr);
-  message_info.mPeerPort = OT_DEFAULT_COAP_PORT;
-
-  sensor_sample_fetch(dev);
-  sensor_channel_get(dev, SENSOR_CHAN_AMBIENT_TEMP, &temp);
-  sensor_channel_get(dev, SENSOR_CHAN_PRESS, &press);
-  sensor_channel_get(dev, SENSOR_CHAN_HUMIDITY, &hum);
-
-  // Convert sensor values to °C, hPa, and % with 2 decimal places
-  snprintk(json_buf, sizeof(json_buf),
-           "{\"id\":\"%s\",\"temp\":%.2f,\"press\":%.2f,\"hum\":%.2f}",
-           eui64_id, temp.val1 + temp.val2 / 1000000.0,
-           press.val1 * 10.0 + press.val2 / 100000.0,
-           hum.val1 + hum.val2 / 1000000.0);
-  LOG_INF("JSON message: %s", json_buf);
-
-  p_message = otCoapNewMessage(p_instance, NULL);
-  if (p_message == NULL) {
-    LOG_ERR("Failed to create message for CoAP Request");
+K_THREAD_STACK_DEFINE(sample_stack, SAMPLE_STACK_SIZE);
+K_THREAD_STACK_DEFINE(publish_stack, PUBLISH_STACK_SIZE);
+static struct k_work_q sample_workq;
+static struct k_work_q publish_workq;
+
+static void sample_work_handler(struct k_work *work);
+static void publish_work_handler(struct k_work *work);
+#if defined(CONFIG_APP_STORE)
+static void backfill_work_handler(struct k_work *work);
+#endif
+
+static K_WORK_DELAYABLE_DEFINE(sample_work, sample_work_handler);
+static K_WORK_DELAYABLE_DEFINE(publish_work, publish_work_handler);
+#if defined(CONFIG_APP_STORE)
+static K_WORK_DELAYABLE_DEFINE(backfill_work, backfill_work_handler);
+#endif
+
+/* Samples from the sampling stage (producer) to the publishing stage. */
+SPSC_DEFINE(sample_queue, struct sensor_sample, CONFIG_APP_SAMPLE_QUEUE_SIZE);
+
+BUILD_ASSERT(REPORT_SENSOR_COUNT > 0, "No okay bosch,bme280 devicetree node");
+
+/* All okay "bosch,bme280" devicetree nodes, indexed by sensor index */
+#define BME280_DEVICE_AND_COMMA(node_id) DEVICE_DT_GET(node_id),
+static const struct device *const sensor_devs[] = {
+    DT_FOREACH_STATUS_OKAY(bosch_bme280, BME280_DEVICE_AND_COMMA)};
+/* Slot of the next sample on the node's grid, and the jittered deadline */
+static int64_t sample_slot;
+static int64_t sample_deadline;
+
+static uint8_t payload_buf[REPORT_MAX_SIZE];
+
+#if defined(CONFIG_APP_BATCH)
+static struct sample_batch batch;
+#elif defined(CONFIG_APP_AGGREGATE)
+static struct aggregate window;
+#endif
+
+static uint32_t samples_read;
+static uint32_t samples_reported;
+static uint32_t samples_dropped;
+static uint32_t samples_late;
+static uint32_t publish_retries;
+static uint32_t publish_retries_total;
+static int64_t max_lateness;
+
+static void log_payload(const uint8_t *p_payload, int payload_len) {
+  if (IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR)) {
+    LOG_HEXDUMP_INF(p_payload, payload_len, "CBOR message:");
+  } else {
+    LOG_INF("JSON message: %.*s", payload_len, p_payload);
+  }
+}
+
+/*
+ * Read all sensors in one wake cycle: first trigger all measurements, then
+ * get the channels. With CONFIG_APP_SENSOR_PM the sensors and their bus are
+ * only resumed for the measurements.
+ */
+static void read_sensors(struct sensor_sample *p_sample) {
+  p_sample->timestamp = k_uptime_get_32();
+  if (sensor_pm_resume() < 0) {
+    LOG_WRN("Failed to resume the sensors, keeping the last readings");
+  }
+  for (size_t i = 0; i < ARRAY_SIZE(sensor_devs); i++) {
+    sensor_sample_fetch(sensor_devs[i]);
+  }
+  sensor_pm_suspend();
+
+  for (size_t i = 0; i < ARRAY_SIZE(sensor_devs); i++) {
+    struct sensor_report *p_report = &p_sample->report[i];
+
+    sensor_channel_get(sensor_devs[i], SENSOR_CHAN_AMBIENT_TEMP,
+                       &p_report->temp);
+    sensor_channel_get(sensor_devs[i], SENSOR_CHAN_PRESS, &p_report->press);
+    sensor_channel_get(sensor_devs[i], SENSOR_CHAN_HUMIDITY, &p_report->hum);
+  }
+}
+
+#if defined(CONFIG_APP_STORE)
+static struct sample_batch backfill_batch;
+static uint32_t samples_stored;
+
+/* Write a sample that couldn't be sent to the log in flash. */
+static void store_sample(const struct sensor_sample *p_sample) {
+  if (store_append(p_sample) == 0) {
+    samples_stored++;
+    LOG_INF("Stored sample (%u stored, %u unsent samples)", samples_stored,
+            store_unsent_count());
+  }
+}
+
+/* Start forwarding the stored samples, now that a report got through. */
+static void start_backfill(void) {
+  if (store_unsent_count() > 0) {
+    k_work_schedule_for_queue(&publish_workq, &backfill_work,
+                              K_MSEC(CONFIG_APP_STORE_BACKFILL_INTERVAL));
+  }
+}
+
+/*
+ * Send the oldest unsent samples in the log as one batch report. A batch
+ * only has samples of one boot, because the uptimes of different boots
+ * can't be compared. For samples of a previous boot the report has no
+ * uptime, so the collector knows that it can't tell how old they are.
+ */
+static void backfill_work_handler(struct k_work *work) {
+  struct openthread_context *ot_context = openthread_get_default_context();
+  struct store_record record;
+  uint32_t seq = store_unsent();
+  uint32_t end = seq + store_unsent_count();
+  uint32_t uptime = k_uptime_get_32();
+  uint32_t boot = 0;
+  int payload_len;
+  int ret;
+
+  batch_clear(&backfill_batch);
+  for (; seq != end && !batch_is_full(&backfill_batch); seq++) {
+    if (store_read(seq, &record) < 0) {
+      continue;
+    }
+    if (batch_count(&backfill_batch) == 0) {
+      boot = record.boot;
+    } else if (record.boot != boot) {
+      break;
+    }
+    batch_add(&backfill_batch, &record.sample);
+  }
+
+  if (batch_count(&backfill_batch) == 0) {
+    store_mark_sent(seq);
     return;
   }
 
-  otCoapMessageInit(p_message, OT_COAP_TYPE_NON_CONFIRMABLE, OT_COAP_CODE_PUT);
+  payload_len = report_encode_batch(payload_buf, sizeof(payload_buf),
+                                    publish_device_id(), &backfill_batch,
+                                    boot == store_boot() ? &uptime : NULL);
+  if (payload_len < 0) {
+    LOG_ERR("Failed to encode backfill report: %d", payload_len);
+    return;
+  }
 
-  error = otCoapMessageAppendUriPathOptions(p_message, "sensor");
-  if (error != OT_ERROR_NONE) {
-    LOG_ERR("Failed to append Uri-Path option for CoAP Request: %s",
-            otThreadErrorToString(error));
-    otMessageFree(p_message);
+  openthread_api_mutex_lock(ot_context);
+  ret = publish_report(payload_buf, payload_len);
+  publish_flush();
+  openthread_api_mutex_unlock(ot_context);
+  if (ret < 0) {
+    /* Try again after the next report that gets through. */
     return;
   }
 
-  error = otCoapMessageAppendContentFormatOption(
-      p_message, OT_COAP_OPTION_CONTENT_FORMAT_JSON);
-  if (error != OT_ERROR_NONE) {
-    LOG_ERR("Failed to append content format option for CoAP Request: %s",
-            otThreadErrorToString(error));
-    otMessageFree(p_message);
+  /* Only write the watermark once per batch, to limit the flash writes. */
+  store_mark_sent(seq);
+  LOG_INF("Backfilled %zu samples (%u unsent samples)",
+          batch_count(&backfill_batch), store_unsent_count());
+  start_backfill();
+}
+#endif
+
+#if defined(CONFIG_APP_BATCH)
+/*
+ * Send all samples in the batch in one report. If this fails, the samples
+ * are kept and the oldest ones are overwritten by new samples, or with
+ * CONFIG_APP_STORE they're written to the log in flash.
+ */
+static void report_batch(void) {
+  timing_t start = publish_cycles_start();
+  uint32_t now = k_uptime_get_32();
+  int payload_len;
+  int ret;
+
+  payload_len = report_encode_batch(payload_buf, sizeof(payload_buf),
+                                    publish_device_id(), &batch, &now);
+  if (payload_len < 0) {
+    LOG_ERR("Failed to encode batch report: %d", payload_len);
     return;
   }
 
-  error = otCoapMessageSetPayloadMarker(p_message);
-  if (error != OT_ERROR_NONE) {
-    LOG_ERR("Failed to set payload marker for CoAP Request: %s",
-            otThreadErrorToString(error));
-    otMessageFree(p_message);
+  ret = publish_report(payload_buf, payload_len);
+  publish_cycles_record(start);
+  log_payload(payload_buf, payload_len);
+
+  if (ret == 0) {
+    LOG_INF("Sent batch of %zu samples", batch_count(&batch));
+    batch_clear(&batch);
+#if defined(CONFIG_APP_STORE)
+    start_backfill();
+  } else {
+    for (size_t i = 0; i < batch_count(&batch); i++) {
+      store_sample(batch_get(&batch, i));
+    }
+    batch_clear(&batch);
+#endif
+  }
+}
+
+static void batch_sample(const struct sensor_sample *p_sample) {
+  uint32_t oldest;
+
+  batch_add(&batch, p_sample);
+  oldest = batch_get(&batch, 0)->timestamp;
+
+  if (batch_is_full(&batch) ||
+      p_sample->timestamp - oldest >= CONFIG_APP_BATCH_TIMEOUT) {
+    report_batch();
+  }
+}
+#else
+static int report_sample(const struct sensor_sample *p_sample) {
+  timing_t start = publish_cycles_start();
+  int payload_len;
+  int ret;
+
+  payload_len = report_encode(payload_buf, sizeof(payload_buf),
+                              publish_device_id(), p_sample);
+  if (payload_len < 0) {
+    LOG_ERR("Failed to encode sensor report: %d", payload_len);
+    return payload_len;
+  }
+
+  ret = publish_report(payload_buf, payload_len);
+  publish_cycles_record(start);
+  log_payload(payload_buf, payload_len);
+
+  return ret;
+}
+#endif
+
+#if defined(CONFIG_APP_AGGREGATE)
+/*
+ * Add the sample to the window, and send its statistics if the next sample
+ * would fall outside it. If this fails, the window is extended until the
+ * next sample.
+ */
+static void aggregate_sample(const struct sensor_sample *p_sample) {
+  timing_t start = publish_cycles_start();
+  int payload_len;
+  int ret;
+
+  aggregate_add(&window, p_sample);
+  if (p_sample->timestamp - window.start + CONFIG_APP_SAMPLE_INTERVAL <
+      CONFIG_APP_AGGREGATE_WINDOW) {
     return;
   }
 
-  error = otMessageAppend(p_message, json_buf, strlen(json_buf));
-  if (error != OT_ERROR_NONE) {
-    LOG_ERR("Failed to append to CoAP Request message: %s",
-            otThreadErrorToString(error));
-    otMessageFree(p_message);
+  payload_len =
+      report_encode_stats(payload_buf, sizeof(payload_buf), publish_device_id(),
+                          &window, k_uptime_get_32());
+  if (payload_len < 0) {
+    LOG_ERR("Failed to encode statistics report: %d", payload_len);
     return;
   }
 
-  error = otCoapSendRequest(p_instance, p_message, &message_info, NULL, NULL);
-  if (error != OT_ERROR_NONE) {
-    LOG_ERR("Failed to send CoAP Request: %s", otThreadErrorToString(error));
-    otMessageFree(p_message);
+  ret = publish_report(payload_buf, payload_len);
+  publish_cycles_record(start);
+  log_payload(payload_buf, payload_len);
+
+  if (ret == 0) {
+    LOG_INF("Sent statistics of %u samples", aggregate_count(&window));
+    aggregate_clear(&window);
+  }
+}
+#endif
+
+#if defined(CONFIG_APP_HISTORY)
+/*
+ * Write every sample to the log. It's only sent right away if there's no
+ * backlog, otherwise it's forwarded in order with the backlog.
+ */
+static void log_sample(const struct sensor_sample *p_sample) {
+  if (store_append(p_sample) < 0) {
+    report_sample(p_sample);
+    return;
+  }
+
+  if (store_unsent_count() == 1 && report_sample(p_sample) == 0) {
+    store_advance_sent(store_head());
+    return;
+  }
+
+  start_backfill();
+}
+#endif
+
+/*
+ * Handle a sample in the publishing stage. Returns -ENOMEM if the sample has
+ * to be retried later because there are no message buffers, 0 otherwise.
+ * With CONFIG_APP_STORE a sample that can't be sent is stored instead.
+ */
+static int publish_sample(const struct sensor_sample *p_sample) {
+#if defined(CONFIG_APP_REPORT_ON_CHANGE)
+  if (!deadband_check(p_sample)) {
+    LOG_DBG("Sample within deadband, reported %u of %u samples",
+            samples_reported, samples_read);
+    return 0;
+  }
+#endif
+
+#if defined(CONFIG_APP_BATCH)
+  batch_sample(p_sample);
+#elif defined(CONFIG_APP_AGGREGATE)
+  aggregate_sample(p_sample);
+#elif defined(CONFIG_APP_HISTORY)
+  log_sample(p_sample);
+#else
+  int ret = report_sample(p_sample);
+
+#if defined(CONFIG_APP_STORE)
+  if (ret < 0) {
+    store_sample(p_sample);
+  } else {
+    start_backfill();
+  }
+#else
+  if (ret == -ENOMEM) {
+    return ret;
+  } else if (ret < 0) {
+    return 0;
+  }
+#endif
+#endif
+
+#if defined(CONFIG_APP_REPORT_ON_CHANGE)
+  deadband_commit(p_sample);
+#endif
+  samples_reported++;
+  return 0;
+}
+
+/*
+ * Publishing stage: send the queued samples. If there are no message buffers,
+ * retry with a randomized exponential backoff, so nodes that run out of
+ * buffers at the same time don't retry at the same time.
+ */
+static void publish_work_handler(struct k_work *work) {
+  struct openthread_context *ot_context = openthread_get_default_context();
+  struct sensor_sample *p_sample;
+  uint32_t delay;
+  int ret;
+
+  while ((p_sample = spsc_peek(&sample_queue)) != NULL) {
+    openthread_api_mutex_lock(ot_context);
+    ret = publish_sample(p_sample);
+    openthread_api_mutex_unlock(ot_context);
+
+    if (ret == -ENOMEM) {
+      publish_retries++;
+      publish_retries_total++;
+      delay = schedule_backoff(PUBLISH_RETRY_DELAY, publish_retries);
+      LOG_WRN("No message buffer, retry %u in %u ms (%u retries for %u "
+              "samples)",
+              publish_retries, delay, publish_retries_total, samples_read);
+      k_work_reschedule_for_queue(&publish_workq, &publish_work,
+                                  K_MSEC(delay));
+      break;
+    }
+
+    publish_retries = 0;
+    spsc_consume(&sample_queue);
+    spsc_release(&sample_queue);
+  }
+
+  if (IS_ENABLED(CONFIG_APP_SED_ALIGN)) {
+    openthread_api_mutex_lock(ot_context);
+    publish_flush();
+    openthread_api_mutex_unlock(ot_context);
+  }
+}
+
+/*
+ * Sampling stage: read the sensor on a fixed schedule and queue the sample
+ * for the publishing stage. If the queue is full, the sample is dropped.
+ *
+ * The schedule is a grid with a random phase per node, and each sample is
+ * taken at a random offset from its slot. The offsets don't accumulate, so
+ * the node keeps its phase, but nodes that ended up in the same slot don't
+ * stay in lockstep.
+ */
+static void sample_work_handler(struct k_work *work) {
+  int64_t now = k_uptime_get();
+  int64_t lateness = now - sample_deadline;
+  struct sensor_sample *p_sample;
+
+  if (lateness > CONFIG_APP_SAMPLE_LATE_THRESHOLD) {
+    samples_late++;
+    max_lateness = MAX(max_lateness, lateness);
+    LOG_WRN("Sample %lld ms late (%u late samples, max %lld ms)", lateness,
+            samples_late, max_lateness);
+  }
+
+  /* Keep the schedule, unless a whole interval was missed. */
+  sample_slot += CONFIG_APP_SAMPLE_INTERVAL;
+  if (sample_slot <= now) {
+    sample_slot = now + CONFIG_APP_SAMPLE_INTERVAL;
+  }
+  sample_deadline = sample_slot + schedule_jitter();
+  k_work_schedule_for_queue(&sample_workq, &sample_work,
+                            K_TIMEOUT_ABS_MS(sample_deadline));
+
+  p_sample = spsc_acquire(&sample_queue);
+  if (p_sample == NULL) {
+    samples_dropped++;
+    LOG_WRN("Sample queue full (%u dropped samples)", samples_dropped);
     return;
   }
 
-  LOG_INF("CoAP data sent");
+  read_sensors(p_sample);
+  samples_read++;
+  spsc_produce(&sample_queue);
+
+  /*
+   * Don't reschedule: if a report is waiting for a message buffer, the new
+   * sample waits for the same retry instead of cutting its backoff short.
+   */
+  k_work_schedule_for_queue(&publish_workq, &publish_work, K_NO_WAIT);
 }
 
 void init_coap(void) {
@@ -108,42 +457,64 @@ void init_coap(void) {
 }
 
 /*
- * Get a device structure from a devicetree node with compatible
- * "bosch,bme280". (If there are multiple, just pick one.)
+ * Check the devices of all devicetree nodes with compatible "bosch,bme280".
+ * Their sensor index in the reports is their position in sensor_devs.
  */
-static const struct device *get_bme280_device(void) {
-  const struct device *const dev = DEVICE_DT_GET_ANY(bosch_bme280);
+static int check_bme280_devices(void) {
+  for (size_t i = 0; i < ARRAY_SIZE(sensor_devs); i++) {
+    const struct device *const dev = sensor_devs[i];
 
-  if (dev == NULL) {
-    /* No such node, or the node does not have status "okay". */
-    LOG_ERR("Error: no device found.");
-    return NULL;
-  }
+    if (!device_is_ready(dev)) {
+      LOG_ERR("Error: Device \"%s\" is not ready; "
+              "check the driver initialization logs for errors.",
+              dev->name);
+      return -ENODEV;
+    }
 
-  if (!device_is_ready(dev)) {
-    LOG_ERR("Error: Device \"%s\" is not ready; "
-            "check the driver initialization logs for errors.",
-            dev->name);
-    return NULL;
+    LOG_INF("Found device \"%s\" as sensor %zu, getting sensor data",
+            dev->name, i);
   }
 
-  LOG_INF("Found device \"%s\", getting sensor data", dev->name);
-  return dev;
+  return 0;
 }
 
 int main(void) {
   init_coap();
+  if (IS_ENABLED(CONFIG_APP_OBSERVE)) {
+    observe_init();
+  }
+  publish_init();
+  publish_cycles_init();
+  schedule_init(publish_device_id()->eui64);
+  if (IS_ENABLED(CONFIG_APP_RADIO_STATS)) {
+    radio_stats_init();
+  }
+  if (IS_ENABLED(CONFIG_APP_STORE)) {
+    store_init();
+  }
+  if (IS_ENABLED(CONFIG_APP_HISTORY)) {
+    history_init();
+  }
 
-  const struct device *dev = get_bme280_device();
-
-  if (dev == NULL) {
+  if (check_bme280_devices() < 0) {
     LOG_ERR("Cannot initialize BME280 sensor");
     return 0;
   }
-
-  while (1) {
-    k_sleep(K_MSEC(5000));
-    send_sensor_request(dev);
+  if (IS_ENABLED(CONFIG_APP_SENSOR_PM)) {
+    sensor_pm_init();
   }
+
+  k_work_queue_start(&sample_workq, sample_stack,
+                     K_THREAD_STACK_SIZEOF(sample_stack), SAMPLE_PRIORITY,
+                     &(struct k_work_queue_config){.name = "sample_workq"});
+  k_work_queue_start(&publish_workq, publish_stack,
+                     K_THREAD_STACK_SIZEOF(publish_stack), PUBLISH_PRIORITY,
+                     &(struct k_work_queue_config){.name = "publish_workq"});
+
+  sample_slot = k_uptime_get() + schedule_phase();
+  sample_deadline = sample_slot;
+  k_work_schedule_for_queue(&sample_workq, &sample_work,
+                            K_TIMEOUT_ABS_MS(sample_deadline));
+
   return 0;
 }
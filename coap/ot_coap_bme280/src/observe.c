@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "observe.h"
+
+#include <errno.h>
+#include <openthread/coap.h>
+#include <openthread/thread.h>
+#include <string.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+#include <zephyr/sys/util.h>
+
+#include "report.h"
+
+LOG_MODULE_DECLARE(ot_coap_bme280);
+
+/* Observe Option values in a GET request (RFC 7641) */
+#define OBSERVE_REGISTER 0
+#define OBSERVE_DEREGISTER 1
+
+/* The Observe Option value is a 24-bit sequence number. */
+#define OBSERVE_SEQ_MASK 0xffffff
+
+struct observer {
+  bool active;
+  /* A confirmable notification is waiting for its acknowledgement. */
+  bool con_pending;
+  otIp6Address addr;
+  uint16_t port;
+  uint8_t token[OT_COAP_MAX_TOKEN_LENGTH];
+  uint8_t token_len;
+};
+
+static struct observer observers[CONFIG_APP_OBSERVE_MAX_OBSERVERS];
+static uint32_t observe_seq;
+static uint32_t notification_count;
+
+/* Last report, sent in the response to a GET request. */
+static uint8_t last_payload[REPORT_MAX_SIZE];
+static size_t last_payload_len;
+
+static void sensor_requested(void *p_context, otMessage *p_message,
+                             const otMessageInfo *p_message_info);
+
+static otCoapResource sensor_resource = {.mUriPath = "sensor",
+                                         .mHandler = sensor_requested,
+                                         .mContext = NULL,
+                                         .mNext = NULL};
+
+static struct observer *find_observer(const otMessageInfo *p_message_info) {
+  for (size_t i = 0; i < ARRAY_SIZE(observers); i++) {
+    if (observers[i].active &&
+        observers[i].port == p_message_info->mPeerPort &&
+        otIp6IsAddressEqual(&observers[i].addr, &p_message_info->mPeerAddr)) {
+      return &observers[i];
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Add the sender of a request as observer. An observer with the same
+ * endpoint is replaced, as required by RFC 7641.
+ */
+static struct observer *add_observer(otMessage *p_message,
+                                     const otMessageInfo *p_message_info) {
+  struct observer *p_observer = find_observer(p_message_info);
+
+  for (size_t i = 0; p_observer == NULL && i < ARRAY_SIZE(observers); i++) {
+    if (!observers[i].active) {
+      p_observer = &observers[i];
+    }
+  }
+
+  if (p_observer == NULL) {
+    return NULL;
+  }
+
+  p_observer->active = true;
+  p_observer->con_pending = false;
+  p_observer->addr = p_message_info->mPeerAddr;
+  p_observer->port = p_message_info->mPeerPort;
+  p_observer->token_len = otCoapMessageGetTokenLength(p_message);
+  memcpy(p_observer->token, otCoapMessageGetToken(p_message),
+         p_observer->token_len);
+
+  return p_observer;
+}
+
+static void remove_observer(struct observer *p_observer) {
+  char addr[OT_IP6_ADDRESS_STRING_SIZE];
+
+  otIp6AddressToString(&p_observer->addr, addr, sizeof(addr));
+  LOG_INF("Removed observer [%s]:%u", addr, p_observer->port);
+  p_observer->active = false;
+  p_observer->con_pending = false;
+}
+
+static otError append_payload(otMessage *p_message, const uint8_t *p_payload,
+                              size_t payload_len) {
+  otError error;
+
+  error = otCoapMessageAppendContentFormatOption(p_message,
+                                                 report_content_format());
+  if (error != OT_ERROR_NONE || payload_len == 0) {
+    return error;
+  }
+
+  error = otCoapMessageSetPayloadMarker(p_message);
+  if (error != OT_ERROR_NONE) {
+    return error;
+  }
+
+  return otMessageAppend(p_message, p_payload, payload_len);
+}
+
+static void sensor_send_response(otMessage *p_request_message,
+                                 const otMessageInfo *p_message_info,
+                                 bool observe) {
+  otError error;
+  otMessage *p_response;
+  otCoapType message_type;
+  otInstance *p_instance = openthread_get_default_instance();
+
+  p_response = otCoapNewMessage(p_instance, NULL);
+  if (p_response == NULL) {
+    LOG_ERR("Failed to create message for CoAP Response");
+    return;
+  }
+
+  if (otCoapMessageGetType(p_request_message) == OT_COAP_TYPE_CONFIRMABLE) {
+    message_type = OT_COAP_TYPE_ACKNOWLEDGMENT;
+  } else {
+    message_type = OT_COAP_TYPE_NON_CONFIRMABLE;
+  }
+
+  error = otCoapMessageInitResponse(p_response, p_request_message, message_type,
+                                    OT_COAP_CODE_CONTENT);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to initialize message for CoAP Response: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_response);
+    return;
+  }
+
+  if (observe) {
+    error = otCoapMessageAppendObserveOption(p_response, observe_seq);
+    if (error != OT_ERROR_NONE) {
+      LOG_ERR("Failed to append Observe option for CoAP Response: %s",
+              otThreadErrorToString(error));
+      otMessageFree(p_response);
+      return;
+    }
+  }
+
+  error = append_payload(p_response, last_payload, last_payload_len);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to append to CoAP Response message: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_response);
+    return;
+  }
+
+  error = otCoapSendResponse(p_instance, p_response, p_message_info);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to send CoAP Response: %s", otThreadErrorToString(error));
+    otMessageFree(p_response);
+  }
+}
+
+static void sensor_requested(void *p_context, otMessage *p_message,
+                             const otMessageInfo *p_message_info) {
+  otCoapOptionIterator iterator;
+  uint64_t observe = OBSERVE_DEREGISTER;
+  struct observer *p_observer;
+  char addr[OT_IP6_ADDRESS_STRING_SIZE];
+
+  /* Ignore the PUT requests of other sensor nodes. */
+  if (otCoapMessageGetCode(p_message) != OT_COAP_CODE_GET) {
+    return;
+  }
+
+  if (otCoapOptionIteratorInit(&iterator, p_message) == OT_ERROR_NONE &&
+      otCoapOptionIteratorGetFirstOptionMatching(
+          &iterator, OT_COAP_OPTION_OBSERVE) != NULL) {
+    otCoapOptionIteratorGetOptionUintValue(&iterator, &observe);
+  }
+
+  otIp6AddressToString(&p_message_info->mPeerAddr, addr, sizeof(addr));
+
+  if (observe == OBSERVE_REGISTER) {
+    p_observer = add_observer(p_message, p_message_info);
+    if (p_observer == NULL) {
+      LOG_WRN("No room for observer [%s]:%u", addr, p_message_info->mPeerPort);
+    } else {
+      LOG_INF("Added observer [%s]:%u", addr, p_message_info->mPeerPort);
+    }
+    sensor_send_response(p_message, p_message_info, p_observer != NULL);
+  } else {
+    /* A GET without Observe=0 ends an existing observation. */
+    p_observer = find_observer(p_message_info);
+    if (p_observer != NULL) {
+      remove_observer(p_observer);
+    }
+    sensor_send_response(p_message, p_message_info, false);
+  }
+}
+
+static void notification_response_cb(void *p_context, otMessage *p_message,
+                                     const otMessageInfo *p_message_info,
+                                     otError result) {
+  struct observer *p_observer = p_context;
+
+  if (!p_observer->con_pending) {
+    /* The observer was removed or registered again in the meantime. */
+    return;
+  }
+
+  p_observer->con_pending = false;
+  if (result != OT_ERROR_NONE) {
+    /* No acknowledgement or a reset: the observer is gone. */
+    LOG_WRN("Notification not acknowledged: %s",
+            otThreadErrorToString(result));
+    remove_observer(p_observer);
+  }
+}
+
+static int send_notification(struct observer *p_observer,
+                             const uint8_t *p_payload, size_t payload_len,
+                             bool confirmable) {
+  otError error;
+  otInstance *p_instance = openthread_get_default_instance();
+  otMessage *p_message;
+  otMessageInfo message_info;
+
+  p_message = otCoapNewMessage(p_instance, NULL);
+  if (p_message == NULL) {
+    LOG_ERR("Failed to create message for CoAP notification");
+    return -ENOMEM;
+  }
+
+  otCoapMessageInit(p_message,
+                    confirmable ? OT_COAP_TYPE_CONFIRMABLE
+                                : OT_COAP_TYPE_NON_CONFIRMABLE,
+                    OT_COAP_CODE_CONTENT);
+
+  error = otCoapMessageSetToken(p_message, p_observer->token,
+                                p_observer->token_len);
+  if (error == OT_ERROR_NONE) {
+    error = otCoapMessageAppendObserveOption(p_message, observe_seq);
+  }
+  if (error == OT_ERROR_NONE) {
+    error = append_payload(p_message, p_payload, payload_len);
+  }
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to build CoAP notification: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  memset(&message_info, 0, sizeof(message_info));
+  message_info.mPeerAddr = p_observer->addr;
+  message_info.mPeerPort = p_observer->port;
+
+  if (confirmable) {
+    error = otCoapSendRequest(p_instance, p_message, &message_info,
+                              notification_response_cb, p_observer);
+  } else {
+    error = otCoapSendRequest(p_instance, p_message, &message_info, NULL, NULL);
+  }
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to send CoAP notification: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  if (confirmable) {
+    p_observer->con_pending = true;
+  }
+  return 0;
+}
+
+int observe_notify(const uint8_t *p_payload, size_t payload_len) {
+  bool confirmable;
+  int notified = 0;
+  int ret = -ENOTCONN;
+
+  memcpy(last_payload, p_payload, MIN(payload_len, sizeof(last_payload)));
+  last_payload_len = MIN(payload_len, sizeof(last_payload));
+
+  observe_seq = (observe_seq + 1) & OBSERVE_SEQ_MASK;
+  confirmable = ++notification_count % CONFIG_APP_OBSERVE_CON_INTERVAL == 0;
+
+  for (size_t i = 0; i < ARRAY_SIZE(observers); i++) {
+    /*
+     * Skip an observer until it acknowledges its confirmable notification,
+     * so a dead one is removed when that times out. The reports in the
+     * meantime don't reach it, like a lost non-confirmable notification.
+     */
+    if (!observers[i].active || observers[i].con_pending) {
+      continue;
+    }
+
+    ret = send_notification(&observers[i], p_payload, payload_len,
+                            confirmable);
+    if (ret == 0) {
+      notified++;
+    }
+  }
+
+  if (notified > 0) {
+    LOG_INF("Notified %d observers", notified);
+    return 0;
+  }
+
+  return ret;
+}
+
+bool observe_con_pending(void) {
+  for (size_t i = 0; i < ARRAY_SIZE(observers); i++) {
+    if (observers[i].active && observers[i].con_pending) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void observe_init(void) {
+  otCoapAddResource(openthread_get_default_instance(), &sensor_resource);
+  LOG_INF("CoAP observable sensor resource started");
+}
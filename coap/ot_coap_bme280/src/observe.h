@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef OBSERVE_H_
+#define OBSERVE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Add the observable sensor resource to the CoAP service. */
+void observe_init(void);
+
+/*
+ * Send a report as a notification to all observers of the sensor resource.
+ * Every CONFIG_APP_OBSERVE_CON_INTERVAL notifications are confirmable, and
+ * observers that don't acknowledge them are removed. An observer gets no
+ * notifications while its confirmable one is waiting for an acknowledgement.
+ *
+ * Returns 0 if at least one observer was notified, -ENOTCONN if there are
+ * no observers, or -ENOMEM if no message buffer is available.
+ */
+int observe_notify(const uint8_t *p_payload, size_t payload_len);
+
+/*
+ * Whether a confirmable notification is waiting for its acknowledgement,
+ * which a sleepy end device only receives when it polls its parent.
+ */
+bool observe_con_pending(void);
+
+#endif /* OBSERVE_H_ */
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "publish.h"
+
+#include <errno.h>
+#include <openthread/coap.h>
+#include <openthread/link.h>
+#include <openthread/platform/radio.h>
+#include <openthread/random_noncrypto.h>
+#include <openthread/thread.h>
+#include <openthread/udp.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "discovery.h"
+#include "observe.h"
+
+LOG_MODULE_DECLARE(ot_coap_bme280);
+
+#define SEND_TO_ADDR "ff03::1"
+#define SENSOR_URI_PATH "sensor"
+
+#define COAP_VERSION 1
+#define COAP_OPTION_URI_PATH 11
+#define COAP_OPTION_CONTENT_FORMAT 12
+#define COAP_PAYLOAD_MARKER 0xff
+
+static struct report_id device_id;
+
+#if defined(CONFIG_APP_SED_ALIGN)
+/* Reports sent since the last data poll of publish_flush() */
+static uint32_t reports_unflushed;
+#endif
+
+#if defined(CONFIG_APP_PUBLISH_TEMPLATE)
+static otUdpSocket publish_socket;
+static otMessageInfo message_info;
+static uint8_t request_header[32];
+static size_t request_header_len;
+static uint16_t message_id;
+
+/* Encode an option delta or length in a nibble and its extended bytes. */
+static uint8_t coap_option_nibble(uint16_t value, uint8_t *ext,
+                                  size_t *ext_len) {
+  if (value < 13) {
+    return value;
+  } else if (value < 269) {
+    ext[(*ext_len)++] = value - 13;
+    return 13;
+  }
+
+  sys_put_be16(value - 269, &ext[*ext_len]);
+  *ext_len += 2;
+  return 14;
+}
+
+static int coap_put_option(uint8_t *buf, size_t size, size_t *len,
+                           uint16_t delta, const void *value,
+                           uint16_t value_len) {
+  uint8_t head[5];
+  size_t head_len = 1;
+  uint8_t delta_nibble = coap_option_nibble(delta, head, &head_len);
+  uint8_t len_nibble = coap_option_nibble(value_len, head, &head_len);
+
+  if (size - *len < head_len + value_len) {
+    return -ENOMEM;
+  }
+
+  head[0] = (delta_nibble << 4) | len_nibble;
+  memcpy(&buf[*len], head, head_len);
+  memcpy(&buf[*len + head_len], value, value_len);
+  *len += head_len + value_len;
+
+  return 0;
+}
+
+/*
+ * Encode the header of a NON-confirmable PUT request without token, with
+ * the Uri-Path and Content-Format options and the payload marker. Only the
+ * message ID changes from request to request.
+ */
+static int encode_request_header(void) {
+  uint8_t content_format = report_content_format();
+  size_t len = 4;
+  int ret;
+
+  request_header[0] =
+      (COAP_VERSION << 6) | (OT_COAP_TYPE_NON_CONFIRMABLE << 4);
+  request_header[1] = OT_COAP_CODE_PUT;
+
+  ret = coap_put_option(request_header, sizeof(request_header), &len,
+                        COAP_OPTION_URI_PATH, SENSOR_URI_PATH,
+                        strlen(SENSOR_URI_PATH));
+  if (ret < 0) {
+    return ret;
+  }
+
+  ret = coap_put_option(request_header, sizeof(request_header), &len,
+                        COAP_OPTION_CONTENT_FORMAT - COAP_OPTION_URI_PATH,
+                        &content_format, sizeof(content_format));
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (len == sizeof(request_header)) {
+    return -ENOMEM;
+  }
+  request_header[len++] = COAP_PAYLOAD_MARKER;
+  request_header_len = len;
+
+  return 0;
+}
+
+static void publish_receive(void *p_context, otMessage *p_message,
+                            const otMessageInfo *p_message_info) {
+  /* The reports are NON-confirmable, so there's nothing to handle. */
+}
+
+int publish_init(void) {
+  otInstance *p_instance = openthread_get_default_instance();
+  otExtAddress eui64;
+  otError error;
+  int ret;
+
+  otPlatRadioGetIeeeEui64(p_instance, eui64.m8);
+  report_id_init(&device_id, eui64.m8);
+  device_id.boot = otRandomNonCryptoGetUint32();
+
+  memset(&message_info, 0, sizeof(message_info));
+  otIp6AddressFromString(SEND_TO_ADDR, &message_info.mPeerAddr);
+  message_info.mPeerPort = OT_DEFAULT_COAP_PORT;
+
+  ret = encode_request_header();
+  if (ret < 0) {
+    LOG_ERR("Cannot encode CoAP request header: %d", ret);
+    return ret;
+  }
+  message_id = otRandomNonCryptoGetUint16();
+
+  error = otUdpOpen(p_instance, &publish_socket, publish_receive, NULL);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Cannot open UDP socket: %s", otThreadErrorToString(error));
+    return -EIO;
+  }
+
+  LOG_HEXDUMP_DBG(request_header, request_header_len, "CoAP request header:");
+  return 0;
+}
+
+const struct report_id *publish_device_id(void) { return &device_id; }
+
+static int publish_request(const uint8_t *p_payload, size_t payload_len) {
+  otError error;
+  otInstance *p_instance = openthread_get_default_instance();
+  otMessage *p_message;
+  otMessageInfo peer_info = message_info;
+
+#if defined(CONFIG_APP_COLLECTOR_DISCOVERY)
+  discovery_get_collector(&peer_info);
+#endif
+
+  p_message = otUdpNewMessage(p_instance, NULL);
+  if (p_message == NULL) {
+    LOG_ERR("Failed to create message for CoAP Request");
+    return -ENOMEM;
+  }
+
+  sys_put_be16(message_id++, &request_header[2]);
+
+  error = otMessageAppend(p_message, request_header, request_header_len);
+  if (error == OT_ERROR_NONE) {
+    error = otMessageAppend(p_message, p_payload, payload_len);
+  }
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to append to CoAP Request message: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  error = otUdpSend(p_instance, &publish_socket, p_message, &peer_info);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to send CoAP Request: %s", otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  LOG_INF("CoAP data sent");
+  return 0;
+}
+#else
+int publish_init(void) {
+  device_id.boot = otRandomNonCryptoGetUint32();
+  return 0;
+}
+
+/* Without the template, the device ID is rebuilt for every report. */
+const struct report_id *publish_device_id(void) {
+  otExtAddress eui64;
+
+  otPlatRadioGetIeeeEui64(openthread_get_default_instance(), eui64.m8);
+  report_id_init(&device_id, eui64.m8);
+
+  return &device_id;
+}
+
+#if !defined(CONFIG_APP_OBSERVE)
+static int publish_request(const uint8_t *p_payload, size_t payload_len) {
+  otError error = OT_ERROR_NONE;
+  otInstance *p_instance = openthread_get_default_instance();
+  otMessage *p_message;
+  otMessageInfo message_info;
+
+  memset(&message_info, 0, sizeof(message_info));
+  otIp6AddressFromString(SEND_TO_ADDR, &message_info.mPeerAddr);
+  message_info.mPeerPort = OT_DEFAULT_COAP_PORT;
+#if defined(CONFIG_APP_COLLECTOR_DISCOVERY)
+  discovery_get_collector(&message_info);
+#endif
+
+  p_message = otCoapNewMessage(p_instance, NULL);
+  if (p_message == NULL) {
+    LOG_ERR("Failed to create message for CoAP Request");
+    return -ENOMEM;
+  }
+
+  otCoapMessageInit(p_message, OT_COAP_TYPE_NON_CONFIRMABLE, OT_COAP_CODE_PUT);
+
+  error = otCoapMessageAppendUriPathOptions(p_message, SENSOR_URI_PATH);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to append Uri-Path option for CoAP Request: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  error = otCoapMessageAppendContentFormatOption(p_message,
+                                                 report_content_format());
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to append content format option for CoAP Request: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  error = otCoapMessageSetPayloadMarker(p_message);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to set payload marker for CoAP Request: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  error = otMessageAppend(p_message, p_payload, payload_len);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to append to CoAP Request message: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  error = otCoapSendRequest(p_instance, p_message, &message_info, NULL, NULL);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to send CoAP Request: %s", otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  LOG_INF("CoAP data sent");
+  return 0;
+}
+#endif
+#endif
+
+int publish_report(const uint8_t *p_payload, size_t payload_len) {
+  int ret;
+
+  /* Without a Thread partition the report would be lost anyway. */
+  if (otThreadGetDeviceRole(openthread_get_default_instance()) <
+      OT_DEVICE_ROLE_CHILD) {
+    return -ENOTCONN;
+  }
+
+#if defined(CONFIG_APP_OBSERVE)
+  ret = observe_notify(p_payload, payload_len);
+#else
+  ret = publish_request(p_payload, payload_len);
+#endif
+
+  if (ret == 0) {
+    /* A report that wasn't sent doesn't count as lost in the mesh. */
+    device_id.seq++;
+#if defined(CONFIG_APP_SED_ALIGN)
+    reports_unflushed++;
+#endif
+  }
+  return ret;
+}
+
+#if defined(CONFIG_APP_SED_ALIGN)
+/* Whether a response to the reports is on its way to the node */
+static bool response_expected(void) {
+#if defined(CONFIG_APP_OBSERVE)
+  return observe_con_pending();
+#else
+  /* The reports are non-confirmable requests without a response. */
+  return false;
+#endif
+}
+
+void publish_flush(void) {
+  otError error;
+  uint32_t reports = reports_unflushed;
+
+  if (reports == 0) {
+    return;
+  }
+  reports_unflushed = 0;
+
+  /*
+   * Anything else for the node waits for the next periodic data poll. Only
+   * the acknowledgement of a confirmable notification is worth an extra
+   * poll, because the observer gets no notifications until it comes in.
+   */
+  if (!response_expected()) {
+    return;
+  }
+
+  error = otLinkSendDataRequest(openthread_get_default_instance());
+  if (error != OT_ERROR_NONE) {
+    LOG_WRN("Failed to send data poll: %s", otThreadErrorToString(error));
+    return;
+  }
+
+  LOG_DBG("Sent data poll after %u reports", reports);
+}
+#endif
+
+#if defined(CONFIG_APP_PUBLISH_CYCLES)
+static struct {
+  uint32_t count;
+  uint64_t min;
+  uint64_t max;
+  uint64_t total;
+} cycles_stats;
+
+void publish_cycles_init(void) {
+  timing_init();
+  timing_start();
+}
+
+static uint32_t cycles_to_us(uint64_t cycles) {
+  return (uint32_t)(timing_cycles_to_ns(cycles) / NSEC_PER_USEC);
+}
+
+void publish_cycles_record(timing_t start) {
+  timing_t end = timing_counter_get();
+  uint64_t cycles = timing_cycles_get(&start, &end);
+
+  if (cycles_stats.count == 0 || cycles < cycles_stats.min) {
+    cycles_stats.min = cycles;
+  }
+  if (cycles > cycles_stats.max) {
+    cycles_stats.max = cycles;
+  }
+  cycles_stats.total += cycles;
+  cycles_stats.count++;
+
+  if (cycles_stats.count == CONFIG_APP_PUBLISH_CYCLES_INTERVAL) {
+    LOG_INF("Time per report: min %u us, avg %u us, max %u us "
+            "(avg %u cycles at %u MHz)",
+            cycles_to_us(cycles_stats.min),
+            (uint32_t)(timing_cycles_to_ns_avg(cycles_stats.total,
+                                               cycles_stats.count) /
+                       NSEC_PER_USEC),
+            cycles_to_us(cycles_stats.max),
+            (uint32_t)(cycles_stats.total / cycles_stats.count),
+            timing_freq_get_mhz());
+    memset(&cycles_stats, 0, sizeof(cycles_stats));
+  }
+}
+#endif
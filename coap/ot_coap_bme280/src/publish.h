@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef PUBLISH_H_
+#define PUBLISH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/timing/timing.h>
+
+#include "report.h"
+
+/*
+ * Prepare the publish path. With CONFIG_APP_PUBLISH_TEMPLATE this reads the
+ * device ID, parses the peer address and encodes the CoAP request header
+ * once, so each report only has to append its payload.
+ */
+int publish_init(void);
+
+/* ID of this device to put in the reports. */
+const struct report_id *publish_device_id(void);
+
+/*
+ * Send a payload as a NON-confirmable PUT request to the sensor resource, or
+ * with CONFIG_APP_OBSERVE as a notification to the observers of the node's
+ * own sensor resource.
+ *
+ * Returns 0 on success, -ENOMEM if no message buffer is available, -ENOTCONN
+ * if the node isn't attached to a Thread partition or there are no
+ * observers, or -EIO if the report can't be sent.
+ */
+int publish_report(const uint8_t *p_payload, size_t payload_len);
+
+#if defined(CONFIG_APP_SED_ALIGN)
+/*
+ * Send a data poll after the reports that were sent since the last flush,
+ * but only if one of them is a confirmable notification waiting for its
+ * acknowledgement. Otherwise the periodic data polls are enough. Call this
+ * with the OpenThread API mutex held, once the queued samples are
+ * published.
+ */
+void publish_flush(void);
+#else
+static inline void publish_flush(void) {}
+#endif
+
+#if defined(CONFIG_APP_PUBLISH_CYCLES)
+/* Start the timing counter that measures the time spent per report. */
+void publish_cycles_init(void);
+
+/* Read the timing counter when a report is started. */
+static inline timing_t publish_cycles_start(void) {
+  return timing_counter_get();
+}
+
+/*
+ * Record the time that was spent to encode and send one report since the
+ * given publish_cycles_start().
+ */
+void publish_cycles_record(timing_t start);
+#else
+static inline void publish_cycles_init(void) {}
+static inline timing_t publish_cycles_start(void) { return 0; }
+static inline void publish_cycles_record(timing_t start) {}
+#endif
+
+#endif /* PUBLISH_H_ */
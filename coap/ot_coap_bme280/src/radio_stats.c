@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "radio_stats.h"
+
+#include <openthread/radio_stats.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+
+LOG_MODULE_DECLARE(ot_coap_bme280);
+
+static void radio_stats_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(radio_stats_work, radio_stats_work_handler);
+
+static void radio_stats_work_handler(struct k_work *work) {
+  struct openthread_context *ot_context = openthread_get_default_context();
+  otRadioTimeStats stats;
+  uint64_t total;
+  uint64_t on;
+
+  openthread_api_mutex_lock(ot_context);
+  stats = *otRadioTimeStatsGet(openthread_get_default_instance());
+  openthread_api_mutex_unlock(ot_context);
+
+  /* The times are in microseconds since boot. */
+  on = stats.mTxTime + stats.mRxTime;
+  total = on + stats.mSleepTime + stats.mDisabledTime;
+  if (total > 0) {
+    LOG_INF("Radio on %llu ms of %llu ms (%u ppm): tx %llu ms, rx %llu ms",
+            on / 1000, total / 1000, (uint32_t)(on * 1000000 / total),
+            stats.mTxTime / 1000, stats.mRxTime / 1000);
+  }
+
+  k_work_schedule(&radio_stats_work, K_MSEC(CONFIG_APP_RADIO_STATS_INTERVAL));
+}
+
+void radio_stats_init(void) {
+  k_work_schedule(&radio_stats_work, K_MSEC(CONFIG_APP_RADIO_STATS_INTERVAL));
+}
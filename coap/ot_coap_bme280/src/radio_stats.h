@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef RADIO_STATS_H_
+#define RADIO_STATS_H_
+
+/*
+ * Log the time the radio was on every CONFIG_APP_RADIO_STATS_INTERVAL
+ * milliseconds, to compare the energy use of different configurations.
+ */
+void radio_stats_init(void);
+
+#endif /* RADIO_STATS_H_ */
@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "report.h"
+#include "aggregate.h"
+#include "batch.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+
+/* Integer keys of the CBOR map, see CONFIG_APP_PAYLOAD_CBOR. */
+enum report_key {
+  REPORT_KEY_ID = 0,
+  REPORT_KEY_TEMP = 1,
+  REPORT_KEY_PRESS = 2,
+  REPORT_KEY_HUM = 3,
+  REPORT_KEY_TIMESTAMP = 4,
+  REPORT_KEY_UPTIME = 5,
+  REPORT_KEY_SAMPLES = 6,
+  REPORT_KEY_SENSORS = 7,
+  REPORT_KEY_COUNT = 8,
+  REPORT_KEY_STATS = 9,
+  REPORT_KEY_SEQ = 10,
+  REPORT_KEY_BOOT = 11,
+};
+
+/* Number of map entries written by cbor_put_id() */
+#define REPORT_ID_ENTRIES 3
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NINT 1
+#define CBOR_MAJOR_BSTR 2
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+
+struct cbor_writer {
+  uint8_t *buf;
+  size_t size;
+  size_t len;
+  bool overflow;
+};
+
+static void cbor_put_bytes(struct cbor_writer *w, const uint8_t *data,
+                           size_t len) {
+  if (w->overflow || w->size - w->len < len) {
+    w->overflow = true;
+    return;
+  }
+
+  memcpy(&w->buf[w->len], data, len);
+  w->len += len;
+}
+
+/* Write an initial byte with the shortest encoding of the argument. */
+static void cbor_put_head(struct cbor_writer *w, uint8_t major,
+                          uint32_t value) {
+  uint8_t head[5];
+  size_t len;
+
+  if (value < 24) {
+    head[0] = (major << 5) | value;
+    len = 1;
+  } else if (value <= UINT8_MAX) {
+    head[0] = (major << 5) | 24;
+    head[1] = value;
+    len = 2;
+  } else if (value <= UINT16_MAX) {
+    head[0] = (major << 5) | 25;
+    sys_put_be16(value, &head[1]);
+    len = 3;
+  } else {
+    head[0] = (major << 5) | 26;
+    sys_put_be32(value, &head[1]);
+    len = 5;
+  }
+
+  cbor_put_bytes(w, head, len);
+}
+
+static void cbor_put_int(struct cbor_writer *w, int32_t value) {
+  if (value >= 0) {
+    cbor_put_head(w, CBOR_MAJOR_UINT, value);
+  } else {
+    /* A negative integer n is encoded as -1 - n. */
+    cbor_put_head(w, CBOR_MAJOR_NINT, -(value + 1));
+  }
+}
+
+/* Write the temperature, pressure and humidity of a sensor. */
+static void cbor_put_readings(struct cbor_writer *w,
+                              const struct sensor_report *report) {
+  cbor_put_int(w, report_temp_centi(report));
+  cbor_put_int(w, report_press_pa(report));
+  cbor_put_int(w, report_hum_centi(report));
+}
+
+/* Put the device ID, sequence number and boot ID entries of the map. */
+static void cbor_put_id(struct cbor_writer *w, const struct report_id *id) {
+  cbor_put_int(w, REPORT_KEY_ID);
+  cbor_put_head(w, CBOR_MAJOR_BSTR, REPORT_EUI64_SIZE);
+  cbor_put_bytes(w, id->eui64, REPORT_EUI64_SIZE);
+  cbor_put_int(w, REPORT_KEY_SEQ);
+  cbor_put_head(w, CBOR_MAJOR_UINT, id->seq);
+  cbor_put_int(w, REPORT_KEY_BOOT);
+  cbor_put_head(w, CBOR_MAJOR_UINT, id->boot);
+}
+
+static int encode_cbor(uint8_t *buf, size_t size, const struct report_id *id,
+                       const struct sensor_sample *sample) {
+  struct cbor_writer w = {.buf = buf, .size = size};
+  const struct sensor_report *report = &sample->report[0];
+
+  if (REPORT_SENSOR_COUNT > 1) {
+    cbor_put_head(&w, CBOR_MAJOR_MAP, REPORT_ID_ENTRIES + 1);
+  } else {
+    cbor_put_head(&w, CBOR_MAJOR_MAP, REPORT_ID_ENTRIES + 3);
+  }
+  cbor_put_id(&w, id);
+
+  if (REPORT_SENSOR_COUNT > 1) {
+    cbor_put_int(&w, REPORT_KEY_SENSORS);
+    cbor_put_head(&w, CBOR_MAJOR_MAP, REPORT_SENSOR_COUNT);
+    for (size_t i = 0; i < REPORT_SENSOR_COUNT; i++) {
+      cbor_put_head(&w, CBOR_MAJOR_UINT, i);
+      cbor_put_head(&w, CBOR_MAJOR_ARRAY, 3);
+      cbor_put_readings(&w, &sample->report[i]);
+    }
+  } else {
+    cbor_put_int(&w, REPORT_KEY_TEMP);
+    cbor_put_int(&w, report_temp_centi(report));
+    cbor_put_int(&w, REPORT_KEY_PRESS);
+    cbor_put_int(&w, report_press_pa(report));
+    cbor_put_int(&w, REPORT_KEY_HUM);
+    cbor_put_int(&w, report_hum_centi(report));
+  }
+
+  return w.overflow ? -ENOMEM : (int)w.len;
+}
+
+static int encode_cbor_batch(uint8_t *buf, size_t size,
+                             const struct report_id *id,
+                             const struct sample_batch *batch,
+                             const uint32_t *now) {
+  struct cbor_writer w = {.buf = buf, .size = size};
+  const struct sensor_sample *sample = batch_get(batch, 0);
+  uint32_t previous = sample->timestamp;
+
+  cbor_put_head(&w, CBOR_MAJOR_MAP, REPORT_ID_ENTRIES + (now != NULL ? 3 : 2));
+  cbor_put_id(&w, id);
+  cbor_put_int(&w, REPORT_KEY_TIMESTAMP);
+  cbor_put_head(&w, CBOR_MAJOR_UINT, sample->timestamp);
+  if (now != NULL) {
+    cbor_put_int(&w, REPORT_KEY_UPTIME);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, *now);
+  }
+  cbor_put_int(&w, REPORT_KEY_SAMPLES);
+  cbor_put_head(&w, CBOR_MAJOR_ARRAY, batch_count(batch));
+
+  for (size_t i = 0; i < batch_count(batch); i++) {
+    sample = batch_get(batch, i);
+    cbor_put_head(&w, CBOR_MAJOR_ARRAY, 1 + 3 * REPORT_SENSOR_COUNT);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, sample->timestamp - previous);
+    for (size_t j = 0; j < REPORT_SENSOR_COUNT; j++) {
+      cbor_put_readings(&w, &sample->report[j]);
+    }
+    previous = sample->timestamp;
+  }
+
+  return w.overflow ? -ENOMEM : (int)w.len;
+}
+
+#if defined(CONFIG_APP_AGGREGATE)
+static void cbor_put_stats(struct cbor_writer *w, const struct aggregate *agg,
+                           const struct channel_stats *stats) {
+  cbor_put_head(w, CBOR_MAJOR_ARRAY, 4);
+  cbor_put_int(w, stats->min);
+  cbor_put_int(w, stats->max);
+  cbor_put_int(w, aggregate_mean(agg, stats));
+  cbor_put_int(w, aggregate_stddev(agg, stats));
+}
+
+static int encode_cbor_stats(uint8_t *buf, size_t size,
+                             const struct report_id *id,
+                             const struct aggregate *agg, uint32_t now) {
+  struct cbor_writer w = {.buf = buf, .size = size};
+
+  cbor_put_head(&w, CBOR_MAJOR_MAP, REPORT_ID_ENTRIES + 4);
+  cbor_put_id(&w, id);
+  cbor_put_int(&w, REPORT_KEY_TIMESTAMP);
+  cbor_put_head(&w, CBOR_MAJOR_UINT, agg->start);
+  cbor_put_int(&w, REPORT_KEY_UPTIME);
+  cbor_put_head(&w, CBOR_MAJOR_UINT, now);
+  cbor_put_int(&w, REPORT_KEY_COUNT);
+  cbor_put_head(&w, CBOR_MAJOR_UINT, aggregate_count(agg));
+  cbor_put_int(&w, REPORT_KEY_STATS);
+  cbor_put_head(&w, CBOR_MAJOR_ARRAY, 3 * REPORT_SENSOR_COUNT);
+
+  for (size_t i = 0; i < REPORT_SENSOR_COUNT; i++) {
+    cbor_put_stats(&w, agg, &agg->sensor[i].temp);
+    cbor_put_stats(&w, agg, &agg->sensor[i].press);
+    cbor_put_stats(&w, agg, &agg->sensor[i].hum);
+  }
+
+  return w.overflow ? -ENOMEM : (int)w.len;
+}
+#endif
+
+/*
+ * Arguments for CENTI_FMT of a channel of a sensor, with the sign of the
+ * sensor value.
+ */
+#define READING_ARGS(report, channel, centi)                                   \
+  CENTI_SIGN_ARGS(centi(report), report_is_negative(&(report)->channel))
+
+/* Append formatted text to buf, keeping track of overflows in len. */
+static void json_append(uint8_t *buf, size_t size, int *len, const char *fmt,
+                        ...) {
+  va_list args;
+
+  if (*len < 0 || *len >= (int)size) {
+    *len = -ENOMEM;
+    return;
+  }
+
+  va_start(args, fmt);
+  *len += vsnprintk((char *)&buf[*len], size - *len, fmt, args);
+  va_end(args);
+}
+
+/* Append the temperature, pressure and humidity of a sensor. */
+static void json_append_readings(uint8_t *buf, size_t size, int *len,
+                                 const struct sensor_report *report) {
+  json_append(buf, size, len, CENTI_FMT "," CENTI_FMT "," CENTI_FMT,
+              READING_ARGS(report, temp, report_temp_centi),
+              READING_ARGS(report, press, report_press_pa),
+              READING_ARGS(report, hum, report_hum_centi));
+}
+
+/* Open the object with the device ID, sequence number and boot ID. */
+static void json_append_id(uint8_t *buf, size_t size, int *len,
+                           const struct report_id *id) {
+  json_append(buf, size, len, "{\"id\":\"%s\",\"seq\":%u,\"boot\":%u", id->hex,
+              id->seq, id->boot);
+}
+
+static int encode_json(uint8_t *buf, size_t size, const struct report_id *id,
+                       const struct sensor_sample *sample) {
+  const struct sensor_report *report = &sample->report[0];
+  int len = 0;
+
+  if (REPORT_SENSOR_COUNT > 1) {
+    json_append_id(buf, size, &len, id);
+    json_append(buf, size, &len, ",\"sensors\":{");
+    for (size_t i = 0; i < REPORT_SENSOR_COUNT; i++) {
+      json_append(buf, size, &len, "%s\"%zu\":[", i > 0 ? "," : "", i);
+      json_append_readings(buf, size, &len, &sample->report[i]);
+      json_append(buf, size, &len, "]");
+    }
+    json_append(buf, size, &len, "}}");
+
+    return len < (int)size ? len : -ENOMEM;
+  }
+
+  // Convert sensor values to °C, hPa, and % with 2 decimal places
+  json_append_id(buf, size, &len, id);
+  json_append(buf, size, &len,
+              ",\"temp\":" CENTI_FMT ",\"press\":" CENTI_FMT
+              ",\"hum\":" CENTI_FMT "}",
+              READING_ARGS(report, temp, report_temp_centi),
+              READING_ARGS(report, press, report_press_pa),
+              READING_ARGS(report, hum, report_hum_centi));
+
+  return len < (int)size ? len : -ENOMEM;
+}
+
+static int encode_json_batch(uint8_t *buf, size_t size,
+                             const struct report_id *id,
+                             const struct sample_batch *batch,
+                             const uint32_t *now) {
+  const struct sensor_sample *sample = batch_get(batch, 0);
+  uint32_t previous = sample->timestamp;
+  int len = 0;
+
+  json_append_id(buf, size, &len, id);
+  json_append(buf, size, &len, ",\"ts\":%u", sample->timestamp);
+  if (now != NULL) {
+    json_append(buf, size, &len, ",\"up\":%u", *now);
+  }
+  json_append(buf, size, &len, ",\"samples\":[");
+
+  for (size_t i = 0; i < batch_count(batch); i++) {
+    sample = batch_get(batch, i);
+    json_append(buf, size, &len, "%s[%u", i > 0 ? "," : "",
+                sample->timestamp - previous);
+    for (size_t j = 0; j < REPORT_SENSOR_COUNT; j++) {
+      json_append(buf, size, &len, ",");
+      json_append_readings(buf, size, &len, &sample->report[j]);
+    }
+    json_append(buf, size, &len, "]");
+    previous = sample->timestamp;
+  }
+
+  json_append(buf, size, &len, "]}");
+
+  return len < (int)size ? len : -ENOMEM;
+}
+
+#if defined(CONFIG_APP_AGGREGATE)
+static void json_append_stats(uint8_t *buf, size_t size, int *len,
+                              const char *sep, const struct aggregate *agg,
+                              const struct channel_stats *stats) {
+  int32_t mean = aggregate_mean(agg, stats);
+  int32_t stddev = aggregate_stddev(agg, stats);
+
+  json_append(buf, size, len,
+              "%s[" CENTI_FMT "," CENTI_FMT "," CENTI_FMT "," CENTI_FMT "]",
+              sep, CENTI_ARGS(stats->min), CENTI_ARGS(stats->max),
+              CENTI_ARGS(mean), CENTI_ARGS(stddev));
+}
+
+static int encode_json_stats(uint8_t *buf, size_t size,
+                             const struct report_id *id,
+                             const struct aggregate *agg, uint32_t now) {
+  int len = 0;
+
+  json_append_id(buf, size, &len, id);
+  json_append(buf, size, &len, ",\"ts\":%u,\"up\":%u,\"n\":%u,\"stats\":[",
+              agg->start, now, aggregate_count(agg));
+
+  for (size_t i = 0; i < REPORT_SENSOR_COUNT; i++) {
+    json_append_stats(buf, size, &len, i > 0 ? "," : "", agg,
+                      &agg->sensor[i].temp);
+    json_append_stats(buf, size, &len, ",", agg, &agg->sensor[i].press);
+    json_append_stats(buf, size, &len, ",", agg, &agg->sensor[i].hum);
+  }
+
+  json_append(buf, size, &len, "]}");
+
+  return len < (int)size ? len : -ENOMEM;
+}
+#endif
+
+void report_id_init(struct report_id *id,
+                    const uint8_t eui64[REPORT_EUI64_SIZE]) {
+  char hex[3];
+
+  memcpy(id->eui64, eui64, REPORT_EUI64_SIZE);
+  id->hex[0] = '\0';
+  for (uint8_t i = 0; i < REPORT_EUI64_SIZE; i++) {
+    snprintk(hex, sizeof(hex), "%02X", eui64[i]);
+    strcat(id->hex, hex);
+  }
+}
+
+otCoapOptionContentFormat report_content_format(void) {
+  if (IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR)) {
+    return OT_COAP_OPTION_CONTENT_FORMAT_CBOR;
+  }
+
+  return OT_COAP_OPTION_CONTENT_FORMAT_JSON;
+}
+
+int report_encode(uint8_t *buf, size_t size, const struct report_id *id,
+                  const struct sensor_sample *sample) {
+  if (IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR)) {
+    return encode_cbor(buf, size, id, sample);
+  }
+
+  return encode_json(buf, size, id, sample);
+}
+
+int report_encode_batch(uint8_t *buf, size_t size, const struct report_id *id,
+                        const struct sample_batch *batch, const uint32_t *now) {
+  if (batch_count(batch) == 0) {
+    return -ENODATA;
+  }
+
+  if (IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR)) {
+    return encode_cbor_batch(buf, size, id, batch, now);
+  }
+
+  return encode_json_batch(buf, size, id, batch, now);
+}
+
+#if defined(CONFIG_APP_AGGREGATE)
+int report_encode_stats(uint8_t *buf, size_t size, const struct report_id *id,
+                        const struct aggregate *agg, uint32_t now) {
+  if (aggregate_count(agg) == 0) {
+    return -ENODATA;
+  }
+
+  if (IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR)) {
+    return encode_cbor_stats(buf, size, id, agg, now);
+  }
+
+  return encode_json_stats(buf, size, id, agg, now);
+}
+#endif
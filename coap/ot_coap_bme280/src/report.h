@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef REPORT_H_
+#define REPORT_H_
+
+#include <openthread/coap.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/sensor.h>
+
+#include "centi.h"
+
+#define REPORT_EUI64_SIZE 8
+
+/* Number of BME280 sensors, one for each okay devicetree instance. */
+#define REPORT_SENSOR_COUNT DT_NUM_INST_STATUS_OKAY(bosch_bme280)
+
+/* Largest payload produced by the report_encode*() functions. */
+#if defined(CONFIG_APP_AGGREGATE)
+#define REPORT_MAX_SIZE (128 + 128 * REPORT_SENSOR_COUNT)
+#else
+#define REPORT_MAX_SIZE                                                        \
+  (128 + 40 * CONFIG_APP_BATCH_SIZE * REPORT_SENSOR_COUNT)
+#endif
+
+/* Identification of the device in the reports. */
+struct report_id {
+  uint8_t eui64[REPORT_EUI64_SIZE];
+  /* EUI-64 as a hexadecimal string for the JSON reports. */
+  char hex[2 * REPORT_EUI64_SIZE + 1];
+  /*
+   * Random ID of this boot, and sequence number of the next report in this
+   * boot. The collector uses them to count lost and duplicate reports.
+   */
+  uint32_t boot;
+  uint32_t seq;
+};
+
+struct sensor_report {
+  struct sensor_value temp;
+  struct sensor_value press;
+  struct sensor_value hum;
+};
+
+/*
+ * Convert a sensor value to an integer in units of divisor millionths,
+ * rounded half away from zero. This only uses integer arithmetic.
+ */
+static inline int32_t report_scale(const struct sensor_value *value,
+                                   int32_t divisor) {
+  return centi_scale(value->val1, value->val2, divisor);
+}
+
+/* Whether a sensor value is below zero, even if it rounds to zero. */
+static inline bool report_is_negative(const struct sensor_value *value) {
+  return value->val1 < 0 || value->val2 < 0;
+}
+
+/* Convert sensor values to 0.01 °C, Pa (0.01 hPa), and 0.01 % */
+static inline int32_t report_temp_centi(const struct sensor_report *report) {
+  return report_scale(&report->temp, 10000);
+}
+
+static inline int32_t report_press_pa(const struct sensor_report *report) {
+  /* The pressure channel is in kPa. */
+  return report_scale(&report->press, 1000);
+}
+
+static inline int32_t report_hum_centi(const struct sensor_report *report) {
+  return report_scale(&report->hum, 10000);
+}
+
+struct sensor_sample {
+  /* Uptime in milliseconds when the sample was taken. */
+  uint32_t timestamp;
+  /* Readings of all sensors, taken in the same wake cycle */
+  struct sensor_report report[REPORT_SENSOR_COUNT];
+};
+
+struct sample_batch;
+struct aggregate;
+
+void report_id_init(struct report_id *id,
+                    const uint8_t eui64[REPORT_EUI64_SIZE]);
+
+/*
+ * Content-Format of the payloads produced by report_encode(), selected with
+ * CONFIG_APP_PAYLOAD_JSON or CONFIG_APP_PAYLOAD_CBOR.
+ */
+otCoapOptionContentFormat report_content_format(void);
+
+/*
+ * Encode a sensor report of the device with the given ID in buf. With more
+ * than one sensor, the readings are keyed by sensor index.
+ *
+ * Returns the length of the payload, or -ENOMEM if it doesn't fit in size
+ * bytes.
+ */
+int report_encode(uint8_t *buf, size_t size, const struct report_id *id,
+                  const struct sensor_sample *sample);
+
+/*
+ * Encode all samples in the batch in one report of the device with the given
+ * ID in buf. The report has the timestamp of the oldest sample, the
+ * uptime now and for each sample the milliseconds since the previous one.
+ * Pass NULL as now for samples of an earlier boot, whose timestamps can't
+ * be related to the uptime; the report then has no uptime.
+ *
+ * Returns the length of the payload, -ENODATA if the batch is empty, or
+ * -ENOMEM if it doesn't fit in size bytes.
+ */
+int report_encode_batch(uint8_t *buf, size_t size, const struct report_id *id,
+                        const struct sample_batch *batch, const uint32_t *now);
+
+/*
+ * Encode the statistics of a window in one report of the device with the
+ * given ID in buf. The report has the timestamp of the first sample in the
+ * window, the uptime now, the number of samples and for each channel of
+ * each sensor the minimum, maximum, mean and standard deviation.
+ *
+ * Returns the length of the payload, -ENODATA if the window is empty, or
+ * -ENOMEM if it doesn't fit in size bytes.
+ */
+int report_encode_stats(uint8_t *buf, size_t size, const struct report_id *id,
+                        const struct aggregate *agg, uint32_t now);
+
+#endif /* REPORT_H_ */
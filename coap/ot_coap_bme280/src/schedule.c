@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "schedule.h"
+
+#include <zephyr/sys/util.h>
+
+BUILD_ASSERT(CONFIG_APP_SAMPLE_JITTER < CONFIG_APP_SAMPLE_INTERVAL / 2,
+             "Sample jitter must be less than half the sample interval");
+
+static uint32_t rng_state = 1;
+
+/* Xorshift generator: the schedule only needs spread, not secrecy. */
+static uint32_t schedule_rand(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+
+  return rng_state;
+}
+
+void schedule_init(const uint8_t eui64[REPORT_EUI64_SIZE]) {
+  /* FNV-1a hash of the EUI-64 */
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < REPORT_EUI64_SIZE; i++) {
+    hash = (hash ^ eui64[i]) * 16777619u;
+  }
+
+  rng_state = hash != 0 ? hash : 1;
+}
+
+uint32_t schedule_phase(void) {
+  return schedule_rand() % CONFIG_APP_SAMPLE_INTERVAL;
+}
+
+int32_t schedule_jitter(void) {
+  if (CONFIG_APP_SAMPLE_JITTER == 0) {
+    return 0;
+  }
+
+  return (int32_t)(schedule_rand() % (2 * CONFIG_APP_SAMPLE_JITTER + 1)) -
+         CONFIG_APP_SAMPLE_JITTER;
+}
+
+uint32_t schedule_backoff(uint32_t retry_delay, uint32_t retries) {
+  uint32_t delay = retry_delay;
+
+  while (retries > 1 && delay < CONFIG_APP_PUBLISH_BACKOFF_MAX) {
+    delay *= 2;
+    retries--;
+  }
+  delay = MIN(delay, CONFIG_APP_PUBLISH_BACKOFF_MAX);
+
+  return delay / 2 + schedule_rand() % (delay / 2 + 1);
+}
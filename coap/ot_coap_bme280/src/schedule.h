@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+#include <stdint.h>
+
+#include "report.h"
+
+/*
+ * Seed the random generator of the schedule from the EUI-64 of the node, so
+ * nodes that boot at the same time still pick different offsets, even
+ * without a hardware entropy source.
+ */
+void schedule_init(const uint8_t eui64[REPORT_EUI64_SIZE]);
+
+/* Offset of the first sample after boot, in [0, CONFIG_APP_SAMPLE_INTERVAL) */
+uint32_t schedule_phase(void);
+
+/* Random offset of a sample from its slot, in +/- CONFIG_APP_SAMPLE_JITTER */
+int32_t schedule_jitter(void);
+
+/*
+ * Delay before the given retry (1 for the first one) of a report that
+ * couldn't get a message buffer: a random time between half and all of
+ * retry_delay doubled per retry, up to CONFIG_APP_PUBLISH_BACKOFF_MAX.
+ */
+uint32_t schedule_backoff(uint32_t retry_delay, uint32_t retries);
+
+#endif /* SCHEDULE_H_ */
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "sensor_pm.h"
+
+#include <errno.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/sys/util.h>
+
+LOG_MODULE_DECLARE(ot_coap_bme280);
+
+/* All okay "bosch,bme280" devicetree nodes and their I2C buses */
+#define BME280_DEVICE_AND_COMMA(node_id) DEVICE_DT_GET(node_id),
+#define BME280_BUS_AND_COMMA(node_id) DEVICE_DT_GET(DT_BUS(node_id)),
+static const struct device *const sensor_devs[] = {
+    DT_FOREACH_STATUS_OKAY(bosch_bme280, BME280_DEVICE_AND_COMMA)};
+static const struct device *const bus_devs[] = {
+    DT_FOREACH_STATUS_OKAY(bosch_bme280, BME280_BUS_AND_COMMA)};
+
+static struct sensor_pm_stats stats;
+static uint32_t bus_resumed;
+static uint32_t sensor_resumed;
+
+/*
+ * Run a power management action. Several sensors can share a bus, so a bus
+ * that is already in the requested state is fine, and so is a device whose
+ * driver doesn't support power management.
+ */
+static int run_action(const struct device *dev, enum pm_device_action action) {
+  int ret = pm_device_action_run(dev, action);
+
+  if (ret == -EALREADY || ret == -ENOSYS) {
+    return 0;
+  }
+  if (ret < 0) {
+    LOG_ERR("Failed to %s device \"%s\": %d",
+            action == PM_DEVICE_ACTION_RESUME ? "resume" : "suspend",
+            dev->name, ret);
+  }
+
+  return ret;
+}
+
+static int resume_devices(const struct device *const *devs, size_t count) {
+  int ret;
+
+  for (size_t i = 0; i < count; i++) {
+    ret = run_action(devs[i], PM_DEVICE_ACTION_RESUME);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  return 0;
+}
+
+static void suspend_devices(const struct device *const *devs, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    run_action(devs[i], PM_DEVICE_ACTION_SUSPEND);
+  }
+}
+
+static void log_stats(void) {
+  uint32_t uptime = k_uptime_get_32();
+
+  if (uptime == 0) {
+    return;
+  }
+
+  /* Microseconds per second of uptime is the duty cycle in ppm. */
+  LOG_INF("Sensor active %llu us (%u ppm), bus active %llu us (%u ppm) "
+          "in %u wakeups",
+          stats.sensor_active_us,
+          (uint32_t)(stats.sensor_active_us * 1000 / uptime),
+          stats.bus_active_us,
+          (uint32_t)(stats.bus_active_us * 1000 / uptime), stats.wakeups);
+}
+
+int sensor_pm_init(void) {
+  suspend_devices(sensor_devs, ARRAY_SIZE(sensor_devs));
+  suspend_devices(bus_devs, ARRAY_SIZE(bus_devs));
+
+  return 0;
+}
+
+int sensor_pm_resume(void) {
+  int ret;
+
+  bus_resumed = k_cycle_get_32();
+  sensor_resumed = bus_resumed;
+  ret = resume_devices(bus_devs, ARRAY_SIZE(bus_devs));
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* Resuming a BME280 reinitializes it, which needs the bus. */
+  sensor_resumed = k_cycle_get_32();
+  return resume_devices(sensor_devs, ARRAY_SIZE(sensor_devs));
+}
+
+void sensor_pm_suspend(void) {
+  uint32_t now;
+
+  /* The BME280 is put in sleep mode over the bus, so it goes first. */
+  suspend_devices(sensor_devs, ARRAY_SIZE(sensor_devs));
+  now = k_cycle_get_32();
+  stats.sensor_active_us += k_cyc_to_us_floor64(now - sensor_resumed);
+
+  suspend_devices(bus_devs, ARRAY_SIZE(bus_devs));
+  now = k_cycle_get_32();
+  stats.bus_active_us += k_cyc_to_us_floor64(now - bus_resumed);
+
+  stats.wakeups++;
+  if (stats.wakeups % CONFIG_APP_SENSOR_PM_STATS_INTERVAL == 0) {
+    log_stats();
+  }
+}
+
+void sensor_pm_get_stats(struct sensor_pm_stats *p_stats) {
+  *p_stats = stats;
+}
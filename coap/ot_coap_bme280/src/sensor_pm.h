@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SENSOR_PM_H_
+#define SENSOR_PM_H_
+
+#include <stdint.h>
+
+/* Time the sensors and their I2C buses were resumed since boot */
+struct sensor_pm_stats {
+  uint32_t wakeups;
+  uint64_t sensor_active_us;
+  uint64_t bus_active_us;
+};
+
+#if defined(CONFIG_APP_SENSOR_PM)
+/* Suspend all BME280 devices and their I2C buses until the first sample. */
+int sensor_pm_init(void);
+
+/*
+ * Resume the I2C buses, then the sensors, for a forced-mode measurement.
+ * Returns 0 on success or a negative error code of pm_device_action_run().
+ */
+int sensor_pm_resume(void);
+
+/* Suspend the sensors, then their I2C buses, after a measurement. */
+void sensor_pm_suspend(void);
+
+void sensor_pm_get_stats(struct sensor_pm_stats *stats);
+#else
+static inline int sensor_pm_init(void) { return 0; }
+static inline int sensor_pm_resume(void) { return 0; }
+static inline void sensor_pm_suspend(void) {}
+#endif
+
+#endif /* SENSOR_PM_H_ */
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "store.h"
+
+#include <errno.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+
+LOG_MODULE_DECLARE(ot_coap_bme280);
+
+#define STORE_PARTITION storage_partition
+
+/* NVS IDs of the metadata and of the first record slot */
+#define STORE_ID_BOOT 1
+#define STORE_ID_SENT 2
+#define STORE_ID_RECORD 16
+
+static struct nvs_fs fs;
+static uint32_t head;
+static uint32_t sent;
+/* Watermark as last written to flash */
+static uint32_t sent_written;
+static uint32_t boot;
+
+static uint16_t record_id(uint32_t seq) {
+  return STORE_ID_RECORD + seq % CONFIG_APP_STORE_SLOTS;
+}
+
+/*
+ * Find the head of the log from the sequence numbers in the records, or
+ * start at 0 with an empty log. Returns the number of records in the log.
+ */
+static uint32_t recover_head(void) {
+  struct store_record record;
+  uint32_t records = 0;
+
+  head = 0;
+  for (uint32_t slot = 0; slot < CONFIG_APP_STORE_SLOTS; slot++) {
+    if (nvs_read(&fs, STORE_ID_RECORD + slot, &record, sizeof(record)) !=
+        sizeof(record)) {
+      continue;
+    }
+    /* Serial number comparison, so the sequence number can wrap. */
+    if (records == 0 || (int32_t)(record.seq + 1 - head) > 0) {
+      head = record.seq + 1;
+    }
+    records++;
+  }
+
+  return records;
+}
+
+int store_init(void) {
+  struct flash_pages_info info;
+  uint32_t records;
+  int ret;
+
+  fs.flash_device = FIXED_PARTITION_DEVICE(STORE_PARTITION);
+  if (!device_is_ready(fs.flash_device)) {
+    LOG_ERR("Flash device %s is not ready", fs.flash_device->name);
+    return -ENODEV;
+  }
+
+  fs.offset = FIXED_PARTITION_OFFSET(STORE_PARTITION);
+  ret = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
+  if (ret < 0) {
+    LOG_ERR("Cannot get flash page info: %d", ret);
+    return ret;
+  }
+  fs.sector_size = info.size;
+  fs.sector_count = FIXED_PARTITION_SIZE(STORE_PARTITION) / info.size;
+
+  ret = nvs_mount(&fs);
+  if (ret < 0) {
+    LOG_ERR("Cannot mount NVS: %d", ret);
+    return ret;
+  }
+
+  records = recover_head();
+
+  /* Without a watermark, nothing in the log has been forwarded yet. */
+  if (nvs_read(&fs, STORE_ID_SENT, &sent, sizeof(sent)) != sizeof(sent)) {
+    sent = head - records;
+  }
+  sent_written = sent;
+  /* Records older than the log size have been overwritten. */
+  if ((int32_t)(head - sent) > CONFIG_APP_STORE_SLOTS) {
+    sent = head - CONFIG_APP_STORE_SLOTS;
+  } else if ((int32_t)(head - sent) < 0) {
+    sent = head;
+  }
+
+  if (nvs_read(&fs, STORE_ID_BOOT, &boot, sizeof(boot)) != sizeof(boot)) {
+    boot = 0;
+  }
+  boot++;
+  ret = nvs_write(&fs, STORE_ID_BOOT, &boot, sizeof(boot));
+  if (ret < 0) {
+    LOG_ERR("Cannot write boot count: %d", ret);
+    return ret;
+  }
+
+  LOG_INF("Sample log: boot %u, %u unsent samples, %zd bytes free", boot,
+          store_unsent_count(), nvs_calc_free_space(&fs));
+  return 0;
+}
+
+int store_append(const struct sensor_sample *p_sample) {
+  struct store_record record = {.seq = head, .boot = boot, .sample = *p_sample};
+  int ret;
+
+  ret = nvs_write(&fs, record_id(record.seq), &record, sizeof(record));
+  if (ret < 0) {
+    LOG_ERR("Cannot store sample %u: %d", record.seq, ret);
+    return ret;
+  }
+
+  head++;
+  /* The log is full: the oldest unsent record was overwritten. */
+  if (head - sent > CONFIG_APP_STORE_SLOTS) {
+    sent = head - CONFIG_APP_STORE_SLOTS;
+  }
+
+  return 0;
+}
+
+int store_read(uint32_t seq, struct store_record *p_record) {
+  ssize_t len;
+
+  if ((int32_t)(head - seq) <= 0 ||
+      (int32_t)(head - seq) > CONFIG_APP_STORE_SLOTS) {
+    return -ENOENT;
+  }
+
+  len = nvs_read(&fs, record_id(seq), p_record, sizeof(*p_record));
+  if (len != sizeof(*p_record)) {
+    return len < 0 ? len : -EIO;
+  }
+
+  /* The slot doesn't have the record anymore. */
+  if (p_record->seq != seq) {
+    return -ENOENT;
+  }
+
+  return 0;
+}
+
+uint32_t store_head(void) { return head; }
+
+uint32_t store_first(void) {
+  return head > CONFIG_APP_STORE_SLOTS ? head - CONFIG_APP_STORE_SLOTS : 0;
+}
+
+uint32_t store_unsent(void) { return sent; }
+
+uint32_t store_unsent_count(void) { return head - sent; }
+
+int store_mark_sent(uint32_t seq) {
+  int ret;
+
+  sent = seq;
+  ret = nvs_write(&fs, STORE_ID_SENT, &sent, sizeof(sent));
+  if (ret < 0) {
+    LOG_ERR("Cannot write sent watermark: %d", ret);
+    return ret;
+  }
+  sent_written = sent;
+
+  return 0;
+}
+
+int store_advance_sent(uint32_t seq) {
+  if (seq - sent_written >= CONFIG_APP_BATCH_SIZE) {
+    return store_mark_sent(seq);
+  }
+
+  sent = seq;
+  return 0;
+}
+
+uint32_t store_boot(void) { return boot; }
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef STORE_H_
+#define STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "report.h"
+
+/*
+ * Ring log of samples in the storage partition. Each record is written to
+ * one of CONFIG_APP_STORE_SLOTS NVS entries, chosen by its sequence number.
+ * The records from the "sent" watermark up to the head are still to be
+ * forwarded. If the log is full, a new record overwrites the oldest one.
+ */
+struct store_record {
+  uint32_t seq;
+  /* Boot count of the device when the sample was taken. */
+  uint32_t boot;
+  struct sensor_sample sample;
+};
+
+/* Mount the storage partition and recover the head and watermark. */
+int store_init(void);
+
+/* Append a sample to the log. */
+int store_append(const struct sensor_sample *p_sample);
+
+/* Read the record with the given sequence number. */
+int store_read(uint32_t seq, struct store_record *p_record);
+
+/* Sequence number of the next record. */
+uint32_t store_head(void);
+
+/* Sequence number of the oldest record in the log. */
+uint32_t store_first(void);
+
+/* Sequence number of the oldest record that hasn't been forwarded yet. */
+uint32_t store_unsent(void);
+
+/* Number of records that haven't been forwarded yet. */
+uint32_t store_unsent_count(void);
+
+/*
+ * Mark all records before seq as forwarded. The watermark is written to
+ * flash on each call, so call this once per forwarded batch.
+ */
+int store_mark_sent(uint32_t seq);
+
+/*
+ * Mark all records before seq as forwarded, but only write the watermark
+ * to flash once it's CONFIG_APP_BATCH_SIZE records ahead of the last
+ * written one. After a reboot, at most that many records are forwarded
+ * twice.
+ */
+int store_advance_sent(uint32_t seq);
+
+/* Boot count of the device, incremented by store_init(). */
+uint32_t store_boot(void);
+
+#endif /* STORE_H_ */
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Compare the integer formatting of the reports with the %.2f formatting of
+ * doubles that it replaced, over every value the BME280 driver can return,
+ * and measure both on the host.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include "centi.h"
+
+#define FORMAT_SIZE 16
+#define BENCHMARK_VALUES 1000000
+
+/* Ranges of the BME280 in 0.01 °C, Pa and 0.01 % */
+#define TEMP_MIN (-4000)
+#define TEMP_MAX 8500
+#define PRESS_MIN 30000
+#define PRESS_MAX 110000
+#define HUM_MAX 10000
+
+/*
+ * Values exactly halfway between two hundredths that the BME280 driver can
+ * return, and how many of those %.2f rounds the other way
+ */
+#define PRESS_HALFWAY 80000
+#define PRESS_HALFWAY_UNLIKE_DOUBLE 40000
+#define HUM_HALFWAY 40000
+#define HUM_HALFWAY_UNLIKE_DOUBLE 20000
+
+/* The same for the values from -2.999999 to 2.999999 */
+#define ZERO_HALFWAY 600
+#define ZERO_HALFWAY_UNLIKE_DOUBLE 302
+
+struct sensor_value {
+  int32_t val1;
+  int32_t val2;
+};
+
+/* Values halfway between two hundredths, and the ones unlike %.2f */
+struct halfway_count {
+  uint32_t values;
+  uint32_t unlike_double;
+};
+
+/* Conversions of the BME280 driver from its compensated values */
+static struct sensor_value temp_value(int32_t comp_temp) {
+  return (struct sensor_value){comp_temp / 100, comp_temp % 100 * 10000};
+}
+
+static struct sensor_value press_value(uint32_t comp_press) {
+  return (struct sensor_value){
+      (comp_press >> 8) / 1000U,
+      (comp_press >> 8) % 1000 * 1000U + (((comp_press & 0xff) * 1000U) >> 8)};
+}
+
+static struct sensor_value hum_value(uint32_t comp_humidity) {
+  return (struct sensor_value){
+      comp_humidity >> 10, ((comp_humidity & 0x3ff) * 1000U * 1000U) >> 10};
+}
+
+static void format_centi(char *buf, const struct sensor_value *value,
+                         int32_t divisor) {
+  int32_t centi = centi_scale(value->val1, value->val2, divisor);
+
+  snprintf(buf, FORMAT_SIZE, CENTI_FMT,
+           CENTI_SIGN_ARGS(centi, value->val1 < 0 || value->val2 < 0));
+}
+
+static void format_double(char *buf, double value) {
+  snprintf(buf, FORMAT_SIZE, "%.2f", value);
+}
+
+/*
+ * Check that a sensor value is formatted like %.2f formats the double the
+ * reports used to print.
+ *
+ * A value exactly halfway between two hundredths is the exception: it is
+ * always rounded away from zero, where %.2f rounds the nearest double,
+ * which is on either side of the halfway point. Those values are checked
+ * against the rounding away from zero instead, and counted, with the ones
+ * that %.2f formats differently.
+ */
+static void check_value(const struct sensor_value *value, int32_t divisor,
+                        double number, struct halfway_count *p_halfway) {
+  char centi[FORMAT_SIZE];
+  char expected[FORMAT_SIZE];
+  int64_t millionths = llabs(value->val1 * 1000000LL + value->val2);
+
+  format_centi(centi, value, divisor);
+  format_double(expected, number);
+
+  if (millionths % divisor != divisor / 2) {
+    zassert_true(strcmp(centi, expected) == 0, "%d.%06d: %s instead of %s",
+                 value->val1, abs(value->val2), centi, expected);
+    return;
+  }
+
+  zassert_equal(abs(centi_scale(value->val1, value->val2, divisor)),
+                millionths / divisor + 1, "%d.%06d: %s", value->val1,
+                abs(value->val2), centi);
+  p_halfway->values++;
+  if (strcmp(centi, expected) != 0) {
+    p_halfway->unlike_double++;
+  }
+}
+
+ZTEST(centi, test_temperature_range) {
+  struct halfway_count halfway = {0};
+
+  for (int32_t comp = TEMP_MIN; comp <= TEMP_MAX; comp++) {
+    struct sensor_value value = temp_value(comp);
+
+    check_value(&value, 10000, value.val1 + value.val2 / 1000000.0, &halfway);
+  }
+
+  /* The driver returns whole hundredths. */
+  zassert_equal(halfway.values, 0);
+}
+
+ZTEST(centi, test_pressure_range) {
+  struct halfway_count halfway = {0};
+
+  for (uint32_t comp = PRESS_MIN << 8; comp <= PRESS_MAX << 8; comp++) {
+    struct sensor_value value = press_value(comp);
+
+    /* The reports are in hPa, the sensor value in kPa. */
+    check_value(&value, 1000, value.val1 * 10.0 + value.val2 / 100000.0,
+                &halfway);
+  }
+
+  zassert_equal(halfway.values, PRESS_HALFWAY);
+  zassert_equal(halfway.unlike_double, PRESS_HALFWAY_UNLIKE_DOUBLE);
+}
+
+ZTEST(centi, test_humidity_range) {
+  struct halfway_count halfway = {0};
+
+  for (uint32_t comp = 0; comp <= HUM_MAX << 10; comp++) {
+    struct sensor_value value = hum_value(comp);
+
+    check_value(&value, 10000, value.val1 + value.val2 / 1000000.0, &halfway);
+  }
+
+  zassert_equal(halfway.values, HUM_HALFWAY);
+  zassert_equal(halfway.unlike_double, HUM_HALFWAY_UNLIKE_DOUBLE);
+}
+
+/* Every sensor value from -2.999999 to 2.999999 */
+ZTEST(centi, test_sign_around_zero) {
+  struct halfway_count halfway = {0};
+  char centi[FORMAT_SIZE];
+
+  for (int32_t val1 = -2; val1 <= 2; val1++) {
+    for (int32_t val2 = val1 > 0 ? 0 : -999999; val2 <= (val1 < 0 ? 0 : 999999);
+         val2++) {
+      struct sensor_value value = {val1, val2};
+
+      check_value(&value, 10000, val1 + val2 / 1000000.0, &halfway);
+    }
+  }
+  zassert_equal(halfway.values, ZERO_HALFWAY);
+  zassert_equal(halfway.unlike_double, ZERO_HALFWAY_UNLIKE_DOUBLE);
+
+  format_centi(centi, &(struct sensor_value){0, -4999}, 10000);
+  zassert_true(strcmp(centi, "-0.00") == 0, "%s", centi);
+}
+
+/*
+ * The accepted behaviour for values halfway between two hundredths: they
+ * are rounded away from zero, and %.2f rounds them either way.
+ */
+ZTEST(centi, test_halfway) {
+  static const struct {
+    struct sensor_value value;
+    int32_t divisor;
+    const char *p_centi;
+    const char *p_double;
+  } cases[] = {
+      {{101, 325500}, 1000, "1013.26", "1013.25"},
+      {{45, 125000}, 10000, "45.13", "45.12"},
+      {{45, 145000}, 10000, "45.15", "45.15"},
+      {{0, -15000}, 10000, "-0.02", "-0.01"},
+  };
+  char centi[FORMAT_SIZE];
+  char expected[FORMAT_SIZE];
+
+  for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+    double scale = cases[i].divisor == 1000 ? 10.0 : 1.0;
+
+    format_centi(centi, &cases[i].value, cases[i].divisor);
+    format_double(expected, cases[i].value.val1 * scale +
+                                cases[i].value.val2 * scale / 1000000.0);
+    zassert_true(strcmp(centi, cases[i].p_centi) == 0, "%s", centi);
+    zassert_true(strcmp(expected, cases[i].p_double) == 0, "%s", expected);
+  }
+}
+
+/* Temperature number i of the benchmark, cycling through the range */
+static struct sensor_value benchmark_value(int32_t i) {
+  return temp_value(TEMP_MIN + i % (TEMP_MAX - TEMP_MIN + 1));
+}
+
+static double ns_per_value(const struct timespec *start,
+                           const struct timespec *end) {
+  return ((end->tv_sec - start->tv_sec) * 1e9 +
+          (end->tv_nsec - start->tv_nsec)) /
+         BENCHMARK_VALUES;
+}
+
+/*
+ * Format the same temperatures both ways. On the device the difference is
+ * larger, because there is no FPU context or soft-float printf to pay for
+ * with the integer formatting; CONFIG_APP_PUBLISH_CYCLES measures that.
+ */
+ZTEST(centi, test_benchmark) {
+  char buf[FORMAT_SIZE];
+  volatile size_t sink = 0;
+  struct timespec start, end;
+  double ns_double, ns_centi;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int32_t i = 0; i < BENCHMARK_VALUES; i++) {
+    struct sensor_value value = benchmark_value(i);
+
+    format_double(buf, value.val1 + value.val2 / 1000000.0);
+    sink += strlen(buf);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ns_double = ns_per_value(&start, &end);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int32_t i = 0; i < BENCHMARK_VALUES; i++) {
+    struct sensor_value value = benchmark_value(i);
+
+    format_centi(buf, &value, 10000);
+    sink += strlen(buf);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ns_centi = ns_per_value(&start, &end);
+
+  TC_PRINT("%%.2f: %.1f ns per value, integer: %.1f ns per value\n",
+           ns_double, ns_centi);
+  zassert_true(sink > 0);
+}
+
+ZTEST_SUITE(centi, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Check the integer statistics of the aggregated reports against exact
+ * references, also over windows far longer than a report window.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <zephyr/ztest.h>
+
+#include "channel_stats.h"
+
+#define RANDOM_WINDOWS 100000
+#define RANDOM_WINDOW_MAX 64
+#define LONG_WINDOW (1U << 24)
+#define LIMIT_WINDOW (1U << 28)
+
+/* Ranges of the BME280 in 0.01 °C, Pa and 0.01 % */
+#define TEMP_MIN (-4000)
+#define PRESS_MIN 30000
+#define PRESS_MAX 110000
+
+static uint32_t random_state = 1;
+
+/* Deterministic pseudo-random numbers, so a failure can be reproduced */
+static uint32_t random_next(void) {
+  random_state = random_state * 1664525U + 1013904223U;
+  return random_state >> 8;
+}
+
+static void add_all(struct channel_stats *stats, const int32_t *values,
+                    uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    channel_stats_add(stats, i + 1, values[i]);
+  }
+}
+
+/*
+ * Whether stddev is the sample standard deviation of the values rounded to
+ * the nearest integer: (stddev - 0.5)^2 <= variance < (stddev + 0.5)^2,
+ * multiplied by 4 * count * (count - 1) to stay in integers. A variance
+ * exactly halfway rounds up.
+ */
+static bool is_rounded_stddev(const int32_t *values, uint32_t count,
+                              int64_t stddev) {
+  int64_t sum = 0;
+  int64_t sum_sq = 0;
+  int64_t squares;
+  int64_t scale = (int64_t)count * (count - 1);
+
+  for (uint32_t i = 0; i < count; i++) {
+    sum += values[i];
+    sum_sq += (int64_t)values[i] * values[i];
+  }
+  squares = 4 * (count * sum_sq - sum * sum);
+
+  return (stddev == 0 ||
+          (2 * stddev - 1) * (2 * stddev - 1) * scale <= squares) &&
+         squares < (2 * stddev + 1) * (2 * stddev + 1) * scale;
+}
+
+ZTEST(channel_stats, test_single_sample) {
+  struct channel_stats stats;
+
+  channel_stats_add(&stats, 1, -1234);
+  zassert_equal(stats.min, -1234);
+  zassert_equal(stats.max, -1234);
+  zassert_equal(channel_stats_mean(&stats, 1), -1234);
+  zassert_equal(channel_stats_stddev(&stats, 1), 0);
+}
+
+ZTEST(channel_stats, test_known_values) {
+  const int32_t values[] = {2, 4, 4, 4, 5, 5, 7, 9};
+  struct channel_stats stats;
+
+  add_all(&stats, values, ARRAY_SIZE(values));
+  zassert_equal(stats.min, 2);
+  zassert_equal(stats.max, 9);
+  zassert_equal(channel_stats_mean(&stats, ARRAY_SIZE(values)), 5);
+  /* The sample variance is 32 / 7, so the standard deviation 2.14. */
+  zassert_equal(channel_stats_stddev(&stats, ARRAY_SIZE(values)), 2);
+}
+
+ZTEST(channel_stats, test_mean_rounds_half_away_from_zero) {
+  const int32_t positive[] = {1, 2};
+  const int32_t negative[] = {-3, -2};
+  const int32_t around_zero[] = {-1, 0};
+  struct channel_stats stats;
+
+  add_all(&stats, positive, 2);
+  zassert_equal(channel_stats_mean(&stats, 2), 2);
+  add_all(&stats, negative, 2);
+  zassert_equal(channel_stats_mean(&stats, 2), -3);
+  add_all(&stats, around_zero, 2);
+  zassert_equal(channel_stats_mean(&stats, 2), -1);
+}
+
+/* Short windows of random values in the ranges of all channels */
+ZTEST(channel_stats, test_random_windows) {
+  int32_t values[RANDOM_WINDOW_MAX];
+  struct channel_stats stats;
+
+  for (uint32_t window = 0; window < RANDOM_WINDOWS; window++) {
+    uint32_t count = 2 + random_next() % (RANDOM_WINDOW_MAX - 1);
+    /* Spread from a few units to the whole range of the channel */
+    uint32_t spread = 1 + random_next() % (1U << (random_next() % 17));
+    int32_t base = TEMP_MIN + random_next() % (PRESS_MAX - TEMP_MIN);
+    int64_t sum = 0;
+    int32_t mean;
+
+    for (uint32_t i = 0; i < count; i++) {
+      values[i] = base + random_next() % spread;
+      sum += values[i];
+    }
+    add_all(&stats, values, count);
+
+    mean = channel_stats_mean(&stats, count);
+    zassert_true(llabs(2 * (mean * (int64_t)count - sum)) <= count,
+                 "mean %d of %u values with sum %lld", mean, count,
+                 (long long)sum);
+    zassert_true(is_rounded_stddev(values, count,
+                                   channel_stats_stddev(&stats, count)),
+                 "stddev %d of %u values from %d",
+                 channel_stats_stddev(&stats, count), count, stats.first);
+  }
+}
+
+/*
+ * A pressure that alternates between two values next to each other has a
+ * standard deviation just above 0.5, which must still round up after 2^24
+ * samples. A float sum of squares of the readings can't even tell them
+ * apart at this magnitude.
+ */
+ZTEST(channel_stats, test_long_window_of_small_changes) {
+  struct channel_stats stats;
+
+  for (uint32_t i = 0; i < LONG_WINDOW - 1; i++) {
+    channel_stats_add(&stats, i + 1, PRESS_MAX - 1 + i % 2);
+  }
+  zassert_equal(channel_stats_mean(&stats, LONG_WINDOW - 1), PRESS_MAX - 1);
+  zassert_equal(channel_stats_stddev(&stats, LONG_WINDOW - 1), 1);
+}
+
+/* Temperature number i of a window that drifts by 5 °C, with noise */
+static int32_t drift_value(uint32_t i) {
+  return 2000 + i / (LONG_WINDOW / 500) + (int32_t)(random_next() % 41) - 20;
+}
+
+/*
+ * Compare a slowly drifting, noisy temperature over 2^24 samples with a
+ * two-pass long double reference.
+ */
+ZTEST(channel_stats, test_long_window_drift) {
+  struct channel_stats stats;
+  int64_t sum = 0;
+  long double mean;
+  long double squares = 0;
+  int32_t value;
+
+  random_state = 1;
+  for (uint32_t i = 0; i < LONG_WINDOW; i++) {
+    value = drift_value(i);
+    channel_stats_add(&stats, i + 1, value);
+    sum += value;
+  }
+  mean = (long double)sum / LONG_WINDOW;
+
+  random_state = 1;
+  for (uint32_t i = 0; i < LONG_WINDOW; i++) {
+    value = drift_value(i);
+    squares += (value - mean) * (value - mean);
+  }
+
+  zassert_equal(channel_stats_mean(&stats, LONG_WINDOW), llroundl(mean));
+  zassert_equal(channel_stats_stddev(&stats, LONG_WINDOW),
+                llroundl(sqrtl(squares / (LONG_WINDOW - 1))));
+}
+
+/*
+ * The largest documented window, with every sample but the first at the
+ * other end of the pressure range: the sums must not overflow.
+ */
+ZTEST(channel_stats, test_limit_window) {
+  struct channel_stats stats;
+  long double mean = PRESS_MAX - (long double)(PRESS_MAX - PRESS_MIN) /
+                                     LIMIT_WINDOW;
+  long double squares;
+
+  channel_stats_add(&stats, 1, PRESS_MIN);
+  for (uint32_t i = 1; i < LIMIT_WINDOW; i++) {
+    channel_stats_add(&stats, i + 1, PRESS_MAX);
+  }
+  squares = (PRESS_MIN - mean) * (PRESS_MIN - mean) +
+            (LIMIT_WINDOW - 1) * (PRESS_MAX - mean) * (PRESS_MAX - mean);
+
+  zassert_equal(channel_stats_mean(&stats, LIMIT_WINDOW), PRESS_MAX);
+  zassert_equal(channel_stats_stddev(&stats, LIMIT_WINDOW),
+                llroundl(sqrtl(squares / (LIMIT_WINDOW - 1))));
+}
+
+ZTEST_SUITE(channel_stats, NULL, NULL, NULL, NULL, NULL);
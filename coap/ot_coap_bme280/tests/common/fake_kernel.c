@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fake_kernel.h"
+
+/* Pending work items in submission order, linked like in Zephyr */
+static struct k_work *p_first;
+static struct k_work *p_last;
+
+void fake_kernel_reset(void) {
+  while (p_first != NULL) {
+    p_first->pending = false;
+    p_first = p_first->p_next;
+  }
+  p_last = NULL;
+}
+
+size_t fake_work_run(void) {
+  size_t ran = 0;
+
+  while (p_first != NULL) {
+    struct k_work *p_work = p_first;
+
+    p_first = p_work->p_next;
+    if (p_first == NULL) {
+      p_last = NULL;
+    }
+    p_work->pending = false;
+    p_work->handler(p_work);
+    ran++;
+  }
+  return ran;
+}
+
+void k_work_queue_start(struct k_work_q *queue, k_thread_stack_t *stack,
+                        size_t stack_size, int prio,
+                        const struct k_work_queue_config *cfg) {
+  queue->name = cfg != NULL ? cfg->name : NULL;
+}
+
+/* Returns 1 if the work item is queued, or 0 if it was queued already. */
+int k_work_submit(struct k_work *work) {
+  if (work->pending) {
+    return 0;
+  }
+
+  work->pending = true;
+  work->p_next = NULL;
+  if (p_last != NULL) {
+    p_last->p_next = work;
+  } else {
+    p_first = work;
+  }
+  p_last = work;
+  return 1;
+}
+
+int k_work_submit_to_queue(struct k_work_q *queue, struct k_work *work) {
+  return k_work_submit(work);
+}
+
+/* Like in Zephyr, a work item that is scheduled already keeps its delay. */
+int k_work_schedule(struct k_work_delayable *dwork, k_timeout_t delay) {
+  if (dwork->work.pending) {
+    return 0;
+  }
+
+  dwork->delay = delay;
+  return k_work_submit(&dwork->work);
+}
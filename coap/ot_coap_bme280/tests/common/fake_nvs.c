@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fake_nvs.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/sys/util.h>
+
+struct fake_entry {
+  bool used;
+  uint16_t id;
+  size_t len;
+  uint8_t data[FAKE_NVS_ENTRY_SIZE];
+};
+
+const struct device fake_flash_device = {.name = "fake_flash"};
+size_t fake_nvs_writes;
+
+static struct fake_entry entries[FAKE_NVS_ENTRIES];
+
+void fake_nvs_reset(void) {
+  memset(entries, 0, sizeof(entries));
+  fake_nvs_writes = 0;
+}
+
+bool device_is_ready(const struct device *dev) {
+  return dev == &fake_flash_device;
+}
+
+int flash_get_page_info_by_offs(const struct device *dev, off_t offset,
+                                struct flash_pages_info *info) {
+  if (offset < 0 || offset >= FAKE_NVS_SECTORS * FAKE_NVS_SECTOR_SIZE) {
+    return -EINVAL;
+  }
+
+  info->start_offset = offset - offset % FAKE_NVS_SECTOR_SIZE;
+  info->size = FAKE_NVS_SECTOR_SIZE;
+  info->index = offset / FAKE_NVS_SECTOR_SIZE;
+  return 0;
+}
+
+int nvs_mount(struct nvs_fs *fs) {
+  if (fs->flash_device != &fake_flash_device || fs->sector_count < 2 ||
+      fs->sector_size != FAKE_NVS_SECTOR_SIZE) {
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+static struct fake_entry *find_entry(uint16_t id) {
+  for (size_t i = 0; i < ARRAY_SIZE(entries); i++) {
+    if (entries[i].used && entries[i].id == id) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+/* Like NVS, this returns the length of the entry, even if it's longer. */
+ssize_t nvs_read(struct nvs_fs *fs, uint16_t id, void *data, size_t len) {
+  struct fake_entry *p_entry = find_entry(id);
+
+  if (p_entry == NULL) {
+    return -ENOENT;
+  }
+
+  memcpy(data, p_entry->data, MIN(len, p_entry->len));
+  return p_entry->len;
+}
+
+ssize_t nvs_write(struct nvs_fs *fs, uint16_t id, const void *data,
+                  size_t len) {
+  struct fake_entry *p_entry = find_entry(id);
+
+  if (len > FAKE_NVS_ENTRY_SIZE) {
+    return -EINVAL;
+  }
+
+  for (size_t i = 0; p_entry == NULL && i < ARRAY_SIZE(entries); i++) {
+    if (!entries[i].used) {
+      p_entry = &entries[i];
+    }
+  }
+  if (p_entry == NULL) {
+    return -ENOSPC;
+  }
+
+  p_entry->used = true;
+  p_entry->id = id;
+  p_entry->len = len;
+  memcpy(p_entry->data, data, len);
+  fake_nvs_writes++;
+  return len;
+}
+
+ssize_t nvs_calc_free_space(struct nvs_fs *fs) {
+  ssize_t free = FAKE_NVS_SECTORS * FAKE_NVS_SECTOR_SIZE;
+
+  for (size_t i = 0; i < ARRAY_SIZE(entries); i++) {
+    if (entries[i].used) {
+      free -= entries[i].len;
+    }
+  }
+  return free;
+}
@@ -0,0 +1,524 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fake_openthread.h"
+
+#include <arpa/inet.h>
+#include <openthread/link.h>
+#include <openthread/platform/radio.h>
+#include <openthread/random_noncrypto.h>
+#include <openthread/thread.h>
+#include <openthread/udp.h>
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/net/openthread.h>
+
+#define FAKE_RESOURCES 8
+
+struct fake_sent fake_sent[FAKE_SENT_MAX];
+size_t fake_sent_count;
+bool fake_no_bufs;
+int fake_api_mutex_depth;
+
+static otMessage messages[FAKE_MESSAGES];
+static otCoapResource *resources[FAKE_RESOURCES];
+static size_t resource_count;
+static uint16_t next_message_id = 1;
+static uint32_t random_state = 1;
+
+void fake_openthread_reset(void) {
+  memset(messages, 0, sizeof(messages));
+  memset(fake_sent, 0, sizeof(fake_sent));
+  fake_sent_count = 0;
+  fake_no_bufs = false;
+  fake_api_mutex_depth = 0;
+  resource_count = 0;
+}
+
+struct otInstance *openthread_get_default_instance(void) {
+  static int instance;
+
+  return (struct otInstance *)&instance;
+}
+
+struct openthread_context *openthread_get_default_context(void) {
+  static int context;
+
+  return (struct openthread_context *)&context;
+}
+
+void openthread_api_mutex_lock(struct openthread_context *ot_context) {
+  fake_api_mutex_depth++;
+}
+
+void openthread_api_mutex_unlock(struct openthread_context *ot_context) {
+  fake_api_mutex_depth--;
+}
+
+const char *otThreadErrorToString(otError aError) { return "error"; }
+
+otDeviceRole otThreadGetDeviceRole(otInstance *aInstance) {
+  return OT_DEVICE_ROLE_CHILD;
+}
+
+void otPlatRadioGetIeeeEui64(otInstance *aInstance, uint8_t *aIeeeEui64) {
+  for (size_t i = 0; i < OT_EXT_ADDRESS_SIZE; i++) {
+    aIeeeEui64[i] = 0xf0 + i;
+  }
+}
+
+uint32_t otRandomNonCryptoGetUint32(void) {
+  random_state = random_state * 1103515245 + 12345;
+  return random_state;
+}
+
+uint16_t otRandomNonCryptoGetUint16(void) {
+  return otRandomNonCryptoGetUint32() >> 16;
+}
+
+otError otLinkSendDataRequest(otInstance *aInstance) { return OT_ERROR_NONE; }
+
+otMessage *otCoapNewMessage(otInstance *aInstance,
+                            const otMessageSettings *aSettings) {
+  if (fake_no_bufs) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < FAKE_MESSAGES; i++) {
+    if (!messages[i].used) {
+      memset(&messages[i], 0, sizeof(messages[i]));
+      messages[i].used = true;
+      return &messages[i];
+    }
+  }
+
+  return NULL;
+}
+
+void otMessageFree(otMessage *aMessage) { aMessage->used = false; }
+
+void otCoapMessageInit(otMessage *aMessage, otCoapType aType,
+                       otCoapCode aCode) {
+  aMessage->type = aType;
+  aMessage->code = aCode;
+  aMessage->token_len = 0;
+  aMessage->option_count = 0;
+  aMessage->payload_marker = false;
+  aMessage->payload_len = 0;
+}
+
+otError otCoapMessageInitResponse(otMessage *aResponse,
+                                  const otMessage *aRequest, otCoapType aType,
+                                  otCoapCode aCode) {
+  otCoapMessageInit(aResponse, aType, aCode);
+  aResponse->message_id = aRequest->message_id;
+  return otCoapMessageSetToken(aResponse, aRequest->token,
+                               aRequest->token_len);
+}
+
+otError otCoapMessageSetToken(otMessage *aMessage, const uint8_t *aToken,
+                              uint8_t aTokenLength) {
+  if (aTokenLength > OT_COAP_MAX_TOKEN_LENGTH) {
+    return OT_ERROR_INVALID_ARGS;
+  }
+
+  memcpy(aMessage->token, aToken, aTokenLength);
+  aMessage->token_len = aTokenLength;
+  return OT_ERROR_NONE;
+}
+
+uint8_t otCoapMessageGetTokenLength(const otMessage *aMessage) {
+  return aMessage->token_len;
+}
+
+const uint8_t *otCoapMessageGetToken(const otMessage *aMessage) {
+  return aMessage->token;
+}
+
+otCoapType otCoapMessageGetType(const otMessage *aMessage) {
+  return aMessage->type;
+}
+
+otCoapCode otCoapMessageGetCode(const otMessage *aMessage) {
+  return aMessage->code;
+}
+
+uint16_t otCoapMessageGetMessageId(const otMessage *aMessage) {
+  return aMessage->message_id;
+}
+
+const char *otCoapMessageCodeToString(const otMessage *aMessage) {
+  return "code";
+}
+
+/* Options must be appended in order of their numbers, like in OpenThread. */
+otError otCoapMessageAppendOption(otMessage *aMessage, uint16_t aNumber,
+                                  uint16_t aLength, const void *aValue) {
+  struct fake_option *p_option;
+
+  if (aMessage->payload_marker || aMessage->option_count == FAKE_OPTIONS ||
+      aLength > FAKE_OPTION_SIZE ||
+      (aMessage->option_count > 0 &&
+       aMessage->options[aMessage->option_count - 1].number > aNumber)) {
+    return OT_ERROR_INVALID_ARGS;
+  }
+
+  p_option = &aMessage->options[aMessage->option_count++];
+  p_option->number = aNumber;
+  p_option->length = aLength;
+  memcpy(p_option->value, aValue, aLength);
+  return OT_ERROR_NONE;
+}
+
+otError otCoapMessageAppendUintOption(otMessage *aMessage, uint16_t aNumber,
+                                      uint32_t aValue) {
+  uint8_t value[sizeof(aValue)];
+  uint16_t length = 0;
+
+  /* The shortest big-endian encoding, with no bytes for 0 */
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    if (length > 0 || (aValue >> shift) != 0) {
+      value[length++] = aValue >> shift;
+    }
+  }
+
+  return otCoapMessageAppendOption(aMessage, aNumber, length, value);
+}
+
+otError otCoapMessageAppendObserveOption(otMessage *aMessage,
+                                         uint32_t aObserve) {
+  return otCoapMessageAppendUintOption(aMessage, OT_COAP_OPTION_OBSERVE,
+                                       aObserve & 0xffffff);
+}
+
+otError otCoapMessageAppendUriPathOptions(otMessage *aMessage,
+                                          const char *aUriPath) {
+  const char *p_segment = aUriPath;
+  otError error = OT_ERROR_NONE;
+
+  while (error == OT_ERROR_NONE && *p_segment != '\0') {
+    const char *p_end = strchr(p_segment, '/');
+    size_t length = p_end != NULL ? (size_t)(p_end - p_segment)
+                                  : strlen(p_segment);
+
+    error = otCoapMessageAppendOption(aMessage, OT_COAP_OPTION_URI_PATH,
+                                      length, p_segment);
+    p_segment += length + (p_end != NULL);
+  }
+
+  return error;
+}
+
+otError otCoapMessageAppendContentFormatOption(
+    otMessage *aMessage, otCoapOptionContentFormat aContentFormat) {
+  return otCoapMessageAppendUintOption(
+      aMessage, OT_COAP_OPTION_CONTENT_FORMAT, aContentFormat);
+}
+
+otError otCoapMessageAppendBlock2Option(otMessage *aMessage, uint32_t aNum,
+                                        bool aMore, otCoapBlockSzx aSize) {
+  return otCoapMessageAppendUintOption(aMessage, OT_COAP_OPTION_BLOCK2,
+                                       aNum << 4 | aMore << 3 | aSize);
+}
+
+otError otCoapMessageSetPayloadMarker(otMessage *aMessage) {
+  aMessage->payload_marker = true;
+  return OT_ERROR_NONE;
+}
+
+otError otMessageAppend(otMessage *aMessage, const void *aBuf,
+                        uint16_t aLength) {
+  if (aMessage->payload_len + aLength > FAKE_PAYLOAD_SIZE) {
+    return OT_ERROR_NO_BUFS;
+  }
+
+  memcpy(&aMessage->payload[aMessage->payload_len], aBuf, aLength);
+  aMessage->payload_len += aLength;
+  return OT_ERROR_NONE;
+}
+
+/* A received message starts at its payload. */
+uint16_t otMessageGetLength(const otMessage *aMessage) {
+  return aMessage->payload_len;
+}
+
+uint16_t otMessageGetOffset(const otMessage *aMessage) { return 0; }
+
+uint16_t otMessageRead(const otMessage *aMessage, uint16_t aOffset, void *aBuf,
+                       uint16_t aLength) {
+  if (aOffset >= aMessage->payload_len) {
+    return 0;
+  }
+  if (aLength > aMessage->payload_len - aOffset) {
+    aLength = aMessage->payload_len - aOffset;
+  }
+
+  memcpy(aBuf, &aMessage->payload[aOffset], aLength);
+  return aLength;
+}
+
+int8_t otMessageGetRss(const otMessage *aMessage) { return aMessage->rss; }
+
+otError otCoapOptionIteratorInit(otCoapOptionIterator *aIterator,
+                                 const otMessage *aMessage) {
+  aIterator->mMessage = aMessage;
+  aIterator->mIndex = 0;
+  return OT_ERROR_NONE;
+}
+
+static const otCoapOption *find_option(otCoapOptionIterator *aIterator,
+                                       uint16_t aOption, uint16_t aFrom) {
+  const otMessage *p_message = aIterator->mMessage;
+
+  for (uint16_t i = aFrom; i < p_message->option_count; i++) {
+    if (p_message->options[i].number == aOption) {
+      aIterator->mIndex = i;
+      aIterator->mOption.mNumber = aOption;
+      aIterator->mOption.mLength = p_message->options[i].length;
+      return &aIterator->mOption;
+    }
+  }
+
+  aIterator->mIndex = p_message->option_count;
+  return NULL;
+}
+
+const otCoapOption *
+otCoapOptionIteratorGetFirstOptionMatching(otCoapOptionIterator *aIterator,
+                                           uint16_t aOption) {
+  return find_option(aIterator, aOption, 0);
+}
+
+const otCoapOption *
+otCoapOptionIteratorGetNextOptionMatching(otCoapOptionIterator *aIterator,
+                                          uint16_t aOption) {
+  return find_option(aIterator, aOption, aIterator->mIndex + 1);
+}
+
+otError otCoapOptionIteratorGetOptionUintValue(otCoapOptionIterator *aIterator,
+                                               uint64_t *aValue) {
+  const struct fake_option *p_option;
+
+  if (aIterator->mIndex >= aIterator->mMessage->option_count) {
+    return OT_ERROR_NOT_FOUND;
+  }
+
+  p_option = &aIterator->mMessage->options[aIterator->mIndex];
+  *aValue = 0;
+  for (uint16_t i = 0; i < p_option->length; i++) {
+    *aValue = *aValue << 8 | p_option->value[i];
+  }
+  return OT_ERROR_NONE;
+}
+
+otError otCoapOptionIteratorGetOptionValue(otCoapOptionIterator *aIterator,
+                                           void *aValue) {
+  const struct fake_option *p_option;
+
+  if (aIterator->mIndex >= aIterator->mMessage->option_count) {
+    return OT_ERROR_NOT_FOUND;
+  }
+
+  p_option = &aIterator->mMessage->options[aIterator->mIndex];
+  memcpy(aValue, p_option->value, p_option->length);
+  return OT_ERROR_NONE;
+}
+
+static otError send_message(otMessage *aMessage,
+                            const otMessageInfo *aMessageInfo, bool response,
+                            otCoapResponseHandler aHandler, void *aContext) {
+  if (fake_sent_count == FAKE_SENT_MAX) {
+    return OT_ERROR_NO_BUFS;
+  }
+
+  fake_sent[fake_sent_count++] = (struct fake_sent){
+      .p_message = aMessage,
+      .info = *aMessageInfo,
+      .response = response,
+      .handler = aHandler,
+      .context = aContext,
+  };
+  return OT_ERROR_NONE;
+}
+
+otError otCoapSendRequest(otInstance *aInstance, otMessage *aMessage,
+                          const otMessageInfo *aMessageInfo,
+                          otCoapResponseHandler aHandler, void *aContext) {
+  aMessage->message_id = next_message_id++;
+  return send_message(aMessage, aMessageInfo, false, aHandler, aContext);
+}
+
+otError otCoapSendResponse(otInstance *aInstance, otMessage *aMessage,
+                           const otMessageInfo *aMessageInfo) {
+  return send_message(aMessage, aMessageInfo, true, NULL, NULL);
+}
+
+void otCoapAddResource(otInstance *aInstance, otCoapResource *aResource) {
+  if (resource_count < FAKE_RESOURCES) {
+    resources[resource_count++] = aResource;
+  }
+}
+
+otError otCoapStart(otInstance *aInstance, uint16_t aPort) {
+  return OT_ERROR_NONE;
+}
+
+otError otUdpOpen(otInstance *aInstance, otUdpSocket *aSocket,
+                  otUdpReceive aCallback, void *aContext) {
+  aSocket->mHandler = aCallback;
+  aSocket->mContext = aContext;
+  return OT_ERROR_NONE;
+}
+
+otMessage *otUdpNewMessage(otInstance *aInstance,
+                           const otMessageSettings *aSettings) {
+  return otCoapNewMessage(aInstance, aSettings);
+}
+
+otError otUdpSend(otInstance *aInstance, otUdpSocket *aSocket,
+                  otMessage *aMessage, const otMessageInfo *aMessageInfo) {
+  return send_message(aMessage, aMessageInfo, false, NULL, NULL);
+}
+
+otError otIp6AddressFromString(const char *aString, otIp6Address *aAddress) {
+  return inet_pton(AF_INET6, aString, aAddress->mFields.m8) == 1
+             ? OT_ERROR_NONE
+             : OT_ERROR_INVALID_ARGS;
+}
+
+bool otIp6IsAddressEqual(const otIp6Address *aFirst,
+                         const otIp6Address *aSecond) {
+  return memcmp(aFirst, aSecond, sizeof(*aFirst)) == 0;
+}
+
+void otIp6AddressToString(const otIp6Address *aAddress, char *aBuffer,
+                          uint16_t aSize) {
+  snprintf(aBuffer, aSize, "fd00::%x", aAddress->mFields.m8[15]);
+}
+
+otMessage *fake_request(otCoapType type, otCoapCode code,
+                        const uint8_t *p_token, uint8_t token_len) {
+  otMessage *p_message = otCoapNewMessage(NULL, NULL);
+
+  otCoapMessageInit(p_message, type, code);
+  p_message->message_id = next_message_id++;
+  otCoapMessageSetToken(p_message, p_token, token_len);
+  return p_message;
+}
+
+otMessageInfo fake_peer(uint8_t peer) {
+  otMessageInfo info = {.mPeerPort = 5683 + peer};
+
+  info.mPeerAddr.mFields.m8[0] = 0xfd;
+  info.mPeerAddr.mFields.m8[15] = peer;
+  return info;
+}
+
+bool fake_deliver(const char *p_uri_path, otMessage *p_request,
+                  const otMessageInfo *p_message_info) {
+  for (size_t i = 0; i < resource_count; i++) {
+    if (strcmp(resources[i]->mUriPath, p_uri_path) == 0) {
+      resources[i]->mHandler(resources[i]->mContext, p_request,
+                             p_message_info);
+      otMessageFree(p_request);
+      return true;
+    }
+  }
+
+  otMessageFree(p_request);
+  return false;
+}
+
+void fake_respond(size_t index, otError result) {
+  struct fake_sent *p_sent = &fake_sent[index];
+
+  if (p_sent->handler != NULL) {
+    p_sent->handler(p_sent->context, NULL, &p_sent->info, result);
+  }
+}
+
+size_t fake_sent_to(uint8_t peer, size_t index) {
+  otMessageInfo info = fake_peer(peer);
+  size_t count = 0;
+
+  for (size_t i = index; i < fake_sent_count; i++) {
+    if (fake_sent[i].info.mPeerPort == info.mPeerPort &&
+        otIp6IsAddressEqual(&fake_sent[i].info.mPeerAddr, &info.mPeerAddr)) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+bool fake_uint_option(const otMessage *p_message, uint16_t number,
+                      uint64_t *p_value) {
+  otCoapOptionIterator iterator;
+
+  otCoapOptionIteratorInit(&iterator, p_message);
+  return otCoapOptionIteratorGetFirstOptionMatching(&iterator, number) !=
+             NULL &&
+         otCoapOptionIteratorGetOptionUintValue(&iterator, p_value) ==
+             OT_ERROR_NONE;
+}
+
+/* Option delta or length nibble, with its extended bytes (RFC 7252 3.1) */
+static size_t encode_nibble(uint16_t value, uint8_t *p_nibble,
+                            uint8_t *p_ext) {
+  if (value < 13) {
+    *p_nibble = value;
+    return 0;
+  }
+  if (value < 269) {
+    *p_nibble = 13;
+    p_ext[0] = value - 13;
+    return 1;
+  }
+
+  *p_nibble = 14;
+  p_ext[0] = (value - 269) >> 8;
+  p_ext[1] = (value - 269) & 0xff;
+  return 2;
+}
+
+size_t fake_encode(const otMessage *p_message, uint8_t *p_buf, size_t size) {
+  uint8_t out[4 + OT_COAP_MAX_TOKEN_LENGTH + FAKE_OPTIONS *
+                                                 (5 + FAKE_OPTION_SIZE) +
+              1 + FAKE_PAYLOAD_SIZE];
+  size_t len = 0;
+  uint16_t number = 0;
+
+  out[len++] = 1 << 6 | p_message->type << 4 | p_message->token_len;
+  out[len++] = p_message->code;
+  out[len++] = p_message->message_id >> 8;
+  out[len++] = p_message->message_id & 0xff;
+  memcpy(&out[len], p_message->token, p_message->token_len);
+  len += p_message->token_len;
+
+  for (size_t i = 0; i < p_message->option_count; i++) {
+    const struct fake_option *p_option = &p_message->options[i];
+    uint8_t delta, length, ext[4];
+    size_t ext_len;
+
+    ext_len = encode_nibble(p_option->number - number, &delta, ext);
+    ext_len += encode_nibble(p_option->length, &length, &ext[ext_len]);
+    out[len++] = delta << 4 | length;
+    memcpy(&out[len], ext, ext_len);
+    len += ext_len;
+    memcpy(&out[len], p_option->value, p_option->length);
+    len += p_option->length;
+    number = p_option->number;
+  }
+
+  if (p_message->payload_marker && p_message->payload_len > 0) {
+    out[len++] = 0xff;
+    memcpy(&out[len], p_message->payload, p_message->payload_len);
+    len += p_message->payload_len;
+  }
+
+  memcpy(p_buf, out, len < size ? len : size);
+  return len;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Work queues for the unit tests. Submitted and scheduled work items are
+ * only run by fake_work_run(), so a test sees the state in between.
+ */
+
+#ifndef FAKE_KERNEL_H_
+#define FAKE_KERNEL_H_
+
+#include <stddef.h>
+#include <zephyr/kernel.h>
+
+/* Forget the pending work items. */
+void fake_kernel_reset(void);
+
+/*
+ * Run the pending work items, also the ones they submit, until none is left.
+ * The delays of scheduled work items are ignored.
+ *
+ * Returns the number of handlers that ran.
+ */
+size_t fake_work_run(void);
+
+#endif /* FAKE_KERNEL_H_ */
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * In-memory NVS on a flash device for the unit tests. The entries survive
+ * a new nvs_mount(), like after a reboot, until fake_nvs_reset() erases
+ * them.
+ */
+
+#ifndef FAKE_NVS_H_
+#define FAKE_NVS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/flash.h>
+
+#define FAKE_NVS_ENTRIES 64
+#define FAKE_NVS_ENTRY_SIZE 128
+#define FAKE_NVS_SECTORS 4
+#define FAKE_NVS_SECTOR_SIZE 4096
+
+extern const struct device fake_flash_device;
+
+/* Number of nvs_write() calls since the last reset */
+extern size_t fake_nvs_writes;
+
+/* Erase all entries. */
+void fake_nvs_reset(void);
+
+#endif /* FAKE_NVS_H_ */
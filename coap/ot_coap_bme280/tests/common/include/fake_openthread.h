@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * In-memory OpenThread CoAP for the unit tests. The messages that the code
+ * under test sends are kept with their response handler, so a test can
+ * check them and answer them, or let them time out.
+ */
+
+#ifndef FAKE_OPENTHREAD_H_
+#define FAKE_OPENTHREAD_H_
+
+#include <openthread/coap.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FAKE_MESSAGES 32
+#define FAKE_OPTIONS 16
+#define FAKE_OPTION_SIZE 32
+#define FAKE_PAYLOAD_SIZE 1280
+#define FAKE_SENT_MAX 64
+
+struct fake_option {
+  uint16_t number;
+  uint16_t length;
+  uint8_t value[FAKE_OPTION_SIZE];
+};
+
+struct otMessage {
+  bool used;
+  otCoapType type;
+  otCoapCode code;
+  uint16_t message_id;
+  uint8_t token[OT_COAP_MAX_TOKEN_LENGTH];
+  uint8_t token_len;
+  struct fake_option options[FAKE_OPTIONS];
+  size_t option_count;
+  bool payload_marker;
+  uint8_t payload[FAKE_PAYLOAD_SIZE];
+  uint16_t payload_len;
+  int8_t rss;
+};
+
+/*
+ * A message that the code under test sent, with its response handler. A
+ * message sent with otUdpSend() has all its bytes in the payload.
+ */
+struct fake_sent {
+  otMessage *p_message;
+  otMessageInfo info;
+  bool response;
+  otCoapResponseHandler handler;
+  void *context;
+};
+
+extern struct fake_sent fake_sent[FAKE_SENT_MAX];
+extern size_t fake_sent_count;
+
+/* While set, otCoapNewMessage() runs out of message buffers. */
+extern bool fake_no_bufs;
+
+/* Number of openthread_api_mutex_lock() calls without an unlock */
+extern int fake_api_mutex_depth;
+
+/* Free all messages and forget the sent messages and the resources. */
+void fake_openthread_reset(void);
+
+/* Build a request from a peer, with an empty token if token_len is 0. */
+otMessage *fake_request(otCoapType type, otCoapCode code,
+                        const uint8_t *p_token, uint8_t token_len);
+
+/* Peer address fd00::<peer> and port 5683 + peer */
+otMessageInfo fake_peer(uint8_t peer);
+
+/*
+ * Pass a request to the handler of the resource with the URI path, and free
+ * it afterwards like OpenThread does. Returns false if there is no such
+ * resource.
+ */
+bool fake_deliver(const char *p_uri_path, otMessage *p_request,
+                  const otMessageInfo *p_message_info);
+
+/*
+ * Call the response handler of sent message index with the result, as for
+ * an acknowledgement with OT_ERROR_NONE or a timeout with
+ * OT_ERROR_RESPONSE_TIMEOUT.
+ */
+void fake_respond(size_t index, otError result);
+
+/* Number of sent messages to the peer, from sent message index on */
+size_t fake_sent_to(uint8_t peer, size_t index);
+
+/* Value of the first option with the number as an unsigned integer */
+bool fake_uint_option(const otMessage *p_message, uint16_t number,
+                      uint64_t *p_value);
+
+/*
+ * Encode a message in the CoAP format of RFC 7252 like OpenThread does.
+ * Returns the length.
+ */
+size_t fake_encode(const otMessage *p_message, uint8_t *p_buf, size_t size);
+
+#endif /* FAKE_OPENTHREAD_H_ */
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * The part of the OpenThread CoAP API that the application uses, for the
+ * unit tests. fake_openthread.c keeps the messages in memory, so a test can
+ * check what the code under test sends and play the peer.
+ */
+
+#ifndef FAKE_OPENTHREAD_COAP_H_
+#define FAKE_OPENTHREAD_COAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum otError {
+  OT_ERROR_NONE = 0,
+  OT_ERROR_FAILED = 1,
+  OT_ERROR_NO_BUFS = 3,
+  OT_ERROR_INVALID_ARGS = 7,
+  OT_ERROR_NOT_FOUND = 23,
+  OT_ERROR_RESPONSE_TIMEOUT = 28,
+} otError;
+
+typedef struct otInstance otInstance;
+typedef struct otMessage otMessage;
+
+typedef struct otIp6Address {
+  union {
+    uint8_t m8[16];
+  } mFields;
+} otIp6Address;
+
+#define OT_IP6_ADDRESS_STRING_SIZE 40
+
+typedef struct otMessageInfo {
+  otIp6Address mSockAddr;
+  otIp6Address mPeerAddr;
+  uint16_t mSockPort;
+  uint16_t mPeerPort;
+} otMessageInfo;
+
+typedef enum otCoapType {
+  OT_COAP_TYPE_CONFIRMABLE = 0,
+  OT_COAP_TYPE_NON_CONFIRMABLE = 1,
+  OT_COAP_TYPE_ACKNOWLEDGMENT = 2,
+  OT_COAP_TYPE_RESET = 3,
+} otCoapType;
+
+#define OT_COAP_CODE(c, d) ((((c) & 0x7) << 5) | ((d) & 0x1f))
+
+typedef enum otCoapCode {
+  OT_COAP_CODE_EMPTY = OT_COAP_CODE(0, 0),
+  OT_COAP_CODE_GET = OT_COAP_CODE(0, 1),
+  OT_COAP_CODE_POST = OT_COAP_CODE(0, 2),
+  OT_COAP_CODE_PUT = OT_COAP_CODE(0, 3),
+  OT_COAP_CODE_CHANGED = OT_COAP_CODE(2, 4),
+  OT_COAP_CODE_CONTENT = OT_COAP_CODE(2, 5),
+  OT_COAP_CODE_BAD_REQUEST = OT_COAP_CODE(4, 0),
+  OT_COAP_CODE_BAD_OPTION = OT_COAP_CODE(4, 2),
+  OT_COAP_CODE_NOT_FOUND = OT_COAP_CODE(4, 4),
+  OT_COAP_CODE_PRECONDITION_FAILED = OT_COAP_CODE(4, 12),
+  OT_COAP_CODE_SERVICE_UNAVAILABLE = OT_COAP_CODE(5, 3),
+} otCoapCode;
+
+typedef enum otCoapOptionType {
+  OT_COAP_OPTION_E_TAG = 4,
+  OT_COAP_OPTION_OBSERVE = 6,
+  OT_COAP_OPTION_URI_PATH = 11,
+  OT_COAP_OPTION_CONTENT_FORMAT = 12,
+  OT_COAP_OPTION_URI_QUERY = 15,
+  OT_COAP_OPTION_BLOCK2 = 23,
+  OT_COAP_OPTION_SIZE2 = 28,
+} otCoapOptionType;
+
+typedef enum otCoapOptionContentFormat {
+  OT_COAP_OPTION_CONTENT_FORMAT_OCTET_STREAM = 42,
+  OT_COAP_OPTION_CONTENT_FORMAT_JSON = 50,
+  OT_COAP_OPTION_CONTENT_FORMAT_CBOR = 60,
+} otCoapOptionContentFormat;
+
+typedef enum otCoapBlockSzx {
+  OT_COAP_OPTION_BLOCK_SZX_16 = 0,
+  OT_COAP_OPTION_BLOCK_SZX_32 = 1,
+  OT_COAP_OPTION_BLOCK_SZX_64 = 2,
+  OT_COAP_OPTION_BLOCK_SZX_128 = 3,
+  OT_COAP_OPTION_BLOCK_SZX_256 = 4,
+  OT_COAP_OPTION_BLOCK_SZX_512 = 5,
+  OT_COAP_OPTION_BLOCK_SZX_1024 = 6,
+} otCoapBlockSzx;
+
+#define OT_DEFAULT_COAP_PORT 5683
+#define OT_COAP_MAX_TOKEN_LENGTH 8
+
+typedef struct otCoapOption {
+  uint16_t mNumber;
+  uint16_t mLength;
+} otCoapOption;
+
+typedef struct otCoapOptionIterator {
+  const otMessage *mMessage;
+  otCoapOption mOption;
+  uint16_t mIndex;
+} otCoapOptionIterator;
+
+typedef void (*otCoapRequestHandler)(void *aContext, otMessage *aMessage,
+                                     const otMessageInfo *aMessageInfo);
+typedef void (*otCoapResponseHandler)(void *aContext, otMessage *aMessage,
+                                      const otMessageInfo *aMessageInfo,
+                                      otError aResult);
+
+typedef struct otCoapResource {
+  const char *mUriPath;
+  otCoapRequestHandler mHandler;
+  void *mContext;
+  struct otCoapResource *mNext;
+} otCoapResource;
+
+typedef struct otMessageSettings otMessageSettings;
+
+static inline uint16_t otCoapBlockSizeFromExponent(otCoapBlockSzx aSize) {
+  return 1 << (aSize + 4);
+}
+
+otMessage *otCoapNewMessage(otInstance *aInstance,
+                            const otMessageSettings *aSettings);
+void otCoapMessageInit(otMessage *aMessage, otCoapType aType,
+                       otCoapCode aCode);
+otError otCoapMessageInitResponse(otMessage *aResponse,
+                                  const otMessage *aRequest, otCoapType aType,
+                                  otCoapCode aCode);
+otError otCoapMessageSetToken(otMessage *aMessage, const uint8_t *aToken,
+                              uint8_t aTokenLength);
+uint8_t otCoapMessageGetTokenLength(const otMessage *aMessage);
+const uint8_t *otCoapMessageGetToken(const otMessage *aMessage);
+otCoapType otCoapMessageGetType(const otMessage *aMessage);
+otCoapCode otCoapMessageGetCode(const otMessage *aMessage);
+uint16_t otCoapMessageGetMessageId(const otMessage *aMessage);
+const char *otCoapMessageCodeToString(const otMessage *aMessage);
+otError otCoapMessageAppendOption(otMessage *aMessage, uint16_t aNumber,
+                                  uint16_t aLength, const void *aValue);
+otError otCoapMessageAppendUintOption(otMessage *aMessage, uint16_t aNumber,
+                                      uint32_t aValue);
+otError otCoapMessageAppendObserveOption(otMessage *aMessage,
+                                         uint32_t aObserve);
+otError otCoapMessageAppendUriPathOptions(otMessage *aMessage,
+                                          const char *aUriPath);
+otError otCoapMessageAppendContentFormatOption(
+    otMessage *aMessage, otCoapOptionContentFormat aContentFormat);
+otError otCoapMessageAppendBlock2Option(otMessage *aMessage, uint32_t aNum,
+                                        bool aMore, otCoapBlockSzx aSize);
+otError otCoapMessageSetPayloadMarker(otMessage *aMessage);
+
+otError otCoapOptionIteratorInit(otCoapOptionIterator *aIterator,
+                                 const otMessage *aMessage);
+const otCoapOption *
+otCoapOptionIteratorGetFirstOptionMatching(otCoapOptionIterator *aIterator,
+                                           uint16_t aOption);
+const otCoapOption *
+otCoapOptionIteratorGetNextOptionMatching(otCoapOptionIterator *aIterator,
+                                          uint16_t aOption);
+otError otCoapOptionIteratorGetOptionUintValue(otCoapOptionIterator *aIterator,
+                                               uint64_t *aValue);
+otError otCoapOptionIteratorGetOptionValue(otCoapOptionIterator *aIterator,
+                                           void *aValue);
+
+otError otCoapSendRequest(otInstance *aInstance, otMessage *aMessage,
+                          const otMessageInfo *aMessageInfo,
+                          otCoapResponseHandler aHandler, void *aContext);
+otError otCoapSendResponse(otInstance *aInstance, otMessage *aMessage,
+                           const otMessageInfo *aMessageInfo);
+void otCoapAddResource(otInstance *aInstance, otCoapResource *aResource);
+otError otCoapStart(otInstance *aInstance, uint16_t aPort);
+
+otError otMessageAppend(otMessage *aMessage, const void *aBuf,
+                        uint16_t aLength);
+uint16_t otMessageGetLength(const otMessage *aMessage);
+uint16_t otMessageGetOffset(const otMessage *aMessage);
+uint16_t otMessageRead(const otMessage *aMessage, uint16_t aOffset, void *aBuf,
+                       uint16_t aLength);
+int8_t otMessageGetRss(const otMessage *aMessage);
+void otMessageFree(otMessage *aMessage);
+
+bool otIp6IsAddressEqual(const otIp6Address *aFirst,
+                         const otIp6Address *aSecond);
+otError otIp6AddressFromString(const char *aString, otIp6Address *aAddress);
+void otIp6AddressToString(const otIp6Address *aAddress, char *aBuffer,
+                          uint16_t aSize);
+
+#endif /* FAKE_OPENTHREAD_COAP_H_ */
@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FAKE_OPENTHREAD_LINK_H_
+#define FAKE_OPENTHREAD_LINK_H_
+
+#include <openthread/coap.h>
+
+otError otLinkSendDataRequest(otInstance *aInstance);
+
+#endif /* FAKE_OPENTHREAD_LINK_H_ */
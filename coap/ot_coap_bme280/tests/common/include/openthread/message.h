@@ -0,0 +1,12 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FAKE_OPENTHREAD_MESSAGE_H_
+#define FAKE_OPENTHREAD_MESSAGE_H_
+
+#include <openthread/coap.h>
+
+#endif /* FAKE_OPENTHREAD_MESSAGE_H_ */
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FAKE_OPENTHREAD_PLATFORM_RADIO_H_
+#define FAKE_OPENTHREAD_PLATFORM_RADIO_H_
+
+#include <openthread/coap.h>
+#include <stdint.h>
+
+#define OT_RADIO_RSSI_INVALID 127
+#define OT_EXT_ADDRESS_SIZE 8
+
+typedef struct otExtAddress {
+  uint8_t m8[OT_EXT_ADDRESS_SIZE];
+} otExtAddress;
+
+void otPlatRadioGetIeeeEui64(otInstance *aInstance, uint8_t *aIeeeEui64);
+
+#endif /* FAKE_OPENTHREAD_PLATFORM_RADIO_H_ */
@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Random numbers for the unit tests, which repeat from run to run. */
+
+#ifndef FAKE_OPENTHREAD_RANDOM_NONCRYPTO_H_
+#define FAKE_OPENTHREAD_RANDOM_NONCRYPTO_H_
+
+#include <stdint.h>
+
+uint32_t otRandomNonCryptoGetUint32(void);
+uint16_t otRandomNonCryptoGetUint16(void);
+
+#endif /* FAKE_OPENTHREAD_RANDOM_NONCRYPTO_H_ */
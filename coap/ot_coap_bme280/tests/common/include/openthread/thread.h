@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FAKE_OPENTHREAD_THREAD_H_
+#define FAKE_OPENTHREAD_THREAD_H_
+
+#include <openthread/coap.h>
+
+typedef enum otDeviceRole {
+  OT_DEVICE_ROLE_DISABLED = 0,
+  OT_DEVICE_ROLE_DETACHED = 1,
+  OT_DEVICE_ROLE_CHILD = 2,
+  OT_DEVICE_ROLE_ROUTER = 3,
+  OT_DEVICE_ROLE_LEADER = 4,
+} otDeviceRole;
+
+const char *otThreadErrorToString(otError aError);
+otDeviceRole otThreadGetDeviceRole(otInstance *aInstance);
+
+#endif /* FAKE_OPENTHREAD_THREAD_H_ */
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * The part of the OpenThread UDP API that the application uses, for the unit
+ * tests. A UDP message keeps all its bytes in the payload of the fake
+ * message.
+ */
+
+#ifndef FAKE_OPENTHREAD_UDP_H_
+#define FAKE_OPENTHREAD_UDP_H_
+
+#include <openthread/coap.h>
+
+typedef void (*otUdpReceive)(void *aContext, otMessage *aMessage,
+                             const otMessageInfo *aMessageInfo);
+
+typedef struct otUdpSocket {
+  otUdpReceive mHandler;
+  void *mContext;
+} otUdpSocket;
+
+otError otUdpOpen(otInstance *aInstance, otUdpSocket *aSocket,
+                  otUdpReceive aCallback, void *aContext);
+otMessage *otUdpNewMessage(otInstance *aInstance,
+                           const otMessageSettings *aSettings);
+otError otUdpSend(otInstance *aInstance, otUdpSocket *aSocket,
+                  otMessage *aMessage, const otMessageInfo *aMessageInfo);
+
+#endif /* FAKE_OPENTHREAD_UDP_H_ */
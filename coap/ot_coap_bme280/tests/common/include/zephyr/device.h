@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Devices of the unit tests, which only have a name. */
+
+#ifndef FAKE_ZEPHYR_DEVICE_H_
+#define FAKE_ZEPHYR_DEVICE_H_
+
+#include <stdbool.h>
+#include <zephyr/devicetree.h>
+
+struct device {
+  const char *name;
+};
+
+bool device_is_ready(const struct device *dev);
+
+#endif /* FAKE_ZEPHYR_DEVICE_H_ */
@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* The devicetree of the unit tests has TEST_SENSOR_COUNT BME280 sensors. */
+
+#ifndef FAKE_ZEPHYR_DEVICETREE_H_
+#define FAKE_ZEPHYR_DEVICETREE_H_
+
+#ifndef TEST_SENSOR_COUNT
+#define TEST_SENSOR_COUNT 1
+#endif
+
+#define DT_NUM_INST_STATUS_OKAY(compat) TEST_SENSOR_COUNT
+
+#endif /* FAKE_ZEPHYR_DEVICETREE_H_ */
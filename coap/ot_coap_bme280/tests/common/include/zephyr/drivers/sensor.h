@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FAKE_ZEPHYR_DRIVERS_SENSOR_H_
+#define FAKE_ZEPHYR_DRIVERS_SENSOR_H_
+
+#include <stdint.h>
+
+struct sensor_value {
+  int32_t val1;
+  int32_t val2;
+};
+
+#endif /* FAKE_ZEPHYR_DRIVERS_SENSOR_H_ */
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* The NVS API, implemented in memory by fake_nvs.c for the unit tests. */
+
+#ifndef FAKE_ZEPHYR_FS_NVS_H_
+#define FAKE_ZEPHYR_FS_NVS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <zephyr/drivers/flash.h>
+
+struct nvs_fs {
+  off_t offset;
+  uint16_t sector_size;
+  uint16_t sector_count;
+  const struct device *flash_device;
+};
+
+int nvs_mount(struct nvs_fs *fs);
+
+ssize_t nvs_read(struct nvs_fs *fs, uint16_t id, void *data, size_t len);
+
+ssize_t nvs_write(struct nvs_fs *fs, uint16_t id, const void *data,
+                  size_t len);
+
+ssize_t nvs_calc_free_space(struct nvs_fs *fs);
+
+#endif /* FAKE_ZEPHYR_FS_NVS_H_ */
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* The part of the kernel API that the application uses, for the unit tests. */
+
+#ifndef FAKE_ZEPHYR_KERNEL_H_
+#define FAKE_ZEPHYR_KERNEL_H_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <zephyr/sys/util.h>
+
+#define snprintk snprintf
+
+/*
+ * Work items only run when the test calls fake_work_run(), see
+ * fake_kernel.h.
+ */
+typedef struct {
+  int64_t ms;
+} k_timeout_t;
+
+#define K_MSEC(ms) ((k_timeout_t){(ms)})
+#define K_NO_WAIT K_MSEC(0)
+
+struct k_work;
+typedef void (*k_work_handler_t)(struct k_work *work);
+
+struct k_work {
+  k_work_handler_t handler;
+  bool pending;
+  struct k_work *p_next;
+};
+
+struct k_work_delayable {
+  struct k_work work;
+  k_timeout_t delay;
+};
+
+struct k_work_q {
+  const char *name;
+};
+
+struct k_work_queue_config {
+  const char *name;
+};
+
+typedef char k_thread_stack_t;
+
+#define K_WORK_DEFINE(sym, work_handler)                                       \
+  struct k_work sym = {.handler = (work_handler)}
+#define K_WORK_DELAYABLE_DEFINE(sym, work_handler)                             \
+  struct k_work_delayable sym = {.work = {.handler = (work_handler)}}
+#define K_THREAD_STACK_DEFINE(sym, size) k_thread_stack_t sym[size]
+#define K_THREAD_STACK_SIZEOF(sym) sizeof(sym)
+
+void k_work_queue_start(struct k_work_q *queue, k_thread_stack_t *stack,
+                        size_t stack_size, int prio,
+                        const struct k_work_queue_config *cfg);
+
+int k_work_submit(struct k_work *work);
+
+int k_work_submit_to_queue(struct k_work_q *queue, struct k_work *work);
+
+int k_work_schedule(struct k_work_delayable *dwork, k_timeout_t delay);
+
+#endif /* FAKE_ZEPHYR_KERNEL_H_ */
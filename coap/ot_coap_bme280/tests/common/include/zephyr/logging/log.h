@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Logging for the unit tests, which only checks the format arguments. */
+
+#ifndef FAKE_ZEPHYR_LOGGING_LOG_H_
+#define FAKE_ZEPHYR_LOGGING_LOG_H_
+
+#define LOG_MODULE_DECLARE(...) extern int fake_log_unused
+#define LOG_MODULE_REGISTER(...) extern int fake_log_unused
+
+static inline __attribute__((format(printf, 1, 2))) void
+fake_log(const char *fmt, ...) {}
+
+#define LOG_DBG(...) fake_log(__VA_ARGS__)
+#define LOG_INF(...) fake_log(__VA_ARGS__)
+#define LOG_WRN(...) fake_log(__VA_ARGS__)
+#define LOG_ERR(...) fake_log(__VA_ARGS__)
+#define LOG_HEXDUMP_DBG(data, length, str) fake_log(str)
+
+#endif /* FAKE_ZEPHYR_LOGGING_LOG_H_ */
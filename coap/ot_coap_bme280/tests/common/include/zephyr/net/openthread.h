@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FAKE_ZEPHYR_NET_OPENTHREAD_H_
+#define FAKE_ZEPHYR_NET_OPENTHREAD_H_
+
+#include <openthread/coap.h>
+
+struct openthread_context;
+
+struct otInstance *openthread_get_default_instance(void);
+
+struct openthread_context *openthread_get_default_context(void);
+
+/* The tests are single-threaded, so the mutex only counts the locks. */
+void openthread_api_mutex_lock(struct openthread_context *ot_context);
+
+void openthread_api_mutex_unlock(struct openthread_context *ot_context);
+
+#endif /* FAKE_ZEPHYR_NET_OPENTHREAD_H_ */
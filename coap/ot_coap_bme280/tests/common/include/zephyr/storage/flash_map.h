@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Every fixed partition of the unit tests is the in-memory NVS of fake_nvs. */
+
+#ifndef FAKE_ZEPHYR_STORAGE_FLASH_MAP_H_
+#define FAKE_ZEPHYR_STORAGE_FLASH_MAP_H_
+
+#include <zephyr/drivers/flash.h>
+
+#include "fake_nvs.h"
+
+#define FIXED_PARTITION_DEVICE(label) (&fake_flash_device)
+#define FIXED_PARTITION_OFFSET(label) 0
+#define FIXED_PARTITION_SIZE(label) (FAKE_NVS_SECTORS * FAKE_NVS_SECTOR_SIZE)
+
+#endif /* FAKE_ZEPHYR_STORAGE_FLASH_MAP_H_ */
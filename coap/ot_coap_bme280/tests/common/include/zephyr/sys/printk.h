@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* The formatting functions of printk, for the unit tests. */
+
+#ifndef FAKE_ZEPHYR_SYS_PRINTK_H_
+#define FAKE_ZEPHYR_SYS_PRINTK_H_
+
+#include <stdio.h>
+
+#define snprintk snprintf
+#define vsnprintk vsnprintf
+
+#endif /* FAKE_ZEPHYR_SYS_PRINTK_H_ */
@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FAKE_ZEPHYR_TIMING_TIMING_H_
+#define FAKE_ZEPHYR_TIMING_TIMING_H_
+
+#include <stdint.h>
+
+typedef uint64_t timing_t;
+
+#endif /* FAKE_ZEPHYR_TIMING_TIMING_H_ */
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Replay traces of two BME280 sensors through the report-on-change filter
+ * with the default deadbands and heartbeat interval, reporting each sample
+ * that passes it, and check which samples are reported.
+ */
+
+#include <stdlib.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include "deadband.h"
+
+/* Default of CONFIG_APP_SAMPLE_INTERVAL in ms */
+#define SAMPLE_INTERVAL 5000
+#define HOUR 3600000
+#define DAY (24 * HOUR)
+
+/* Readings of the room in 0.01 °C, Pa and 0.01 % */
+#define ROOM_TEMP 2150
+#define ROOM_PRESS 101325
+#define ROOM_HUM 4500
+
+struct readings {
+  int32_t temp;
+  int32_t press;
+  int32_t hum;
+};
+
+/* Uptime of the start of the trace of a test */
+static uint32_t start;
+static uint32_t noise_state;
+
+/* Set the sensor values of a sensor as the driver returns them. */
+static void set_readings(struct sensor_report *p_report,
+                         const struct readings *p_readings) {
+  p_report->temp = (struct sensor_value){p_readings->temp / 100,
+                                         p_readings->temp % 100 * 10000};
+  p_report->press = (struct sensor_value){p_readings->press / 1000,
+                                          p_readings->press % 1000 * 1000};
+  p_report->hum = (struct sensor_value){p_readings->hum / 100,
+                                        p_readings->hum % 100 * 10000};
+}
+
+/* Sample at ms after the start with the same readings on both sensors */
+static struct sensor_sample sample_at(uint32_t ms,
+                                      const struct readings *p_readings) {
+  struct sensor_sample sample = {.timestamp = start + ms};
+
+  for (size_t i = 0; i < REPORT_SENSOR_COUNT; i++) {
+    set_readings(&sample.report[i], p_readings);
+  }
+  return sample;
+}
+
+/* Run a sample through the filter, like main.c. Returns whether it's sent. */
+static bool offer(const struct sensor_sample *p_sample) {
+  if (!deadband_check(p_sample)) {
+    return false;
+  }
+
+  deadband_commit(p_sample);
+  return true;
+}
+
+/* Uniform noise in [-amplitude, amplitude] from a xorshift generator */
+static int32_t noise(int32_t amplitude) {
+  noise_state ^= noise_state << 13;
+  noise_state ^= noise_state >> 17;
+  noise_state ^= noise_state << 5;
+
+  return (int32_t)(noise_state % (2 * amplitude + 1)) - amplitude;
+}
+
+/* Triangle wave with the given period, between -amplitude and amplitude */
+static int32_t swing(uint32_t ms, uint32_t period, int32_t amplitude) {
+  int64_t phase = ms % period;
+  int64_t quarter = period / 4;
+
+  if (phase < quarter) {
+    return amplitude * phase / quarter;
+  }
+  if (phase < 3 * quarter) {
+    return amplitude * (2 * quarter - phase) / quarter;
+  }
+  return amplitude * (phase - 4 * quarter) / quarter;
+}
+
+/*
+ * Readings of a mostly static room: slow swings of 1 °C and 4 % a day and
+ * of 1.6 hPa in two days, with noise of a BME280 without oversampling.
+ */
+static struct readings static_room(uint32_t ms) {
+  return (struct readings){
+      ROOM_TEMP + swing(ms, DAY, 50) + noise(4),
+      ROOM_PRESS + swing(ms, 2 * DAY, 80) + noise(6),
+      ROOM_HUM + swing(ms, DAY, 200) + noise(10),
+  };
+}
+
+static bool exceeds_deadbands(const struct sensor_sample *p_sample,
+                              const struct sensor_sample *p_reported) {
+  for (size_t i = 0; i < REPORT_SENSOR_COUNT; i++) {
+    const struct sensor_report *p_now = &p_sample->report[i];
+    const struct sensor_report *p_last = &p_reported->report[i];
+
+    if (abs(report_temp_centi(p_now) - report_temp_centi(p_last)) >=
+            CONFIG_APP_DEADBAND_TEMP ||
+        abs(report_press_pa(p_now) - report_press_pa(p_last)) >=
+            CONFIG_APP_DEADBAND_PRESS ||
+        abs(report_hum_centi(p_now) - report_hum_centi(p_last)) >=
+            CONFIG_APP_DEADBAND_HUM) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Start each test two days after the last one, with the room reported at
+ * its start.
+ */
+static void before(void *fixture) {
+  struct readings room = {ROOM_TEMP, ROOM_PRESS, ROOM_HUM};
+  struct sensor_sample sample;
+
+  start += 2 * DAY;
+  noise_state = 1;
+  sample = sample_at(0, &room);
+  zassert_true(offer(&sample));
+}
+
+ZTEST(deadband, test_without_change_only_the_heartbeat_is_sent) {
+  struct readings room = {ROOM_TEMP, ROOM_PRESS, ROOM_HUM};
+  uint32_t expected = 0;
+
+  for (uint32_t ms = SAMPLE_INTERVAL; ms <= HOUR; ms += SAMPLE_INTERVAL) {
+    struct sensor_sample sample = sample_at(ms, &room);
+
+    if (offer(&sample)) {
+      expected += CONFIG_APP_HEARTBEAT_INTERVAL;
+      zassert_equal(ms, expected);
+    }
+  }
+  zassert_equal(expected, HOUR);
+}
+
+ZTEST(deadband, test_static_room_sends_a_few_reports_an_hour) {
+  struct readings room = {ROOM_TEMP, ROOM_PRESS, ROOM_HUM};
+  struct sensor_sample reported = sample_at(0, &room);
+  uint32_t reports = 0;
+  uint32_t longest_gap = 0;
+
+  for (uint32_t ms = SAMPLE_INTERVAL; ms < DAY; ms += SAMPLE_INTERVAL) {
+    struct readings readings = static_room(ms);
+    struct sensor_sample sample = sample_at(ms, &readings);
+
+    if (!offer(&sample)) {
+      /* A sample that isn't sent is within the deadbands of the last. */
+      zassert_false(exceeds_deadbands(&sample, &reported), "%u ms", ms);
+      continue;
+    }
+
+    reports++;
+    longest_gap = MAX(longest_gap, sample.timestamp - reported.timestamp);
+    reported = sample;
+  }
+
+  TC_PRINT("%u of %u samples reported\n", reports, DAY / SAMPLE_INTERVAL);
+  zassert_true(reports <= 24 * 6);
+  zassert_true(longest_gap <= CONFIG_APP_HEARTBEAT_INTERVAL);
+}
+
+ZTEST(deadband, test_step_is_reported_right_away) {
+  uint32_t step = HOUR / 2;
+
+  for (uint32_t ms = SAMPLE_INTERVAL; ms < HOUR; ms += SAMPLE_INTERVAL) {
+    struct readings readings = static_room(ms);
+    struct sensor_sample sample;
+
+    if (ms >= step) {
+      readings.temp += 150;
+    }
+    sample = sample_at(ms, &readings);
+    if (ms == step) {
+      zassert_true(offer(&sample));
+    } else {
+      offer(&sample);
+    }
+  }
+}
+
+/* A channel that moves its deadband in either direction is reported. */
+ZTEST(deadband, test_deadband_edges) {
+  static const struct readings changes[] = {
+      {CONFIG_APP_DEADBAND_TEMP, 0, 0},
+      {0, CONFIG_APP_DEADBAND_PRESS, 0},
+      {0, 0, CONFIG_APP_DEADBAND_HUM},
+  };
+  uint32_t ms = 0;
+
+  for (size_t i = 0; i < ARRAY_SIZE(changes); i++) {
+    for (int32_t sign = -1; sign <= 1; sign += 2) {
+      const struct readings *p_change = &changes[i];
+      struct readings within = {
+          ROOM_TEMP + sign * MAX(p_change->temp - 1, 0),
+          ROOM_PRESS + sign * MAX(p_change->press - 1, 0),
+          ROOM_HUM + sign * MAX(p_change->hum - 1, 0),
+      };
+      struct readings moved = {ROOM_TEMP + sign * p_change->temp,
+                               ROOM_PRESS + sign * p_change->press,
+                               ROOM_HUM + sign * p_change->hum};
+      struct readings room = {ROOM_TEMP, ROOM_PRESS, ROOM_HUM};
+      struct sensor_sample sample;
+
+      ms += SAMPLE_INTERVAL;
+      sample = sample_at(ms, &within);
+      zassert_false(offer(&sample), "change %zu, sign %d", i, sign);
+      ms += SAMPLE_INTERVAL;
+      sample = sample_at(ms, &moved);
+      zassert_true(offer(&sample), "change %zu, sign %d", i, sign);
+      ms += SAMPLE_INTERVAL;
+      sample = sample_at(ms, &room);
+      zassert_true(offer(&sample), "change %zu, sign %d", i, sign);
+    }
+  }
+}
+
+ZTEST(deadband, test_any_sensor_triggers_a_report) {
+  struct readings room = {ROOM_TEMP, ROOM_PRESS, ROOM_HUM};
+  struct readings humid = {ROOM_TEMP, ROOM_PRESS,
+                           ROOM_HUM + CONFIG_APP_DEADBAND_HUM};
+  struct sensor_sample sample = sample_at(SAMPLE_INTERVAL, &room);
+
+  zassert_false(offer(&sample));
+  set_readings(&sample.report[REPORT_SENSOR_COUNT - 1], &humid);
+  zassert_true(offer(&sample));
+}
+
+ZTEST_SUITE(deadband, NULL, NULL, before, NULL, NULL);
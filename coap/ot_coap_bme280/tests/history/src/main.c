@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Download the sample log from sensor/history block by block against an
+ * in-memory OpenThread and sample log, while the log grows and wraps.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include "fake_openthread.h"
+#include "history.h"
+#include "store.h"
+
+#define LOG_SLOTS 32
+#define RECORD_SIZE 24
+#define TRANSFER_MAX (CONFIG_APP_HISTORY_TRANSFER_RECORDS * RECORD_SIZE)
+#define PEER 1
+
+static uint32_t head;
+static uint32_t reads;
+
+/* Sample log with LOG_SLOTS slots and made-up readings per record */
+int store_read(uint32_t seq, struct store_record *p_record) {
+  reads++;
+  if ((int32_t)(head - seq) <= 0 || (int32_t)(head - seq) > LOG_SLOTS) {
+    return -ENOENT;
+  }
+
+  *p_record = (struct store_record){
+      .seq = seq,
+      .boot = 1 + seq / 100,
+      .sample = {.timestamp = seq * 1000,
+                 .report = {{.temp = {20 + seq % 10, 500000},
+                             .press = {101, 325000},
+                             .hum = {40 + seq % 5, 0}}}},
+  };
+  return 0;
+}
+
+uint32_t store_head(void) { return head; }
+
+uint32_t store_first(void) {
+  return head > LOG_SLOTS ? head - LOG_SLOTS : 0;
+}
+
+/* Representation of record seq, or of a record no longer in the log */
+static void expected_record(uint32_t seq, bool logged, uint8_t *buf) {
+  memset(buf, 0, RECORD_SIZE);
+  sys_put_be32(seq, &buf[0]);
+  if (logged) {
+    sys_put_be32(1 + seq / 100, &buf[4]);
+    sys_put_be32(seq * 1000, &buf[8]);
+    sys_put_be32((20 + seq % 10) * 100 + 50, &buf[12]);
+    sys_put_be32(101325, &buf[16]);
+    sys_put_be32((40 + seq % 5) * 100, &buf[20]);
+  }
+}
+
+struct block {
+  otCoapCode code;
+  uint32_t num;
+  bool more;
+  uint32_t size;
+  uint64_t size2;
+  uint8_t etag[8];
+  uint16_t etag_len;
+  uint8_t payload[FAKE_PAYLOAD_SIZE];
+  uint16_t payload_len;
+};
+
+/* GET a block, with the queries if they aren't NULL. */
+static void get_block(uint32_t num, otCoapBlockSzx szx, const char *p_from,
+                      const char *p_to, struct block *p_block) {
+  uint8_t token = PEER;
+  otMessage *p_request = fake_request(OT_COAP_TYPE_CONFIRMABLE,
+                                      OT_COAP_CODE_GET, &token, 1);
+  otMessageInfo info = fake_peer(PEER);
+  const otMessage *p_response;
+  uint64_t block2;
+
+  if (p_from != NULL) {
+    otCoapMessageAppendOption(p_request, OT_COAP_OPTION_URI_QUERY,
+                              strlen(p_from), p_from);
+  }
+  if (p_to != NULL) {
+    otCoapMessageAppendOption(p_request, OT_COAP_OPTION_URI_QUERY,
+                              strlen(p_to), p_to);
+  }
+  otCoapMessageAppendBlock2Option(p_request, num, false, szx);
+
+  fake_sent_count = 0;
+  zassert_true(fake_deliver("sensor/history", p_request, &info));
+  zassert_equal(fake_sent_count, 1);
+  p_response = fake_sent[0].p_message;
+
+  memset(p_block, 0, sizeof(*p_block));
+  p_block->code = p_response->code;
+  if (fake_uint_option(p_response, OT_COAP_OPTION_BLOCK2, &block2)) {
+    p_block->num = block2 >> 4;
+    p_block->more = block2 & 0x8;
+    p_block->size = otCoapBlockSizeFromExponent(block2 & 0x7);
+  }
+  fake_uint_option(p_response, OT_COAP_OPTION_SIZE2, &p_block->size2);
+  for (size_t i = 0; i < p_response->option_count; i++) {
+    if (p_response->options[i].number == OT_COAP_OPTION_E_TAG) {
+      p_block->etag_len = p_response->options[i].length;
+      memcpy(p_block->etag, p_response->options[i].value, p_block->etag_len);
+    }
+  }
+  p_block->payload_len = p_response->payload_len;
+  memcpy(p_block->payload, p_response->payload, p_response->payload_len);
+  otMessageFree(fake_sent[0].p_message);
+}
+
+/*
+ * Download a transfer in blocks of 16 bytes like the collector does, with
+ * a call of between() after each block. Returns the length.
+ */
+static size_t download(const char *p_from, uint8_t *p_payload,
+                       void (*between)(uint32_t num)) {
+  struct block block;
+  uint8_t etag[8];
+  char from[16];
+  char to[16];
+  size_t len = 0;
+
+  get_block(0, OT_COAP_OPTION_BLOCK_SZX_16, p_from, NULL, &block);
+  zassert_equal(block.code, OT_COAP_CODE_CONTENT);
+  zassert_equal(block.etag_len, sizeof(etag));
+  memcpy(etag, block.etag, sizeof(etag));
+  snprintf(from, sizeof(from), "from=%u", sys_get_be32(&etag[0]));
+  snprintf(to, sizeof(to), "to=%u", sys_get_be32(&etag[4]));
+
+  while (true) {
+    memcpy(&p_payload[len], block.payload, block.payload_len);
+    len += block.payload_len;
+    if (!block.more) {
+      return len;
+    }
+    if (between != NULL) {
+      between(block.num);
+    }
+
+    get_block(block.num + 1, OT_COAP_OPTION_BLOCK_SZX_16, from, to, &block);
+    zassert_equal(block.code, OT_COAP_CODE_CONTENT);
+    zassert_mem_equal(block.etag, etag, sizeof(etag));
+  }
+}
+
+static void before(void *fixture) {
+  fake_openthread_reset();
+  history_init();
+  head = 0;
+  reads = 0;
+}
+
+ZTEST(history, test_empty_log) {
+  struct block block;
+
+  get_block(0, OT_COAP_OPTION_BLOCK_SZX_512, NULL, NULL, &block);
+  zassert_equal(block.code, OT_COAP_CODE_CONTENT);
+  zassert_false(block.more);
+  zassert_equal(block.payload_len, 0);
+  zassert_equal(sys_get_be32(&block.etag[0]), 0);
+  zassert_equal(sys_get_be32(&block.etag[4]), 0);
+}
+
+/* The log grows by a record after every block of the transfer. */
+static void append_record(uint32_t num) { head++; }
+
+ZTEST(history, test_transfer_is_fixed_by_first_block) {
+  static uint8_t payload[TRANSFER_MAX];
+  uint8_t expected[RECORD_SIZE];
+  size_t len;
+
+  head = 10;
+  len = download(NULL, payload, append_record);
+  zassert_equal(len, 10 * RECORD_SIZE);
+  for (uint32_t seq = 0; seq < 10; seq++) {
+    expected_record(seq, true, expected);
+    zassert_mem_equal(&payload[seq * RECORD_SIZE], expected, RECORD_SIZE,
+                      "record %u", seq);
+  }
+  zassert_true(head > 20);
+}
+
+/* Another client starts a transfer from elsewhere after every block. */
+static void other_client(uint32_t num) {
+  struct block block;
+
+  head++;
+  get_block(0, OT_COAP_OPTION_BLOCK_SZX_64, "from=3", NULL, &block);
+  zassert_equal(block.code, OT_COAP_CODE_CONTENT);
+}
+
+ZTEST(history, test_clients_dont_share_a_transfer) {
+  static uint8_t payload[TRANSFER_MAX];
+  uint8_t expected[RECORD_SIZE];
+
+  head = 6;
+  zassert_equal(download("from=1", payload, other_client), 5 * RECORD_SIZE);
+  for (uint32_t seq = 1; seq < 6; seq++) {
+    expected_record(seq, true, expected);
+    zassert_mem_equal(&payload[(seq - 1) * RECORD_SIZE], expected,
+                      RECORD_SIZE, "record %u", seq);
+  }
+}
+
+/* The log wraps during the transfer, so its first records are gone. */
+static void wrap_log(uint32_t num) { head = 40; }
+
+ZTEST(history, test_records_overwritten_during_transfer) {
+  static uint8_t payload[TRANSFER_MAX];
+  uint8_t expected[RECORD_SIZE];
+
+  head = 10;
+  zassert_equal(download(NULL, payload, wrap_log), 10 * RECORD_SIZE);
+  /* Record 0 is split over the blocks before and after the wrap. */
+  for (uint32_t seq = 1; seq < 10; seq++) {
+    expected_record(seq, seq >= head - LOG_SLOTS, expected);
+    zassert_mem_equal(&payload[seq * RECORD_SIZE], expected, RECORD_SIZE,
+                      "record %u", seq);
+  }
+}
+
+ZTEST(history, test_etag_follows_the_window) {
+  struct block first;
+  struct block second;
+
+  head = 10;
+  get_block(0, OT_COAP_OPTION_BLOCK_SZX_512, NULL, NULL, &first);
+  head = 11;
+  get_block(0, OT_COAP_OPTION_BLOCK_SZX_512, NULL, NULL, &second);
+  zassert_equal(sys_get_be32(&first.etag[0]), 0);
+  zassert_equal(sys_get_be32(&first.etag[4]), 10);
+  zassert_equal(sys_get_be32(&second.etag[4]), 11);
+  zassert_equal(second.payload_len, 11 * RECORD_SIZE);
+}
+
+ZTEST(history, test_window_is_capped) {
+  struct block block;
+
+  head = LOG_SLOTS;
+  get_block(0, OT_COAP_OPTION_BLOCK_SZX_1024, NULL, NULL, &block);
+  zassert_equal(block.size2, TRANSFER_MAX);
+  zassert_equal(block.payload_len, TRANSFER_MAX);
+  zassert_equal(sys_get_be32(&block.etag[4]),
+                CONFIG_APP_HISTORY_TRANSFER_RECORDS);
+}
+
+/* A block only reads the records it contains from the log. */
+ZTEST(history, test_reads_per_block) {
+  struct block block;
+
+  head = LOG_SLOTS;
+  reads = 0;
+  get_block(1, OT_COAP_OPTION_BLOCK_SZX_128, NULL, NULL, &block);
+  zassert_equal(block.code, OT_COAP_CODE_CONTENT);
+  zassert_equal(block.payload_len, 128);
+  /* Bytes 128 to 255 are in records 5 to 10. */
+  zassert_equal(reads, 6);
+}
+
+ZTEST(history, test_invalid_windows) {
+  struct block block;
+
+  head = 10;
+  get_block(0, OT_COAP_OPTION_BLOCK_SZX_16, "from=5", "to=11", &block);
+  zassert_equal(block.code, OT_COAP_CODE_BAD_REQUEST);
+  get_block(0, OT_COAP_OPTION_BLOCK_SZX_16, "from=5", "to=4", &block);
+  zassert_equal(block.code, OT_COAP_CODE_BAD_REQUEST);
+  get_block(0, OT_COAP_OPTION_BLOCK_SZX_16, "from=0", "to=17", &block);
+  zassert_equal(block.code, OT_COAP_CODE_BAD_REQUEST);
+  get_block(8, OT_COAP_OPTION_BLOCK_SZX_16, "from=5", "to=10", &block);
+  zassert_equal(block.code, OT_COAP_CODE_BAD_OPTION);
+}
+
+ZTEST_SUITE(history, NULL, NULL, before, NULL, NULL);
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Check the notifications of the observable sensor resource against an
+ * in-memory OpenThread, in particular that an observer that doesn't
+ * acknowledge a confirmable notification is removed.
+ */
+
+#include <errno.h>
+#include <zephyr/ztest.h>
+
+#include "fake_openthread.h"
+#include "observe.h"
+
+#define PEER_A 1
+#define PEER_B 2
+#define PEER_C 3
+
+static const uint8_t payload[] = "{\"temp\":21.50}";
+
+otCoapOptionContentFormat report_content_format(void) {
+  return OT_COAP_OPTION_CONTENT_FORMAT_JSON;
+}
+
+/* Send a GET request of the peer that registers or deregisters it. */
+static void get_sensor(uint8_t peer, bool observe) {
+  otMessage *p_request = fake_request(OT_COAP_TYPE_CONFIRMABLE,
+                                      OT_COAP_CODE_GET, &peer, sizeof(peer));
+  otMessageInfo info = fake_peer(peer);
+
+  if (observe) {
+    otCoapMessageAppendObserveOption(p_request, 0);
+  }
+  zassert_true(fake_deliver("sensor", p_request, &info));
+}
+
+/* Whether the last response to the peer registered it as observer */
+static bool registered(uint8_t peer) {
+  const struct fake_sent *p_sent = &fake_sent[fake_sent_count - 1];
+  uint64_t observe;
+
+  zassert_true(p_sent->response);
+  zassert_equal(p_sent->info.mPeerPort, fake_peer(peer).mPeerPort);
+  return fake_uint_option(p_sent->p_message, OT_COAP_OPTION_OBSERVE, &observe);
+}
+
+/* Index of the first message to the peer from index on, or -1 */
+static int sent_to(uint8_t peer, size_t index) {
+  for (size_t i = index; i < fake_sent_count; i++) {
+    if (fake_sent[i].info.mPeerPort == fake_peer(peer).mPeerPort) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * Notify until the notification to the peer is confirmable, and return the
+ * index of that one.
+ */
+static int notify_until_confirmable(uint8_t peer) {
+  for (int i = 0; i < CONFIG_APP_OBSERVE_CON_INTERVAL; i++) {
+    size_t index = fake_sent_count;
+    int sent;
+
+    zassert_equal(observe_notify(payload, sizeof(payload) - 1), 0);
+    sent = sent_to(peer, index);
+    zassert_true(sent >= 0);
+    if (fake_sent[sent].p_message->type == OT_COAP_TYPE_CONFIRMABLE) {
+      return sent;
+    }
+  }
+
+  zassert_unreachable("No confirmable notification");
+  return -1;
+}
+
+static void before(void *fixture) {
+  fake_openthread_reset();
+  observe_init();
+}
+
+/* Deregister every observer, so the next test starts without any. */
+static void after(void *fixture) {
+  get_sensor(PEER_A, false);
+  get_sensor(PEER_B, false);
+  get_sensor(PEER_C, false);
+}
+
+ZTEST(observe, test_no_observers) {
+  zassert_equal(observe_notify(payload, sizeof(payload) - 1), -ENOTCONN);
+  zassert_equal(fake_sent_count, 0);
+}
+
+ZTEST(observe, test_register_and_notify) {
+  const otMessage *p_message;
+  size_t index;
+
+  get_sensor(PEER_A, true);
+  zassert_true(registered(PEER_A));
+
+  index = fake_sent_count;
+  zassert_equal(observe_notify(payload, sizeof(payload) - 1), 0);
+  zassert_equal(fake_sent_count, index + 1);
+  p_message = fake_sent[index].p_message;
+  zassert_equal(p_message->token_len, 1);
+  zassert_equal(p_message->token[0], PEER_A);
+  zassert_equal(p_message->payload_len, sizeof(payload) - 1);
+  zassert_mem_equal(p_message->payload, payload, sizeof(payload) - 1);
+}
+
+ZTEST(observe, test_full_observer_list) {
+  get_sensor(PEER_A, true);
+  get_sensor(PEER_B, true);
+  get_sensor(PEER_C, true);
+  zassert_false(registered(PEER_C));
+}
+
+ZTEST(observe, test_acknowledged_confirmable_keeps_observer) {
+  int con;
+  int sent;
+  size_t index;
+
+  get_sensor(PEER_A, true);
+  con = notify_until_confirmable(PEER_A);
+
+  /* No notifications until the acknowledgement */
+  index = fake_sent_count;
+  observe_notify(payload, sizeof(payload) - 1);
+  zassert_equal(sent_to(PEER_A, index), -1);
+
+  fake_respond(con, OT_ERROR_NONE);
+  index = fake_sent_count;
+  zassert_equal(observe_notify(payload, sizeof(payload) - 1), 0);
+  sent = sent_to(PEER_A, index);
+  zassert_true(sent >= 0);
+  zassert_equal(fake_sent[sent].p_message->type,
+                OT_COAP_TYPE_NON_CONFIRMABLE);
+}
+
+/* A sleepy end device polls its parent only for these acknowledgements. */
+ZTEST(observe, test_con_pending) {
+  int con;
+
+  get_sensor(PEER_A, true);
+  zassert_false(observe_con_pending());
+  con = notify_until_confirmable(PEER_A);
+  zassert_true(observe_con_pending());
+
+  fake_respond(con, OT_ERROR_NONE);
+  zassert_false(observe_con_pending());
+
+  con = notify_until_confirmable(PEER_A);
+  fake_respond(con, OT_ERROR_RESPONSE_TIMEOUT);
+  zassert_false(observe_con_pending());
+}
+
+/*
+ * A non-confirmable notification after the confirmable one used to clear
+ * its pending flag, so the timeout of the confirmable one was ignored and
+ * the observer stayed forever.
+ */
+ZTEST(observe, test_unacknowledged_confirmable_removes_observer) {
+  int con_a;
+  int con_b;
+  int sent;
+  size_t index;
+
+  get_sensor(PEER_A, true);
+  get_sensor(PEER_B, true);
+  con_a = notify_until_confirmable(PEER_A);
+  con_b = sent_to(PEER_B, con_a);
+  zassert_true(con_b >= 0);
+  zassert_equal(fake_sent[con_b].p_message->type, OT_COAP_TYPE_CONFIRMABLE);
+  fake_respond(con_b, OT_ERROR_NONE);
+
+  /* The next notification is non-confirmable and only goes to B. */
+  index = fake_sent_count;
+  zassert_equal(observe_notify(payload, sizeof(payload) - 1), 0);
+  sent = sent_to(PEER_B, index);
+  zassert_true(sent >= 0);
+  zassert_equal(fake_sent[sent].p_message->type,
+                OT_COAP_TYPE_NON_CONFIRMABLE);
+  zassert_equal(sent_to(PEER_A, index), -1);
+
+  fake_respond(con_a, OT_ERROR_RESPONSE_TIMEOUT);
+
+  index = fake_sent_count;
+  zassert_equal(observe_notify(payload, sizeof(payload) - 1), 0);
+  zassert_equal(sent_to(PEER_A, index), -1);
+  zassert_true(sent_to(PEER_B, index) >= 0);
+
+  /* A's place is free again. */
+  get_sensor(PEER_C, true);
+  zassert_true(registered(PEER_C));
+}
+
+ZTEST_SUITE(observe, NULL, NULL, before, after, NULL);
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Check that the reports sent from the pre-built request template are the
+ * same bytes that the OpenThread CoAP API would build for them.
+ */
+
+#include <string.h>
+#include <zephyr/ztest.h>
+
+#include "fake_openthread.h"
+#include "publish.h"
+
+#define SENSOR_URI_PATH "sensor"
+
+static const uint8_t payload[] = "{\"temp\":21.50}";
+static otCoapOptionContentFormat content_format;
+
+void report_id_init(struct report_id *id,
+                    const uint8_t eui64[REPORT_EUI64_SIZE]) {
+  memcpy(id->eui64, eui64, REPORT_EUI64_SIZE);
+}
+
+otCoapOptionContentFormat report_content_format(void) {
+  return content_format;
+}
+
+/*
+ * Build the request with the OpenThread CoAP API, like publish.c does
+ * without the template, and encode it. Returns the length.
+ */
+static size_t coap_api_request(uint16_t message_id, uint8_t *p_buf,
+                               size_t size) {
+  otMessage *p_message = otCoapNewMessage(NULL, NULL);
+  size_t len;
+
+  otCoapMessageInit(p_message, OT_COAP_TYPE_NON_CONFIRMABLE, OT_COAP_CODE_PUT);
+  /* otCoapSendRequest() would pick the message ID. */
+  p_message->message_id = message_id;
+  zassert_equal(otCoapMessageAppendUriPathOptions(p_message, SENSOR_URI_PATH),
+                OT_ERROR_NONE);
+  zassert_equal(
+      otCoapMessageAppendContentFormatOption(p_message, content_format),
+      OT_ERROR_NONE);
+  otCoapMessageSetPayloadMarker(p_message);
+  otMessageAppend(p_message, payload, sizeof(payload) - 1);
+
+  len = fake_encode(p_message, p_buf, size);
+  otMessageFree(p_message);
+  return len;
+}
+
+/* Send a report from the template and compare it with the CoAP API's. */
+static void check_report(size_t index) {
+  uint8_t expected[FAKE_PAYLOAD_SIZE];
+  const otMessage *p_sent;
+  size_t len;
+
+  zassert_equal(publish_report(payload, sizeof(payload) - 1), 0);
+  zassert_equal(fake_sent_count, index + 1);
+  p_sent = fake_sent[index].p_message;
+
+  /* The message ID is bytes 2 and 3 of the header. */
+  zassert_true(p_sent->payload_len > 4);
+  len = coap_api_request(p_sent->payload[2] << 8 | p_sent->payload[3],
+                         expected, sizeof(expected));
+  zassert_equal(p_sent->payload_len, len);
+  zassert_mem_equal(p_sent->payload, expected, len);
+}
+
+static void before(void *fixture) {
+  fake_openthread_reset();
+}
+
+ZTEST(publish_template, test_json_request) {
+  content_format = OT_COAP_OPTION_CONTENT_FORMAT_JSON;
+  zassert_equal(publish_init(), 0);
+  check_report(0);
+}
+
+ZTEST(publish_template, test_cbor_request) {
+  content_format = OT_COAP_OPTION_CONTENT_FORMAT_CBOR;
+  zassert_equal(publish_init(), 0);
+  check_report(0);
+}
+
+ZTEST(publish_template, test_message_id_changes) {
+  const uint8_t *p_first;
+  const uint8_t *p_second;
+
+  content_format = OT_COAP_OPTION_CONTENT_FORMAT_JSON;
+  zassert_equal(publish_init(), 0);
+  check_report(0);
+  check_report(1);
+
+  p_first = fake_sent[0].p_message->payload;
+  p_second = fake_sent[1].p_message->payload;
+  zassert_equal((p_second[2] << 8 | p_second[3]) -
+                    (p_first[2] << 8 | p_first[3]),
+                1);
+}
+
+ZTEST(publish_template, test_sent_to_all_nodes) {
+  otIp6Address all_nodes;
+
+  content_format = OT_COAP_OPTION_CONTENT_FORMAT_JSON;
+  zassert_equal(publish_init(), 0);
+  check_report(0);
+
+  otIp6AddressFromString("ff03::1", &all_nodes);
+  zassert_true(
+      otIp6IsAddressEqual(&fake_sent[0].info.mPeerAddr, &all_nodes));
+  zassert_equal(fake_sent[0].info.mPeerPort, OT_DEFAULT_COAP_PORT);
+}
+
+ZTEST_SUITE(publish_template, NULL, NULL, before, NULL, NULL);
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Encode reports with report.c in the payload format of the build, and
+ * compare them with the JSON and CBOR payloads that test_payload_bme280.py
+ * decodes with the collector. The CBOR payloads have to fit in one IEEE
+ * 802.15.4 frame, where the JSON ones need 6LoWPAN fragmentation.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include "batch.h"
+#include "report.h"
+
+/* Largest IEEE 802.15.4 frame */
+#define FRAME_SIZE 127
+/*
+ * MAC header with short addresses and a compressed PAN ID (9), auxiliary
+ * security header (6), MIC-32 (4) and FCS (2)
+ */
+#define MAC_OVERHEAD 21
+/*
+ * IPHC dispatch (2), source IID (8) with the prefix from a context, inline
+ * destination address of the off-mesh collector (16), and UDP NHC with
+ * inline ports and checksum (7)
+ */
+#define LOWPAN_OVERHEAD 33
+/*
+ * CoAP header without token (4), Uri-Path "sensor" (7), Content-Format (2)
+ * and payload marker (1)
+ */
+#define COAP_OVERHEAD 14
+/* Payload that still fits in one frame, without 6LoWPAN fragmentation */
+#define PAYLOAD_BUDGET                                                         \
+  (FRAME_SIZE - MAC_OVERHEAD - LOWPAN_OVERHEAD - COAP_OVERHEAD)
+
+#define PAYLOAD_SIZE 256
+
+/* Readings of a sensor in 0.01 °C, Pa and 0.01 %, as the driver returns */
+#define READINGS(temp, press, hum)                                             \
+  {                                                                            \
+    {(temp) / 100, (temp) % 100 * 10000},                                      \
+        {(press) / 1000, (press) % 1000 * 1000},                               \
+        {(hum) / 100, (hum) % 100 * 10000},                                    \
+  }
+
+struct expected_report {
+  const char *p_name;
+  uint32_t seq;
+  uint32_t boot;
+  struct sensor_report readings[REPORT_SENSOR_COUNT];
+  const char *p_json;
+  uint8_t cbor[PAYLOAD_BUDGET];
+  size_t cbor_len;
+};
+
+static const uint8_t eui64[REPORT_EUI64_SIZE] = {0xF4, 0xCE, 0x36, 0xA1,
+                                                 0xB2, 0xC3, 0xD4, 0xE5};
+
+#if TEST_SENSOR_COUNT == 1
+static const struct expected_report reports[] = {
+    {
+        .p_name = "typical",
+        .seq = 1234,
+        .boot = 0x5A3C96E1,
+        .readings = {READINGS(2150, 101325, 4500)},
+        .p_json = "{\"id\":\"F4CE36A1B2C3D4E5\",\"seq\":1234,"
+                  "\"boot\":1513920225,\"temp\":21.50,\"press\":1013.25,"
+                  "\"hum\":45.00}",
+        .cbor = {0xA6, 0x00, 0x48, 0xF4, 0xCE, 0x36, 0xA1, 0xB2, 0xC3,
+                 0xD4, 0xE5, 0x0A, 0x19, 0x04, 0xD2, 0x0B, 0x1A, 0x5A,
+                 0x3C, 0x96, 0xE1, 0x01, 0x19, 0x08, 0x66, 0x02, 0x1A,
+                 0x00, 0x01, 0x8B, 0xCD, 0x03, 0x19, 0x11, 0x94},
+        .cbor_len = 35,
+    },
+    {
+        .p_name = "cold",
+        .seq = 17,
+        .boot = 1,
+        .readings = {READINGS(-1525, 98790, 8210)},
+        .p_json = "{\"id\":\"F4CE36A1B2C3D4E5\",\"seq\":17,\"boot\":1,"
+                  "\"temp\":-15.25,\"press\":987.90,\"hum\":82.10}",
+        .cbor = {0xA6, 0x00, 0x48, 0xF4, 0xCE, 0x36, 0xA1, 0xB2,
+                 0xC3, 0xD4, 0xE5, 0x0A, 0x11, 0x0B, 0x01, 0x01,
+                 0x39, 0x05, 0xF4, 0x02, 0x1A, 0x00, 0x01, 0x81,
+                 0xE6, 0x03, 0x19, 0x20, 0x12},
+        .cbor_len = 29,
+    },
+    {
+        .p_name = "largest",
+        .seq = UINT32_MAX,
+        .boot = UINT32_MAX,
+        .readings = {READINGS(-4000, 110000, 10000)},
+        .p_json = "{\"id\":\"F4CE36A1B2C3D4E5\",\"seq\":4294967295,"
+                  "\"boot\":4294967295,\"temp\":-40.00,\"press\":1100.00,"
+                  "\"hum\":100.00}",
+        .cbor = {0xA6, 0x00, 0x48, 0xF4, 0xCE, 0x36, 0xA1, 0xB2, 0xC3, 0xD4,
+                 0xE5, 0x0A, 0x1A, 0xFF, 0xFF, 0xFF, 0xFF, 0x0B, 0x1A, 0xFF,
+                 0xFF, 0xFF, 0xFF, 0x01, 0x39, 0x0F, 0x9F, 0x02, 0x1A, 0x00,
+                 0x01, 0xAD, 0xB0, 0x03, 0x19, 0x27, 0x10},
+        .cbor_len = 37,
+    },
+};
+#elif TEST_SENSOR_COUNT == 2
+static const struct expected_report reports[] = {
+    {
+        .p_name = "two sensors",
+        .seq = 1234,
+        .boot = 0x5A3C96E1,
+        .readings = {READINGS(2150, 101325, 4500),
+                     READINGS(2163, 101331, 4420)},
+        .p_json = "{\"id\":\"F4CE36A1B2C3D4E5\",\"seq\":1234,"
+                  "\"boot\":1513920225,\"sensors\":{\"0\":[21.50,1013.25,"
+                  "45.00],\"1\":[21.63,1013.31,44.20]}}",
+        .cbor = {0xA4, 0x00, 0x48, 0xF4, 0xCE, 0x36, 0xA1, 0xB2, 0xC3,
+                 0xD4, 0xE5, 0x0A, 0x19, 0x04, 0xD2, 0x0B, 0x1A, 0x5A,
+                 0x3C, 0x96, 0xE1, 0x07, 0xA2, 0x00, 0x83, 0x19, 0x08,
+                 0x66, 0x1A, 0x00, 0x01, 0x8B, 0xCD, 0x19, 0x11, 0x94,
+                 0x01, 0x83, 0x19, 0x08, 0x73, 0x1A, 0x00, 0x01, 0x8B,
+                 0xD3, 0x19, 0x11, 0x44},
+        .cbor_len = 49,
+    },
+};
+#endif
+
+/* Payload of a report in the format of the build, and its length */
+static const uint8_t *expected_payload(const struct expected_report *p_report,
+                                       size_t *p_len) {
+  if (IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR)) {
+    *p_len = p_report->cbor_len;
+    return p_report->cbor;
+  }
+
+  *p_len = strlen(p_report->p_json);
+  return (const uint8_t *)p_report->p_json;
+}
+
+static void report_id(const struct expected_report *p_report,
+                      struct report_id *p_id) {
+  report_id_init(p_id, eui64);
+  p_id->seq = p_report->seq;
+  p_id->boot = p_report->boot;
+}
+
+static void report_sample(const struct expected_report *p_report,
+                          uint32_t timestamp, struct sensor_sample *p_sample) {
+  p_sample->timestamp = timestamp;
+  memcpy(p_sample->report, p_report->readings, sizeof(p_sample->report));
+}
+
+ZTEST(report, test_content_format) {
+  zassert_equal(report_content_format(),
+                IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR)
+                    ? OT_COAP_OPTION_CONTENT_FORMAT_CBOR
+                    : OT_COAP_OPTION_CONTENT_FORMAT_JSON);
+}
+
+ZTEST(report, test_payloads) {
+  uint8_t buf[PAYLOAD_SIZE];
+
+  for (size_t i = 0; i < ARRAY_SIZE(reports); i++) {
+    struct report_id id;
+    struct sensor_sample sample;
+    const uint8_t *p_expected;
+    size_t len;
+
+    report_id(&reports[i], &id);
+    report_sample(&reports[i], 0, &sample);
+    p_expected = expected_payload(&reports[i], &len);
+
+    zassert_equal(report_encode(buf, sizeof(buf), &id, &sample), len, "%s",
+                  reports[i].p_name);
+    zassert_mem_equal(buf, p_expected, len, "%s", reports[i].p_name);
+  }
+}
+
+/*
+ * The payloads of both formats are checked against report.c by the builds
+ * of their format, so the sizes can be compared here.
+ */
+ZTEST(report, test_frame_budget) {
+  TC_PRINT("Payload budget in one frame: %d bytes\n", PAYLOAD_BUDGET);
+  for (size_t i = 0; i < ARRAY_SIZE(reports); i++) {
+    size_t json_len = strlen(reports[i].p_json);
+    size_t cbor_len = reports[i].cbor_len;
+
+    TC_PRINT("%s: JSON %zu bytes, CBOR %zu bytes\n", reports[i].p_name,
+             json_len, cbor_len);
+    zassert_true(cbor_len <= PAYLOAD_BUDGET, "%s", reports[i].p_name);
+    zassert_true(json_len > PAYLOAD_BUDGET, "%s", reports[i].p_name);
+    zassert_true(2 * cbor_len < json_len, "%s", reports[i].p_name);
+  }
+}
+
+/* A JSON payload also needs room for the terminating null character. */
+ZTEST(report, test_buffer_too_small) {
+  uint8_t buf[PAYLOAD_SIZE];
+  size_t extra = IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR) ? 0 : 1;
+
+  for (size_t i = 0; i < ARRAY_SIZE(reports); i++) {
+    struct report_id id;
+    struct sensor_sample sample;
+    size_t len;
+
+    report_id(&reports[i], &id);
+    report_sample(&reports[i], 0, &sample);
+    expected_payload(&reports[i], &len);
+
+    for (size_t size = 0; size < len + extra; size++) {
+      zassert_equal(report_encode(buf, size, &id, &sample), -ENOMEM,
+                    "%s in %zu bytes", reports[i].p_name, size);
+    }
+    zassert_equal(report_encode(buf, len + extra, &id, &sample), len, "%s",
+                  reports[i].p_name);
+  }
+}
+
+/* Batch of a sample of each report, the second one 5005 ms later */
+static void report_batch(struct sample_batch *p_batch) {
+  struct sensor_sample sample;
+
+  *p_batch = (struct sample_batch){0};
+  report_sample(&reports[0], 1000, &sample);
+  batch_add(p_batch, &sample);
+  report_sample(&reports[ARRAY_SIZE(reports) - 1], 6005, &sample);
+  batch_add(p_batch, &sample);
+}
+
+/* Offset of needle in the payload, or -1 if it isn't in there */
+static int find(const uint8_t *p_payload, size_t len, const void *p_needle,
+                size_t needle_len) {
+  for (size_t i = 0; i + needle_len <= len; i++) {
+    if (memcmp(&p_payload[i], p_needle, needle_len) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ * A batch report of an earlier boot is the same report without the uptime
+ * entry, so the collector can't date its samples.
+ */
+ZTEST(report, test_batch_without_uptime) {
+  static const char json_uptime[] = ",\"up\":12000";
+  static const uint8_t cbor_uptime[] = {0x05, 0x19, 0x2E, 0xE0};
+  const uint8_t *p_uptime = IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR)
+                                ? cbor_uptime
+                                : (const uint8_t *)json_uptime;
+  size_t uptime_len = IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR)
+                          ? sizeof(cbor_uptime)
+                          : sizeof(json_uptime) - 1;
+  struct sample_batch batch;
+  struct report_id id;
+  uint8_t with[PAYLOAD_SIZE];
+  uint8_t without[PAYLOAD_SIZE];
+  uint32_t now = 12000;
+  int with_len;
+  int without_len;
+  int offset;
+
+  report_id(&reports[0], &id);
+  report_batch(&batch);
+  with_len = report_encode_batch(with, sizeof(with), &id, &batch, &now);
+  without_len = report_encode_batch(without, sizeof(without), &id, &batch,
+                                    NULL);
+  zassert_true(with_len > 0);
+  zassert_equal(without_len, with_len - uptime_len);
+
+  offset = find(with, with_len, p_uptime, uptime_len);
+  zassert_true(offset > 0);
+  zassert_equal(find(without, without_len, p_uptime, uptime_len), -1);
+  zassert_mem_equal(&without[1], &with[1], offset - 1);
+  zassert_mem_equal(&without[offset], &with[offset + uptime_len],
+                    without_len - offset);
+
+  /* The CBOR map has one entry less. */
+  zassert_equal(without[0],
+                IS_ENABLED(CONFIG_APP_PAYLOAD_CBOR) ? with[0] - 1 : with[0]);
+}
+
+ZTEST(report, test_empty_batch) {
+  struct sample_batch batch = {0};
+  struct report_id id;
+  uint8_t buf[PAYLOAD_SIZE];
+  uint32_t now = 0;
+
+  report_id(&reports[0], &id);
+  zassert_equal(report_encode_batch(buf, sizeof(buf), &id, &batch, &now),
+                -ENODATA);
+}
+
+ZTEST_SUITE(report, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Check the bounds of the random phase, jitter and backoff of the schedule,
+ * and that a fleet of nodes with sequential EUI-64s that boots at the same
+ * time spreads its reports over the sample interval.
+ */
+
+#include <stdlib.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include "schedule.h"
+
+/* PUBLISH_RETRY_DELAY in main.c */
+#define PUBLISH_RETRY_DELAY 500
+/* Airtime in ms of a full IEEE 802.15.4 frame at 250 kbit/s with its ACK */
+#define AIRTIME 5
+/* EUI-64 of the first node of a fleet, the others count up from it */
+#define FIRST_EUI64 0xF4CE36A1B2C30000ULL
+
+#define NODES 50
+#define HOUR 3600000
+#define SAMPLES (HOUR / CONFIG_APP_SAMPLE_INTERVAL)
+
+struct frame {
+  uint32_t start;
+  uint32_t node;
+};
+
+static void init_node(uint32_t node) {
+  uint8_t eui64[REPORT_EUI64_SIZE];
+
+  sys_put_be64(FIRST_EUI64 + node, eui64);
+  schedule_init(eui64);
+}
+
+static int compare_uint32(const void *p_a, const void *p_b) {
+  uint32_t a = *(const uint32_t *)p_a;
+  uint32_t b = *(const uint32_t *)p_b;
+
+  return (a > b) - (a < b);
+}
+
+static int compare_frames(const void *p_a, const void *p_b) {
+  return compare_uint32(&((const struct frame *)p_a)->start,
+                        &((const struct frame *)p_b)->start);
+}
+
+ZTEST(schedule, test_seeded_from_eui64) {
+  uint32_t first[8];
+
+  init_node(0);
+  for (size_t i = 0; i < ARRAY_SIZE(first); i++) {
+    first[i] = schedule_phase();
+  }
+
+  init_node(0);
+  for (size_t i = 0; i < ARRAY_SIZE(first); i++) {
+    zassert_equal(schedule_phase(), first[i]);
+  }
+
+  init_node(1);
+  zassert_not_equal(schedule_phase(), first[0]);
+}
+
+ZTEST(schedule, test_phases_of_sequential_eui64s_spread_out) {
+  uint32_t phases[200];
+  uint32_t distinct = 1;
+  uint32_t largest_gap = 0;
+
+  for (uint32_t i = 0; i < ARRAY_SIZE(phases); i++) {
+    init_node(i);
+    phases[i] = schedule_phase();
+    zassert_true(phases[i] < CONFIG_APP_SAMPLE_INTERVAL);
+  }
+
+  qsort(phases, ARRAY_SIZE(phases), sizeof(phases[0]), compare_uint32);
+  for (size_t i = 1; i < ARRAY_SIZE(phases); i++) {
+    distinct += phases[i] != phases[i - 1];
+    largest_gap = MAX(largest_gap, phases[i] - phases[i - 1]);
+  }
+
+  /* About 4 of 200 phases drawn from 5000 values are expected to repeat. */
+  zassert_true(distinct > 190, "%u distinct phases", distinct);
+  zassert_true(largest_gap < 250, "gap of %u ms", largest_gap);
+}
+
+ZTEST(schedule, test_jitter_bounds) {
+  int32_t min = 0;
+  int32_t max = 0;
+
+  init_node(0);
+  for (int i = 0; i < 10000; i++) {
+    int32_t jitter = schedule_jitter();
+
+    min = MIN(min, jitter);
+    max = MAX(max, jitter);
+  }
+
+  zassert_equal(min, -CONFIG_APP_SAMPLE_JITTER);
+  zassert_equal(max, CONFIG_APP_SAMPLE_JITTER);
+}
+
+/* Half to all of the retry delay doubled per retry, up to the maximum */
+ZTEST(schedule, test_backoff_bounds) {
+  init_node(0);
+  for (uint32_t retries = 1; retries < 10; retries++) {
+    uint32_t delay = MIN(PUBLISH_RETRY_DELAY << (retries - 1),
+                         CONFIG_APP_PUBLISH_BACKOFF_MAX);
+    uint32_t min = UINT32_MAX;
+    uint32_t max = 0;
+
+    for (int i = 0; i < 1000; i++) {
+      uint32_t backoff = schedule_backoff(PUBLISH_RETRY_DELAY, retries);
+
+      min = MIN(min, backoff);
+      max = MAX(max, backoff);
+    }
+
+    zassert_true(min >= delay / 2, "retry %u: %u ms", retries, min);
+    zassert_true(max <= delay, "retry %u: %u ms", retries, max);
+  }
+}
+
+/*
+ * Sample every node of a fleet that boots at the same time for an hour, at
+ * its phase and then at each slot with its jitter, and count the frames
+ * that start within an airtime of a frame of another node.
+ */
+ZTEST(schedule, test_spread_fleet_rarely_contends) {
+  static struct frame frames[NODES * SAMPLES];
+  uint32_t contending = 0;
+  size_t count = 0;
+
+  for (uint32_t node = 0; node < NODES; node++) {
+    uint32_t slot;
+
+    init_node(node);
+    slot = schedule_phase();
+    frames[count++] = (struct frame){slot, node};
+    for (uint32_t i = 1; i < SAMPLES; i++) {
+      slot += CONFIG_APP_SAMPLE_INTERVAL;
+      frames[count++] = (struct frame){slot + schedule_jitter(), node};
+    }
+  }
+
+  qsort(frames, count, sizeof(frames[0]), compare_frames);
+  for (size_t i = 0; i < count; i++) {
+    bool before = i > 0 && frames[i].start - frames[i - 1].start < AIRTIME &&
+                  frames[i - 1].node != frames[i].node;
+    bool after = i + 1 < count &&
+                 frames[i + 1].start - frames[i].start < AIRTIME &&
+                 frames[i + 1].node != frames[i].node;
+
+    contending += before || after;
+  }
+
+  TC_PRINT("%u of %zu frames contend\n", contending, count);
+  /* 50 nodes sending a 5 ms frame every 5 s keep the channel 5 % busy. */
+  zassert_true(contending < 15 * count / 100);
+}
+
+ZTEST_SUITE(schedule, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Append samples to the sample log in an in-memory NVS, read them back and
+ * forward them, and check what a reboot recovers from the flash.
+ */
+
+#include <errno.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/ztest.h>
+
+#include "fake_nvs.h"
+#include "store.h"
+
+#define SLOTS CONFIG_APP_STORE_SLOTS
+/* NVS ID of the first record slot in store.c */
+#define STORE_ID_RECORD 16
+
+/* Sample number i, with made-up readings */
+static struct sensor_sample sample(uint32_t i) {
+  return (struct sensor_sample){
+      .timestamp = i * 5000,
+      .report = {{.temp = {20 + i % 10, 500000},
+                  .press = {101, 325000},
+                  .hum = {40 + i % 5, 0}}},
+  };
+}
+
+static void append_samples(uint32_t first, uint32_t count) {
+  for (uint32_t i = first; i < first + count; i++) {
+    struct sensor_sample s = sample(i);
+
+    zassert_equal(store_append(&s), 0, "sample %u", i);
+  }
+}
+
+/* Check that record seq has sample number i of the given boot. */
+static void check_record(uint32_t seq, uint32_t i, uint32_t boot) {
+  struct sensor_sample expected = sample(i);
+  struct store_record record;
+
+  zassert_equal(store_read(seq, &record), 0, "record %u", seq);
+  zassert_equal(record.seq, seq);
+  zassert_equal(record.boot, boot, "record %u", seq);
+  zassert_mem_equal(&record.sample, &expected, sizeof(expected), "record %u",
+                    seq);
+}
+
+static void before(void *fixture) {
+  fake_nvs_reset();
+  zassert_equal(store_init(), 0);
+}
+
+ZTEST(store, test_empty_log) {
+  struct store_record record;
+
+  zassert_equal(store_boot(), 1);
+  zassert_equal(store_head(), 0);
+  zassert_equal(store_unsent_count(), 0);
+  zassert_equal(store_read(0, &record), -ENOENT);
+}
+
+ZTEST(store, test_append_and_read) {
+  struct store_record record;
+
+  append_samples(0, 3);
+  zassert_equal(store_head(), 3);
+  zassert_equal(store_unsent(), 0);
+  zassert_equal(store_unsent_count(), 3);
+  for (uint32_t seq = 0; seq < 3; seq++) {
+    check_record(seq, seq, 1);
+  }
+  zassert_equal(store_read(3, &record), -ENOENT);
+}
+
+/* A full log overwrites its oldest records, even if they're unsent. */
+ZTEST(store, test_full_log_overwrites_oldest) {
+  struct store_record record;
+
+  append_samples(0, SLOTS + 2);
+  zassert_equal(store_unsent(), 2);
+  zassert_equal(store_unsent_count(), SLOTS);
+  zassert_equal(store_read(1, &record), -ENOENT);
+  for (uint32_t seq = 2; seq < SLOTS + 2; seq++) {
+    check_record(seq, seq, 1);
+  }
+}
+
+ZTEST(store, test_mark_sent) {
+  size_t writes;
+
+  append_samples(0, 5);
+  writes = fake_nvs_writes;
+  zassert_equal(store_mark_sent(3), 0);
+  zassert_equal(fake_nvs_writes, writes + 1);
+  zassert_equal(store_unsent(), 3);
+  zassert_equal(store_unsent_count(), 2);
+}
+
+/* The head, watermark and boot count are recovered after a reboot. */
+ZTEST(store, test_recovered_after_reboot) {
+  append_samples(0, 5);
+  zassert_equal(store_mark_sent(3), 0);
+
+  zassert_equal(store_init(), 0);
+  zassert_equal(store_boot(), 2);
+  zassert_equal(store_head(), 5);
+  zassert_equal(store_unsent(), 3);
+
+  append_samples(5, 2);
+  check_record(4, 4, 1);
+  check_record(5, 5, 2);
+  zassert_equal(store_unsent_count(), 4);
+}
+
+/* Without a watermark, the records of the last boot are all unsent. */
+ZTEST(store, test_unsent_without_watermark) {
+  append_samples(0, 5);
+
+  zassert_equal(store_init(), 0);
+  zassert_equal(store_head(), 5);
+  zassert_equal(store_unsent(), 0);
+  zassert_equal(store_unsent_count(), 5);
+}
+
+/* Records overwritten before the reboot aren't unsent after it. */
+ZTEST(store, test_watermark_behind_the_log) {
+  append_samples(0, 2 * SLOTS);
+
+  zassert_equal(store_init(), 0);
+  zassert_equal(store_head(), 2 * SLOTS);
+  zassert_equal(store_unsent(), SLOTS);
+  zassert_equal(store_unsent_count(), SLOTS);
+}
+
+/* The head is recovered with serial number comparison across a wrap. */
+ZTEST(store, test_sequence_number_wraps) {
+  struct nvs_fs fs = {.flash_device = &fake_flash_device};
+
+  for (uint32_t seq = UINT32_MAX - 2; seq != 2; seq++) {
+    struct store_record record = {.seq = seq, .boot = 1, .sample = sample(seq)};
+
+    zassert_equal(nvs_write(&fs, STORE_ID_RECORD + seq % SLOTS, &record,
+                            sizeof(record)),
+                  sizeof(record));
+  }
+
+  zassert_equal(store_init(), 0);
+  zassert_equal(store_head(), 2);
+  check_record(UINT32_MAX, UINT32_MAX, 1);
+  check_record(1, 1, 1);
+}
+
+ZTEST_SUITE(store, NULL, NULL, before, NULL, NULL);
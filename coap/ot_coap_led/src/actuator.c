@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "actuator.h"
+
+#include <string.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/spsc_lockfree.h>
+
+LOG_MODULE_DECLARE(ot_coap_led);
+
+#define ACTUATOR_STACK_SIZE 1024
+#define ACTUATOR_PRIORITY 5
+
+/* All okay children of "gpio-leds" devicetree nodes, indexed by LED index */
+#define LED_SPEC_AND_COMMA(node_id) GPIO_DT_SPEC_GET(node_id, gpios),
+#define LED_CHILDREN(node_id)                                                  \
+  DT_FOREACH_CHILD_STATUS_OKAY(node_id, LED_SPEC_AND_COMMA)
+static const struct gpio_dt_spec leds[] = {
+    DT_FOREACH_STATUS_OKAY(gpio_leds, LED_CHILDREN)};
+
+BUILD_ASSERT(ARRAY_SIZE(leds) > 0, "No okay gpio-leds devicetree node");
+BUILD_ASSERT(ARRAY_SIZE(leds) <= ACTUATOR_MAX_LEDS, "Too many LEDs");
+
+/* A change is resolved when it's queued, so the queue only holds states. */
+struct led_cmd {
+  timing_t start;
+  uint32_t state;
+};
+
+K_THREAD_STACK_DEFINE(actuator_stack, ACTUATOR_STACK_SIZE);
+static struct k_work_q actuator_workq;
+
+static void actuator_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(actuator_work, actuator_work_handler);
+
+/* LED commands from the CoAP handler (producer) to the actuator. */
+SPSC_DEFINE(command_queue, struct led_cmd, CONFIG_APP_ACTUATOR_QUEUE_SIZE);
+
+/*
+ * State after the queued commands, only used in the OpenThread thread or
+ * with the OpenThread API mutex held
+ */
+static uint32_t led_target;
+static uint32_t commands_dropped;
+
+#if defined(CONFIG_APP_ACTUATOR_STATS)
+static struct cycle_stats {
+  uint64_t min;
+  uint64_t max;
+  uint64_t total;
+  uint32_t count;
+} handler_stats, latency_stats;
+
+static uint32_t cycles_to_us(uint64_t cycles) {
+  return (uint32_t)(timing_cycles_to_ns(cycles) / NSEC_PER_USEC);
+}
+
+static void cycle_stats_record(struct cycle_stats *p_stats, const char *name,
+                               timing_t start) {
+  timing_t end = timing_counter_get();
+  uint64_t cycles = timing_cycles_get(&start, &end);
+
+  if (p_stats->count == 0 || cycles < p_stats->min) {
+    p_stats->min = cycles;
+  }
+  if (cycles > p_stats->max) {
+    p_stats->max = cycles;
+  }
+  p_stats->total += cycles;
+  p_stats->count++;
+
+  if (p_stats->count == CONFIG_APP_ACTUATOR_STATS_INTERVAL) {
+    LOG_INF("%s: min %u us, avg %u us, max %u us "
+            "(avg %u cycles at %u MHz)",
+            name, cycles_to_us(p_stats->min),
+            (uint32_t)(timing_cycles_to_ns_avg(p_stats->total,
+                                               p_stats->count) /
+                       NSEC_PER_USEC),
+            cycles_to_us(p_stats->max),
+            (uint32_t)(p_stats->total / p_stats->count),
+            timing_freq_get_mhz());
+    memset(p_stats, 0, sizeof(*p_stats));
+  }
+}
+
+/* Called in the OpenThread thread only, like actuator_submit(). */
+void actuator_handler_time_record(timing_t start) {
+  cycle_stats_record(&handler_stats, "Handler time", start);
+}
+#endif
+
+/*
+ * Set all LEDs to the state with one masked write per GPIO port, so the LEDs
+ * on the same port change at the same time.
+ */
+static int leds_set(uint32_t state) {
+  const struct device *ports[ARRAY_SIZE(leds)];
+  gpio_port_pins_t masks[ARRAY_SIZE(leds)];
+  gpio_port_value_t values[ARRAY_SIZE(leds)];
+  size_t port_count = 0;
+  size_t port;
+  int ret = 0;
+
+  for (size_t i = 0; i < ARRAY_SIZE(leds); i++) {
+    for (port = 0; port < port_count; port++) {
+      if (ports[port] == leds[i].port) {
+        break;
+      }
+    }
+    if (port == port_count) {
+      ports[port] = leds[i].port;
+      masks[port] = 0;
+      values[port] = 0;
+      port_count++;
+    }
+
+    masks[port] |= BIT(leds[i].pin);
+    if (state & BIT(i)) {
+      values[port] |= BIT(leds[i].pin);
+    }
+  }
+
+  for (port = 0; port < port_count; port++) {
+    int err = gpio_port_set_masked(ports[port], masks[port], values[port]);
+
+    if (err < 0) {
+      ret = err;
+    }
+  }
+  return ret;
+}
+
+static void actuator_work_handler(struct k_work *work) {
+  struct led_cmd *p_cmd;
+  int ret;
+
+  while ((p_cmd = spsc_consume(&command_queue)) != NULL) {
+    ret = leds_set(p_cmd->state);
+#if defined(CONFIG_APP_ACTUATOR_STATS)
+    cycle_stats_record(&latency_stats, "Actuation latency", p_cmd->start);
+#endif
+    if (ret < 0) {
+      LOG_ERR("Failed to set LEDs: %d", ret);
+    } else {
+      LOG_INF("LEDs 0x%08x", p_cmd->state);
+    }
+    spsc_release(&command_queue);
+  }
+}
+
+int actuator_submit(const struct led_change *p_change, timing_t start) {
+  struct led_cmd *p_cmd = spsc_acquire(&command_queue);
+
+  if (p_cmd == NULL) {
+    commands_dropped++;
+    LOG_WRN("Actuator queue full (%u commands dropped)", commands_dropped);
+    return -ENOBUFS;
+  }
+
+  led_target &= ~p_change->off;
+  led_target |= p_change->on;
+  led_target ^= p_change->toggle;
+  led_target &= BIT64_MASK(ARRAY_SIZE(leds));
+  p_cmd->state = led_target;
+  p_cmd->start = start;
+  spsc_produce(&command_queue);
+
+  k_work_submit_to_queue(&actuator_workq, &actuator_work);
+  return 0;
+}
+
+uint32_t actuator_state(void) { return led_target; }
+
+size_t actuator_state_vector(char *buf) {
+  for (size_t i = 0; i < ARRAY_SIZE(leds); i++) {
+    buf[i] = led_target & BIT(i) ? '1' : '0';
+  }
+
+  return ARRAY_SIZE(leds);
+}
+
+size_t actuator_count(void) { return ARRAY_SIZE(leds); }
+
+int actuator_init(void) {
+  int ret;
+
+  for (size_t i = 0; i < ARRAY_SIZE(leds); i++) {
+    if (!gpio_is_ready_dt(&leds[i])) {
+      return -ENODEV;
+    }
+
+    ret = gpio_pin_configure_dt(&leds[i], GPIO_OUTPUT_INACTIVE);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+#if defined(CONFIG_APP_ACTUATOR_STATS)
+  timing_init();
+  timing_start();
+#endif
+
+  k_work_queue_start(&actuator_workq, actuator_stack,
+                     K_THREAD_STACK_SIZEOF(actuator_stack), ACTUATOR_PRIORITY,
+                     &(struct k_work_queue_config){.name = "actuator_workq"});
+  return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ACTUATOR_H_
+#define ACTUATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/timing/timing.h>
+
+/* The LED states are a bitmask, so there are at most this many LEDs. */
+#define ACTUATOR_MAX_LEDS 32
+
+/*
+ * Change of the LEDs by one command, as bitmasks by LED index. The LEDs in
+ * off are turned off, the ones in on turned on, and then the ones in toggle
+ * are toggled.
+ */
+struct led_change {
+  uint32_t off;
+  uint32_t on;
+  uint32_t toggle;
+};
+
+/*
+ * Configure the LEDs and start the work queue that applies the LED commands.
+ *
+ * Returns 0 on success, -ENODEV if an LED isn't ready, or a negative error
+ * code if one can't be configured.
+ */
+int actuator_init(void);
+
+/*
+ * Number of LEDs: all okay children of gpio-leds nodes in the devicetree, in
+ * devicetree order.
+ */
+size_t actuator_count(void);
+
+/*
+ * Queue a change of the LEDs for the actuator, which applies it to all LEDs
+ * at once. The start argument is the timing counter at the start of the
+ * request handler from actuator_timing_start(), to measure the latency until
+ * the LEDs are set. Only call
+ * this in the OpenThread thread or with the OpenThread API mutex held, so
+ * there's only one producer at a time.
+ *
+ * Returns 0 on success, or -ENOBUFS if the queue is full.
+ */
+int actuator_submit(const struct led_change *p_change, timing_t start);
+
+/*
+ * State of the LEDs by index after all queued commands are applied, which is
+ * what a response reports.
+ */
+uint32_t actuator_state(void);
+
+/*
+ * Write the state as a '0' or '1' per LED in buf, starting at LED 0, which
+ * must have room for ACTUATOR_MAX_LEDS characters.
+ *
+ * Returns the number of LEDs.
+ */
+size_t actuator_state_vector(char *buf);
+
+#if defined(CONFIG_APP_ACTUATOR_STATS)
+/* Read the timing counter at the start of the request handler. */
+static inline timing_t actuator_timing_start(void) {
+  return timing_counter_get();
+}
+
+/*
+ * Record the time that the request handler took since the start given by
+ * actuator_timing_start().
+ */
+void actuator_handler_time_record(timing_t start);
+#else
+static inline timing_t actuator_timing_start(void) { return 0; }
+static inline void actuator_handler_time_record(timing_t start) {}
+#endif
+
+#endif /* ACTUATOR_H_ */
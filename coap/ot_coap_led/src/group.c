@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "group.h"
+
+#include <errno.h>
+#include <openthread/ip6.h>
+#include <openthread/random_noncrypto.h>
+#include <openthread/thread.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+
+LOG_MODULE_DECLARE(ot_coap_led);
+
+/* Number of responses to multicast requests that can wait at the same time */
+#define GROUP_MAX_DELAYED 4
+
+struct delayed_response {
+  struct k_work_delayable work;
+  otMessage *p_message;
+  otMessageInfo message_info;
+};
+
+static struct delayed_response delayed[GROUP_MAX_DELAYED];
+
+static void delayed_work_handler(struct k_work *work) {
+  struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+  struct delayed_response *p_delayed =
+      CONTAINER_OF(dwork, struct delayed_response, work);
+  struct openthread_context *ot_context = openthread_get_default_context();
+  otError error;
+
+  openthread_api_mutex_lock(ot_context);
+  error = otCoapSendResponse(openthread_get_default_instance(),
+                             p_delayed->p_message, &p_delayed->message_info);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to send CoAP Response: %s", otThreadErrorToString(error));
+    otMessageFree(p_delayed->p_message);
+  }
+  p_delayed->p_message = NULL;
+  openthread_api_mutex_unlock(ot_context);
+}
+
+int group_send_response_later(otMessage *p_response,
+                              const otMessageInfo *p_message_info) {
+  struct delayed_response *p_delayed = NULL;
+  uint32_t leisure;
+
+  for (size_t i = 0; i < ARRAY_SIZE(delayed); i++) {
+    if (delayed[i].p_message == NULL) {
+      p_delayed = &delayed[i];
+      break;
+    }
+  }
+
+  if (p_delayed == NULL) {
+    return -ENOBUFS;
+  }
+
+  p_delayed->p_message = p_response;
+  p_delayed->message_info = *p_message_info;
+  /* Let OpenThread pick a unicast source address for the response. */
+  memset(&p_delayed->message_info.mSockAddr, 0,
+         sizeof(p_delayed->message_info.mSockAddr));
+
+  leisure = otRandomNonCryptoGetUint32() % (CONFIG_APP_MULTICAST_LEISURE + 1);
+  k_work_schedule(&p_delayed->work, K_MSEC(leisure));
+  return 0;
+}
+
+int group_join(void) {
+  otInstance *p_instance = openthread_get_default_instance();
+  otIp6Address group;
+  otError error;
+
+  for (size_t i = 0; i < ARRAY_SIZE(delayed); i++) {
+    k_work_init_delayable(&delayed[i].work, delayed_work_handler);
+  }
+
+  error = otIp6AddressFromString(CONFIG_APP_MULTICAST_GROUP, &group);
+  if (error == OT_ERROR_NONE) {
+    error = otIp6SubscribeMulticastAddress(p_instance, &group);
+  }
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Cannot join multicast group %s: %s", CONFIG_APP_MULTICAST_GROUP,
+            otThreadErrorToString(error));
+    return -EIO;
+  }
+
+  LOG_INF("Joined multicast group %s", CONFIG_APP_MULTICAST_GROUP);
+  return 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef GROUP_H_
+#define GROUP_H_
+
+#include <openthread/coap.h>
+#include <stdbool.h>
+
+/* Subscribe to the multicast group CONFIG_APP_MULTICAST_GROUP. */
+int group_join(void);
+
+/* Whether the request was sent to a multicast address. */
+static inline bool group_is_multicast(const otMessageInfo *p_message_info) {
+  return p_message_info->mSockAddr.mFields.m8[0] == 0xff;
+}
+
+/*
+ * Send the response to a multicast request after a random leisure of up to
+ * CONFIG_APP_MULTICAST_LEISURE milliseconds (RFC 7252, section 8.2), so the
+ * responses of the group members don't all arrive at once. The response is
+ * sent from a unicast address of the node. Takes over the response message.
+ *
+ * Returns 0 on success, or -ENOBUFS if too many responses are waiting.
+ */
+int group_send_response_later(otMessage *p_response,
+                              const otMessageInfo *p_message_info);
+
+#endif /* GROUP_H_ */
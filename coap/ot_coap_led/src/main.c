@@ -6,72 +6,274 @@
 
 #include <openthread/coap.h>
 #include <openthread/thread.h>
+#include <string.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/net/openthread.h>
 
+#include "actuator.h"
+#include "group.h"
+#include "observe.h"
+#include "schedule.h"
+
 LOG_MODULE_REGISTER(ot_coap_led, LOG_LEVEL_DBG);
 
-#define LED0_NODE DT_ALIAS(led0)
-#if !DT_NODE_HAS_STATUS(LED0_NODE, okay)
-#error "Unsupported board: led0 devicetree alias is not defined"
-#endif
-static const struct gpio_dt_spec led = GPIO_DT_SPEC_GET(LED0_NODE, gpios);
+/* No-Response option (RFC 7967) and its bit to suppress 2.xx responses */
+#define COAP_OPTION_NO_RESPONSE 258
+#define NO_RESPONSE_SUCCESS BIT(1)
+
+/* Longest decimal 64-bit time, and a command vector scheduled at it */
+#define TIME_MAX_LEN (sizeof("18446744073709551615") - 1)
+#define LED_PAYLOAD_MAX_LEN (ACTUATOR_MAX_LEDS + 1 + TIME_MAX_LEN)
 
-int led_state = 0;
+#if defined(CONFIG_APP_LED_BUTTON)
+#define SW0_NODE DT_ALIAS(sw0)
+#if !DT_NODE_HAS_STATUS(SW0_NODE, okay)
+#error "Unsupported board: sw0 devicetree alias is not defined"
+#endif
+static const struct gpio_dt_spec button = GPIO_DT_SPEC_GET(SW0_NODE, gpios);
+static struct gpio_callback button_cb_data;
+#endif
 
 static void led_requested(void *p_context, otMessage *p_message,
                           const otMessageInfo *p_message_info);
 static void led_send_response(otMessage *p_request_message,
-                              const otMessageInfo *p_message_info);
+                              const otMessageInfo *p_message_info,
+                              bool observe);
+static void led_send_ack(otMessage *p_request_message,
+                         const otMessageInfo *p_message_info,
+                         otCoapCode response_code);
 
 static otCoapResource led_resource = {.mUriPath = "led",
                                       .mHandler = led_requested,
                                       .mContext = NULL,
                                       .mNext = NULL};
 
+#if defined(CONFIG_APP_SCHEDULE)
+static void time_requested(void *p_context, otMessage *p_message,
+                           const otMessageInfo *p_message_info);
+
+static otCoapResource time_resource = {.mUriPath = "time",
+                                       .mHandler = time_requested,
+                                       .mContext = NULL,
+                                       .mNext = NULL};
+#endif
+
+/*
+ * Parse a command vector with a character per LED, starting at LED 0: '0'
+ * turns the LED off, '1' on, '2' toggles it and '-' leaves it as it is. The
+ * LEDs after the end of the vector are left as they are too, so the payload
+ * "1" turns on LED 0 like it did with a single LED.
+ *
+ * Returns 0 on success, or -EINVAL if the vector is empty, longer than the
+ * number of LEDs or has another character.
+ */
+static int led_parse(const char *p_buf, uint16_t len,
+                     struct led_change *p_change) {
+  *p_change = (struct led_change){0};
+
+  if (len == 0 || len > actuator_count()) {
+    return -EINVAL;
+  }
+
+  for (uint16_t i = 0; i < len; i++) {
+    switch (p_buf[i]) {
+    case '0':
+      p_change->off |= BIT(i);
+      break;
+    case '1':
+      p_change->on |= BIT(i);
+      break;
+    case '2':
+      p_change->toggle |= BIT(i);
+      break;
+    case '-':
+      break;
+    default:
+      return -EINVAL;
+    }
+  }
+
+  return 0;
+}
+
+#if defined(CONFIG_APP_SCHEDULE)
+/*
+ * Parse a scheduled command: a command vector, then '@' and the time in
+ * microseconds to carry it out at, as a decimal number.
+ *
+ * Returns 0 on success, or -EINVAL if the vector or the time is invalid or
+ * the time doesn't fit in 64 bits.
+ */
+static int led_parse_scheduled(const char *p_buf, uint16_t len,
+                               struct led_change *p_change, uint64_t *p_at) {
+  const char *p_time = memchr(p_buf, '@', MIN(len, LED_PAYLOAD_MAX_LEN));
+  uint16_t time_len;
+
+  *p_at = 0;
+
+  if (p_time == NULL || len > LED_PAYLOAD_MAX_LEN) {
+    return -EINVAL;
+  }
+
+  time_len = len - (p_time - p_buf) - 1;
+  if (time_len == 0 || time_len > TIME_MAX_LEN) {
+    return -EINVAL;
+  }
+
+  for (uint16_t i = 1; i <= time_len; i++) {
+    uint8_t digit;
+
+    if (p_time[i] < '0' || p_time[i] > '9') {
+      return -EINVAL;
+    }
+    digit = p_time[i] - '0';
+    if (*p_at > (UINT64_MAX - digit) / 10) {
+      return -EINVAL;
+    }
+    *p_at = *p_at * 10 + digit;
+  }
+
+  return led_parse(p_buf, p_time - p_buf, p_change);
+}
+#endif
+
+/*
+ * Queue a change of the LEDs, and notify the observers if the state changes.
+ * Call this in the OpenThread thread or with the OpenThread API mutex held.
+ *
+ * Returns 0 on success, or -ENOBUFS if the actuator queue is full.
+ */
+static int led_apply(const struct led_change *p_change, timing_t start) {
+  uint32_t state = actuator_state();
+  int ret = actuator_submit(p_change, start);
+
+  if (ret == 0 && actuator_state() != state) {
+    observe_changed();
+  }
+  return ret;
+}
+
+#if defined(CONFIG_APP_SCHEDULE)
+/* Called by the scheduler with the OpenThread API mutex held. */
+static void led_scheduled(const struct led_change *p_change) {
+  led_apply(p_change, actuator_timing_start());
+}
+
+/*
+ * Carry out a change at the given time in the scheduler's clock, or right
+ * away if that time has passed already.
+ *
+ * Returns 0 on success, or the error of schedule_submit() or led_apply().
+ */
+static int led_schedule(const struct led_change *p_change, uint64_t at,
+                        timing_t start) {
+  int ret = schedule_submit(p_change, at);
+
+  if (ret == -ETIME) {
+    LOG_WRN("Scheduled command arrived too late, carrying it out now");
+    return led_apply(p_change, start);
+  } else if (ret < 0) {
+    LOG_ERR("Failed to schedule LED command: %d", ret);
+  }
+  return ret;
+}
+#endif
+
+/*
+ * Runs in the OpenThread thread, so it only checks the request and queues
+ * the LED command. The actuator's work queue sets the LEDs.
+ */
 static void led_requested(void *p_context, otMessage *p_message,
                           const otMessageInfo *p_message_info) {
+  timing_t start = actuator_timing_start();
   otCoapCode method_code = otCoapMessageGetCode(p_message);
   otCoapType message_type = otCoapMessageGetType(p_message);
-  char buf[1];
+  struct led_change change;
+  char buf[LED_PAYLOAD_MAX_LEN];
+  uint16_t len;
   int ret;
+#if defined(CONFIG_APP_SCHEDULE)
+  uint64_t at;
+#endif
 
   if (message_type == OT_COAP_TYPE_CONFIRMABLE ||
       message_type == OT_COAP_TYPE_NON_CONFIRMABLE) {
     if (method_code == OT_COAP_CODE_PUT) {
-      otMessageRead(p_message, otMessageGetOffset(p_message), buf, 1);
-      LOG_INF("Received: %c", buf[0]);
-      if (buf[0] == '0') {
-        ret = gpio_pin_set_dt(&led, 0);
-        led_state = 0;
-      } else if (buf[0] == '1') {
-        ret = gpio_pin_set_dt(&led, 1);
-        led_state = 1;
-      } else if (buf[0] == '2') {
-        ret = gpio_pin_toggle_dt(&led);
-        led_state = 1 - led_state;
+      len = otMessageGetLength(p_message) - otMessageGetOffset(p_message);
+      otMessageRead(p_message, otMessageGetOffset(p_message), buf,
+                    MIN(len, sizeof(buf)));
+      if (led_parse(buf, len, &change) == 0) {
+        ret = led_apply(&change, start);
+#if defined(CONFIG_APP_SCHEDULE)
+      } else if (led_parse_scheduled(buf, len, &change, &at) == 0) {
+        ret = led_schedule(&change, at, start);
+#endif
       } else {
-        LOG_ERR("Received unsupported payload: %c", buf[0]);
+        LOG_ERR("Received unsupported payload of %u bytes", len);
+        ret = -EINVAL;
       }
 
-      if (message_type == OT_COAP_TYPE_CONFIRMABLE) {
-        led_send_response(p_message, p_message_info);
+      /*
+       * -EINVAL is a bad payload or a time too far ahead, the other errors
+       * are a full schedule, no network time or a full actuator queue.
+       */
+      if (message_type == OT_COAP_TYPE_CONFIRMABLE && ret == 0) {
+        led_send_response(p_message, p_message_info, false);
+      } else if (message_type == OT_COAP_TYPE_CONFIRMABLE) {
+        led_send_ack(p_message, p_message_info,
+                     ret == -EINVAL ? OT_COAP_CODE_BAD_REQUEST
+                                    : OT_COAP_CODE_SERVICE_UNAVAILABLE);
       }
     } else if (method_code == OT_COAP_CODE_GET) {
-      led_send_response(p_message, p_message_info);
+      led_send_response(p_message, p_message_info,
+                        observe_request(p_message, p_message_info));
     }
   }
+
+  actuator_handler_time_record(start);
+}
+
+/*
+ * Whether the request has a No-Response option that suppresses the success
+ * response. The error responses are always sent, so the other bits don't
+ * matter.
+ */
+static bool response_suppressed(otMessage *p_message) {
+  otCoapOptionIterator iterator;
+  uint64_t no_response = 0;
+
+  if (otCoapOptionIteratorInit(&iterator, p_message) == OT_ERROR_NONE &&
+      otCoapOptionIteratorGetFirstOptionMatching(
+          &iterator, COAP_OPTION_NO_RESPONSE) != NULL) {
+    otCoapOptionIteratorGetOptionUintValue(&iterator, &no_response);
+  }
+
+  return no_response & NO_RESPONSE_SUCCESS;
 }
 
 static void led_send_response(otMessage *p_request_message,
-                              const otMessageInfo *p_message_info) {
+                              const otMessageInfo *p_message_info,
+                              bool observe) {
   otError error;
   otMessage *p_response;
   otCoapCode response_code;
   otCoapType message_type;
   otInstance *p_instance = openthread_get_default_instance();
-  char buf[1];
+  char buf[ACTUATOR_MAX_LEDS];
+  size_t len;
+
+  /*
+   * A confirmable request still needs its acknowledgement, so it gets an
+   * empty one instead of the suppressed response (RFC 7967, section 2).
+   */
+  if (response_suppressed(p_request_message)) {
+    if (otCoapMessageGetType(p_request_message) == OT_COAP_TYPE_CONFIRMABLE) {
+      led_send_ack(p_request_message, p_message_info, OT_COAP_CODE_EMPTY);
+    }
+    return;
+  }
 
   p_response = otCoapNewMessage(p_instance, NULL);
   if (p_response == NULL) {
@@ -112,6 +314,16 @@ static void led_send_response(otMessage *p_request_message,
     return;
   }
 
+  if (observe) {
+    error = otCoapMessageAppendObserveOption(p_response, observe_sequence());
+    if (error != OT_ERROR_NONE) {
+      LOG_ERR("Failed to append Observe option for CoAP Response: %s",
+              otThreadErrorToString(error));
+      otMessageFree(p_response);
+      return;
+    }
+  }
+
   error = otCoapMessageSetPayloadMarker(p_response);
   if (error != OT_ERROR_NONE) {
     LOG_ERR("Failed to set payload marker for CoAP Response: %s",
@@ -120,9 +332,8 @@ static void led_send_response(otMessage *p_request_message,
     return;
   }
 
-  buf[0] = led_state + 0x30;
-  LOG_INF("LED state: %c", buf[0]);
-  error = otMessageAppend(p_response, buf, 1);
+  len = actuator_state_vector(buf);
+  error = otMessageAppend(p_response, buf, len);
   if (error != OT_ERROR_NONE) {
     LOG_ERR("Failed to append to CoAP Response message: %s",
             otThreadErrorToString(error));
@@ -130,6 +341,49 @@ static void led_send_response(otMessage *p_request_message,
     return;
   }
 
+#if defined(CONFIG_APP_MULTICAST)
+  if (group_is_multicast(p_message_info)) {
+    if (group_send_response_later(p_response, p_message_info) < 0) {
+      LOG_WRN("Too many responses to multicast requests waiting");
+      otMessageFree(p_response);
+    }
+    return;
+  }
+#endif
+
+  error = otCoapSendResponse(p_instance, p_response, p_message_info);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to send CoAP Response: %s", otThreadErrorToString(error));
+    otMessageFree(p_response);
+  }
+}
+
+/*
+ * Acknowledge a confirmable request without payload: with an error code if
+ * it failed, or with OT_COAP_CODE_EMPTY for an empty acknowledgement.
+ */
+static void led_send_ack(otMessage *p_request_message,
+                         const otMessageInfo *p_message_info,
+                         otCoapCode response_code) {
+  otError error;
+  otMessage *p_response;
+  otInstance *p_instance = openthread_get_default_instance();
+
+  p_response = otCoapNewMessage(p_instance, NULL);
+  if (p_response == NULL) {
+    LOG_ERR("Failed to create message for CoAP Response");
+    return;
+  }
+
+  error = otCoapMessageInitResponse(p_response, p_request_message,
+                                    OT_COAP_TYPE_ACKNOWLEDGMENT, response_code);
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to initialize message for CoAP Response: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_response);
+    return;
+  }
+
   error = otCoapSendResponse(p_instance, p_response, p_message_info);
   if (error != OT_ERROR_NONE) {
     LOG_ERR("Failed to send CoAP Response: %s", otThreadErrorToString(error));
@@ -137,6 +391,61 @@ static void led_send_response(otMessage *p_request_message,
   }
 }
 
+#if defined(CONFIG_APP_SCHEDULE)
+/*
+ * Respond with the time of the scheduler in microseconds, so a client can
+ * estimate the offset of its clock to it.
+ */
+static void time_requested(void *p_context, otMessage *p_message,
+                           const otMessageInfo *p_message_info) {
+  otError error;
+  otMessage *p_response;
+  otInstance *p_instance = openthread_get_default_instance();
+  otCoapType message_type = otCoapMessageGetType(p_message);
+  otCoapCode response_code = OT_COAP_CODE_CONTENT;
+  char buf[TIME_MAX_LEN + 1];
+  int len = 0;
+  uint64_t now;
+
+  if (otCoapMessageGetCode(p_message) != OT_COAP_CODE_GET ||
+      (message_type != OT_COAP_TYPE_CONFIRMABLE &&
+       message_type != OT_COAP_TYPE_NON_CONFIRMABLE)) {
+    return;
+  }
+
+  if (schedule_now(&now) == 0) {
+    len = snprintk(buf, sizeof(buf), "%llu", now);
+  } else {
+    response_code = OT_COAP_CODE_SERVICE_UNAVAILABLE;
+  }
+
+  p_response = otCoapNewMessage(p_instance, NULL);
+  if (p_response == NULL) {
+    LOG_ERR("Failed to create message for CoAP Response");
+    return;
+  }
+
+  error = otCoapMessageInitResponse(
+      p_response, p_message,
+      message_type == OT_COAP_TYPE_CONFIRMABLE ? OT_COAP_TYPE_ACKNOWLEDGMENT
+                                               : OT_COAP_TYPE_NON_CONFIRMABLE,
+      response_code);
+  if (error == OT_ERROR_NONE && len > 0) {
+    error = otCoapMessageSetPayloadMarker(p_response);
+    if (error == OT_ERROR_NONE) {
+      error = otMessageAppend(p_response, buf, len);
+    }
+  }
+  if (error == OT_ERROR_NONE) {
+    error = otCoapSendResponse(p_instance, p_response, p_message_info);
+  }
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to send CoAP Response: %s", otThreadErrorToString(error));
+    otMessageFree(p_response);
+  }
+}
+#endif
+
 void init_coap(void) {
   otError error;
   otInstance *p_instance = openthread_get_default_instance();
@@ -149,29 +458,75 @@ void init_coap(void) {
   LOG_INF("CoAP service started");
   otCoapAddResource(p_instance, &led_resource);
   LOG_INF("CoAP led resource started");
+#if defined(CONFIG_APP_SCHEDULE)
+  otCoapAddResource(p_instance, &time_resource);
+  LOG_INF("CoAP time resource started");
+#endif
+}
+
+#if defined(CONFIG_APP_LED_BUTTON)
+/* A press of the button is a local change, which the observers see too. */
+static void button_work_handler(struct k_work *work) {
+  struct openthread_context *ot_context = openthread_get_default_context();
+  struct led_change change = {.toggle = BIT(0)};
+
+  LOG_INF("Button pressed");
+  openthread_api_mutex_lock(ot_context);
+  led_apply(&change, actuator_timing_start());
+  openthread_api_mutex_unlock(ot_context);
 }
 
-int init_led(void) {
+static K_WORK_DEFINE(button_work, button_work_handler);
+
+static void button_pressed(const struct device *dev, struct gpio_callback *cb,
+                           uint32_t pins) {
+  k_work_submit(&button_work);
+}
+
+static int init_button(void) {
   int ret;
 
-  if (!gpio_is_ready_dt(&led)) {
-    return 0;
+  if (!gpio_is_ready_dt(&button)) {
+    return -ENODEV;
   }
 
-  ret = gpio_pin_configure_dt(&led, GPIO_OUTPUT_ACTIVE);
+  ret = gpio_pin_configure_dt(&button, GPIO_INPUT);
   if (ret < 0) {
-    return 0;
+    return ret;
   }
 
-  return 0;
+  ret = gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_TO_ACTIVE);
+  if (ret < 0) {
+    return ret;
+  }
+
+  gpio_init_callback(&button_cb_data, button_pressed, BIT(button.pin));
+  return gpio_add_callback(button.port, &button_cb_data);
 }
+#endif
 
 int main(void) {
   int ret;
 
-  init_led();
+  ret = actuator_init();
+  if (ret < 0) {
+    LOG_ERR("Failed to initialize the LED: %d", ret);
+    return 0;
+  }
+#if defined(CONFIG_APP_SCHEDULE)
+  schedule_init(led_scheduled);
+#endif
   init_coap();
-  ret = gpio_pin_set_dt(&led, 0);
+#if defined(CONFIG_APP_MULTICAST)
+  group_join();
+#endif
+
+#if defined(CONFIG_APP_LED_BUTTON)
+  ret = init_button();
+  if (ret < 0) {
+    LOG_ERR("Failed to initialize the button: %d", ret);
+  }
+#endif
 
   return 0;
 }
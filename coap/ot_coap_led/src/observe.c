@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "observe.h"
+
+#include <errno.h>
+#include <openthread/thread.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+
+#include "actuator.h"
+
+LOG_MODULE_DECLARE(ot_coap_led);
+
+/* Observe Option values in a GET request (RFC 7641) */
+#define OBSERVE_REGISTER 0
+#define OBSERVE_DEREGISTER 1
+
+/* The Observe Option value is a 24-bit sequence number. */
+#define OBSERVE_SEQ_MASK 0xffffff
+
+struct observer {
+  bool active;
+  /* A confirmable notification is waiting for its acknowledgement. */
+  bool con_pending;
+  /* The observer hasn't been notified of the latest state yet. */
+  bool dirty;
+  otIp6Address addr;
+  uint16_t port;
+  uint8_t token[OT_COAP_MAX_TOKEN_LENGTH];
+  uint8_t token_len;
+};
+
+static struct observer observers[CONFIG_APP_OBSERVE_MAX_OBSERVERS];
+static uint32_t observe_seq;
+static uint32_t notification_count;
+static uint32_t changes_pending;
+
+static void notify_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(notify_work, notify_work_handler);
+
+static struct observer *find_observer(const otMessageInfo *p_message_info) {
+  for (size_t i = 0; i < ARRAY_SIZE(observers); i++) {
+    if (observers[i].active &&
+        observers[i].port == p_message_info->mPeerPort &&
+        otIp6IsAddressEqual(&observers[i].addr, &p_message_info->mPeerAddr)) {
+      return &observers[i];
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Add the sender of a request as observer. An observer with the same
+ * endpoint is replaced, as required by RFC 7641.
+ */
+static struct observer *add_observer(otMessage *p_message,
+                                     const otMessageInfo *p_message_info) {
+  struct observer *p_observer = find_observer(p_message_info);
+
+  for (size_t i = 0; p_observer == NULL && i < ARRAY_SIZE(observers); i++) {
+    if (!observers[i].active) {
+      p_observer = &observers[i];
+    }
+  }
+
+  if (p_observer == NULL) {
+    return NULL;
+  }
+
+  p_observer->active = true;
+  p_observer->con_pending = false;
+  p_observer->dirty = false;
+  p_observer->addr = p_message_info->mPeerAddr;
+  p_observer->port = p_message_info->mPeerPort;
+  p_observer->token_len = otCoapMessageGetTokenLength(p_message);
+  memcpy(p_observer->token, otCoapMessageGetToken(p_message),
+         p_observer->token_len);
+
+  return p_observer;
+}
+
+static void remove_observer(struct observer *p_observer) {
+  char addr[OT_IP6_ADDRESS_STRING_SIZE];
+
+  otIp6AddressToString(&p_observer->addr, addr, sizeof(addr));
+  LOG_INF("Removed observer [%s]:%u", addr, p_observer->port);
+  p_observer->active = false;
+  p_observer->con_pending = false;
+  p_observer->dirty = false;
+}
+
+static int send_notification(struct observer *p_observer, bool confirmable);
+
+static void notification_response_cb(void *p_context, otMessage *p_message,
+                                     const otMessageInfo *p_message_info,
+                                     otError result) {
+  struct observer *p_observer = p_context;
+
+  if (!p_observer->con_pending) {
+    /* The observer was removed or registered again in the meantime. */
+    return;
+  }
+
+  p_observer->con_pending = false;
+  if (result != OT_ERROR_NONE) {
+    /* No acknowledgement or a reset: the observer is gone. */
+    LOG_WRN("Notification not acknowledged: %s",
+            otThreadErrorToString(result));
+    remove_observer(p_observer);
+    return;
+  }
+
+  /* Send the changes that were held back for the acknowledgement. */
+  if (p_observer->dirty) {
+    observe_seq = (observe_seq + 1) & OBSERVE_SEQ_MASK;
+    if (send_notification(p_observer, false) == 0) {
+      p_observer->dirty = false;
+    }
+  }
+}
+
+/* Send the current LED state to an observer. */
+static int send_notification(struct observer *p_observer, bool confirmable) {
+  otError error;
+  otInstance *p_instance = openthread_get_default_instance();
+  otMessage *p_message;
+  otMessageInfo message_info;
+  char buf[ACTUATOR_MAX_LEDS];
+  size_t len = actuator_state_vector(buf);
+
+  p_message = otCoapNewMessage(p_instance, NULL);
+  if (p_message == NULL) {
+    LOG_ERR("Failed to create message for CoAP notification");
+    return -ENOMEM;
+  }
+
+  otCoapMessageInit(p_message,
+                    confirmable ? OT_COAP_TYPE_CONFIRMABLE
+                                : OT_COAP_TYPE_NON_CONFIRMABLE,
+                    OT_COAP_CODE_CONTENT);
+
+  error = otCoapMessageSetToken(p_message, p_observer->token,
+                                p_observer->token_len);
+  if (error == OT_ERROR_NONE) {
+    error = otCoapMessageAppendObserveOption(p_message, observe_seq);
+  }
+  if (error == OT_ERROR_NONE) {
+    error = otCoapMessageSetPayloadMarker(p_message);
+  }
+  if (error == OT_ERROR_NONE) {
+    error = otMessageAppend(p_message, buf, len);
+  }
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to build CoAP notification: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  memset(&message_info, 0, sizeof(message_info));
+  message_info.mPeerAddr = p_observer->addr;
+  message_info.mPeerPort = p_observer->port;
+
+  if (confirmable) {
+    error = otCoapSendRequest(p_instance, p_message, &message_info,
+                              notification_response_cb, p_observer);
+  } else {
+    error = otCoapSendRequest(p_instance, p_message, &message_info, NULL, NULL);
+  }
+  if (error != OT_ERROR_NONE) {
+    LOG_ERR("Failed to send CoAP notification: %s",
+            otThreadErrorToString(error));
+    otMessageFree(p_message);
+    return -EIO;
+  }
+
+  p_observer->con_pending = confirmable;
+  return 0;
+}
+
+static void notify_work_handler(struct k_work *work) {
+  struct openthread_context *ot_context = openthread_get_default_context();
+  bool confirmable;
+  int notified = 0;
+
+  openthread_api_mutex_lock(ot_context);
+
+  observe_seq = (observe_seq + 1) & OBSERVE_SEQ_MASK;
+  confirmable = ++notification_count % CONFIG_APP_OBSERVE_CON_INTERVAL == 0;
+
+  for (size_t i = 0; i < ARRAY_SIZE(observers); i++) {
+    /*
+     * Don't stack notifications for a slow observer, it gets the latest
+     * state once it acknowledges the pending one.
+     */
+    if (!observers[i].dirty || observers[i].con_pending) {
+      continue;
+    }
+
+    if (send_notification(&observers[i], confirmable) == 0) {
+      observers[i].dirty = false;
+      notified++;
+    }
+  }
+
+  if (notified > 0) {
+    LOG_INF("Notified %d observers of %u changes", notified, changes_pending);
+  }
+  changes_pending = 0;
+
+  openthread_api_mutex_unlock(ot_context);
+}
+
+bool observe_request(otMessage *p_message,
+                     const otMessageInfo *p_message_info) {
+  otCoapOptionIterator iterator;
+  uint64_t observe = OBSERVE_DEREGISTER;
+  struct observer *p_observer;
+  char addr[OT_IP6_ADDRESS_STRING_SIZE];
+
+  if (otCoapOptionIteratorInit(&iterator, p_message) == OT_ERROR_NONE &&
+      otCoapOptionIteratorGetFirstOptionMatching(
+          &iterator, OT_COAP_OPTION_OBSERVE) != NULL) {
+    otCoapOptionIteratorGetOptionUintValue(&iterator, &observe);
+  }
+
+  otIp6AddressToString(&p_message_info->mPeerAddr, addr, sizeof(addr));
+
+  if (observe == OBSERVE_REGISTER) {
+    p_observer = add_observer(p_message, p_message_info);
+    if (p_observer == NULL) {
+      LOG_WRN("No room for observer [%s]:%u", addr, p_message_info->mPeerPort);
+      return false;
+    }
+    LOG_INF("Added observer [%s]:%u", addr, p_message_info->mPeerPort);
+    return true;
+  }
+
+  /* A GET without Observe=0 ends an existing observation. */
+  p_observer = find_observer(p_message_info);
+  if (p_observer != NULL) {
+    remove_observer(p_observer);
+  }
+  return false;
+}
+
+uint32_t observe_sequence(void) { return observe_seq; }
+
+void observe_changed(void) {
+  for (size_t i = 0; i < ARRAY_SIZE(observers); i++) {
+    if (observers[i].active) {
+      observers[i].dirty = true;
+    }
+  }
+
+  /* The first change of a burst starts the holdoff, later ones join it. */
+  changes_pending++;
+  k_work_schedule(&notify_work, K_MSEC(CONFIG_APP_OBSERVE_HOLDOFF));
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef OBSERVE_H_
+#define OBSERVE_H_
+
+#include <openthread/coap.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(CONFIG_APP_OBSERVE)
+/*
+ * Handle the Observe option of a GET request of the LED resource: Observe 0
+ * registers the sender, another value or none deregisters it.
+ *
+ * Returns true if the sender is registered, so the response needs an
+ * Observe option with observe_sequence().
+ */
+bool observe_request(otMessage *p_message, const otMessageInfo *p_message_info);
+
+/* Sequence number of the last notification, for the Observe option. */
+uint32_t observe_sequence(void);
+
+/*
+ * Notify all observers of a change of the LED state, after
+ * CONFIG_APP_OBSERVE_HOLDOFF milliseconds. The changes in the meantime are
+ * coalesced in one notification with the latest state, and an observer
+ * with an unacknowledged confirmable notification only gets the latest
+ * state once it's acknowledged. Call this with the OpenThread API mutex
+ * held or in the OpenThread thread.
+ */
+void observe_changed(void);
+#else
+static inline bool observe_request(otMessage *p_message,
+                                   const otMessageInfo *p_message_info) {
+  return false;
+}
+
+static inline uint32_t observe_sequence(void) { return 0; }
+
+static inline void observe_changed(void) {}
+#endif
+
+#endif /* OBSERVE_H_ */
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "schedule.h"
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+
+#if defined(CONFIG_APP_SCHEDULE_NETWORK_TIME)
+#include <openthread/network_time.h>
+#endif
+
+LOG_MODULE_DECLARE(ot_coap_led);
+
+struct scheduled_change {
+  struct k_work_delayable work;
+  struct led_change change;
+  uint64_t at;
+  bool used;
+};
+
+static struct scheduled_change scheduled[CONFIG_APP_SCHEDULE_MAX_CHANGES];
+static schedule_handler_t change_handler;
+
+int schedule_now(uint64_t *p_now) {
+#if defined(CONFIG_APP_SCHEDULE_NETWORK_TIME)
+  if (otNetworkTimeGet(openthread_get_default_instance(), p_now) !=
+      OT_NETWORK_TIME_SYNCHRONIZED) {
+    return -EAGAIN;
+  }
+#else
+  *p_now = k_ticks_to_us_floor64(k_uptime_ticks());
+#endif
+  return 0;
+}
+
+/*
+ * Runs in the system work queue, which has a cooperative priority, so the
+ * change is handed to the actuator right after the timer expires.
+ */
+static void scheduled_work_handler(struct k_work *work) {
+  struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+  struct scheduled_change *p_scheduled =
+      CONTAINER_OF(dwork, struct scheduled_change, work);
+  struct openthread_context *ot_context = openthread_get_default_context();
+  struct led_change change;
+  uint64_t now;
+
+  openthread_api_mutex_lock(ot_context);
+  change = p_scheduled->change;
+  p_scheduled->used = false;
+  change_handler(&change);
+  if (schedule_now(&now) == 0) {
+    LOG_INF("Scheduled change carried out %lld us after its time",
+            (int64_t)(now - p_scheduled->at));
+  }
+  openthread_api_mutex_unlock(ot_context);
+}
+
+int schedule_submit(const struct led_change *p_change, uint64_t at) {
+  struct scheduled_change *p_scheduled = NULL;
+  uint64_t now;
+  int ret;
+
+  ret = schedule_now(&now);
+  if (ret < 0) {
+    return ret;
+  }
+  if (at <= now) {
+    return -ETIME;
+  }
+  if (at - now > (uint64_t)CONFIG_APP_SCHEDULE_MAX_LEAD * USEC_PER_MSEC) {
+    return -EINVAL;
+  }
+
+  for (size_t i = 0; i < ARRAY_SIZE(scheduled); i++) {
+    if (!scheduled[i].used) {
+      p_scheduled = &scheduled[i];
+      break;
+    }
+  }
+
+  if (p_scheduled == NULL) {
+    return -ENOBUFS;
+  }
+
+  p_scheduled->used = true;
+  p_scheduled->change = *p_change;
+  p_scheduled->at = at;
+  /*
+   * The timer runs on the local clock, which doesn't drift noticeably from
+   * the network time within the maximum lead.
+   */
+  k_work_schedule(&p_scheduled->work, K_USEC(at - now));
+  return 0;
+}
+
+void schedule_init(schedule_handler_t handler) {
+  change_handler = handler;
+
+  for (size_t i = 0; i < ARRAY_SIZE(scheduled); i++) {
+    k_work_init_delayable(&scheduled[i].work, scheduled_work_handler);
+  }
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+#include <stdint.h>
+
+#include "actuator.h"
+
+/*
+ * Function that carries out a scheduled change, called with the OpenThread
+ * API mutex held.
+ */
+typedef void (*schedule_handler_t)(const struct led_change *p_change);
+
+/* Prepare the timers of the scheduled changes. */
+void schedule_init(schedule_handler_t handler);
+
+/*
+ * Get the time in microseconds that LED commands are scheduled in: the
+ * network time with CONFIG_APP_SCHEDULE_NETWORK_TIME, otherwise the uptime
+ * of the node. Call this with the OpenThread API mutex held or in the
+ * OpenThread thread.
+ *
+ * Returns 0 on success, or -EAGAIN if the network time isn't synchronized.
+ */
+int schedule_now(uint64_t *p_now);
+
+/*
+ * Carry out a change of the LEDs at the given time, as returned by
+ * schedule_now(). Call this with the OpenThread API mutex held or in the
+ * OpenThread thread.
+ *
+ * Returns 0 on success, -ETIME if the time has already passed, -EINVAL if
+ * it's more than CONFIG_APP_SCHEDULE_MAX_LEAD milliseconds away, -ENOBUFS if
+ * too many changes are waiting, or -EAGAIN if the network time isn't
+ * synchronized.
+ */
+int schedule_submit(const struct led_change *p_change, uint64_t at);
+
+#endif /* SCHEDULE_H_ */
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Queue LED commands to the actuator with four LEDs on two fake GPIO
+ * ports, and check the state it reports and the writes of its work queue.
+ */
+
+#include <errno.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include "actuator.h"
+#include "fake_gpio.h"
+#include "fake_kernel.h"
+
+#define LEDS 4
+#define ALL_LEDS BIT_MASK(LEDS)
+
+/* Port and pin of each LED in the fake devicetree */
+static const struct {
+  int port;
+  gpio_pin_t pin;
+} led_pins[LEDS] = {{0, 6}, {0, 8}, {1, 9}, {0, 12}};
+
+static const gpio_port_pins_t port_masks[FAKE_GPIO_PORTS] = {
+    BIT(6) | BIT(8) | BIT(12), BIT(9)};
+
+static void submit(uint32_t off, uint32_t on, uint32_t toggle) {
+  struct led_change change = {.off = off, .on = on, .toggle = toggle};
+
+  zassert_equal(actuator_submit(&change, 0), 0);
+}
+
+/* Check the levels of the LED pins against a state. */
+static void check_levels(uint32_t state) {
+  for (size_t i = 0; i < LEDS; i++) {
+    bool high = fake_gpio_levels[led_pins[i].port] & BIT(led_pins[i].pin);
+
+    zassert_equal(high, (state & BIT(i)) != 0, "LED %zu", i);
+  }
+}
+
+/* Start each test with all LEDs off and freshly configured. */
+static void before(void *fixture) {
+  fake_kernel_reset();
+  submit(ALL_LEDS, 0, 0);
+  fake_work_run();
+  fake_gpio_reset();
+  zassert_equal(actuator_init(), 0);
+}
+
+ZTEST(actuator, test_init_configures_inactive_outputs) {
+  zassert_equal(actuator_count(), LEDS);
+  for (size_t i = 0; i < LEDS; i++) {
+    zassert_equal(fake_gpio_flags[led_pins[i].port][led_pins[i].pin],
+                  GPIO_OUTPUT_INACTIVE, "LED %zu", i);
+  }
+  check_levels(0);
+  zassert_equal(fake_gpio_write_count, 0);
+}
+
+/*
+ * The state is resolved when a command is queued, so a response reports it
+ * before the work queue sets the LEDs.
+ */
+ZTEST(actuator, test_state_is_resolved_when_queued) {
+  char vector[ACTUATOR_MAX_LEDS];
+
+  submit(0, BIT(0) | BIT(2), 0);
+  zassert_equal(actuator_state(), BIT(0) | BIT(2));
+  submit(0, 0, BIT(0) | BIT(1));
+  zassert_equal(actuator_state(), BIT(1) | BIT(2));
+  zassert_equal(actuator_state_vector(vector), LEDS);
+  zassert_mem_equal(vector, "0110", LEDS);
+  zassert_equal(fake_gpio_write_count, 0);
+
+  zassert_equal(fake_work_run(), 1);
+  zassert_equal(fake_gpio_write_count, 2 * FAKE_GPIO_PORTS);
+  check_levels(BIT(1) | BIT(2));
+}
+
+/* A change turns LEDs off, then on, then toggles them. */
+ZTEST(actuator, test_change_order) {
+  submit(0, ALL_LEDS, 0);
+  submit(BIT(0) | BIT(1), BIT(1) | BIT(2), BIT(2) | BIT(3));
+  zassert_equal(actuator_state(), BIT(1));
+
+  /* The bits of LEDs that don't exist are ignored. */
+  submit(0, BIT(LEDS), BIT(ACTUATOR_MAX_LEDS - 1));
+  zassert_equal(actuator_state(), BIT(1));
+}
+
+/* The LEDs on the same port change at the same time. */
+ZTEST(actuator, test_one_masked_write_per_port) {
+  submit(0, BIT(0) | BIT(2) | BIT(3), 0);
+  fake_work_run();
+
+  zassert_equal(fake_gpio_write_count, FAKE_GPIO_PORTS);
+  zassert_equal_ptr(fake_gpio_writes[0].port, &fake_gpio_ports[0]);
+  zassert_equal(fake_gpio_writes[0].mask, port_masks[0]);
+  zassert_equal(fake_gpio_writes[0].value, BIT(6) | BIT(12));
+  zassert_equal_ptr(fake_gpio_writes[1].port, &fake_gpio_ports[1]);
+  zassert_equal(fake_gpio_writes[1].mask, port_masks[1]);
+  zassert_equal(fake_gpio_writes[1].value, BIT(9));
+  check_levels(BIT(0) | BIT(2) | BIT(3));
+}
+
+/* A full queue drops a command without changing the state. */
+ZTEST(actuator, test_full_queue_drops_command) {
+  struct led_change change = {.toggle = BIT(0)};
+
+  for (int i = 0; i < CONFIG_APP_ACTUATOR_QUEUE_SIZE; i++) {
+    submit(0, 0, BIT(0));
+  }
+  zassert_equal(actuator_state(), 0);
+
+  zassert_equal(actuator_submit(&change, 0), -ENOBUFS);
+  zassert_equal(actuator_state(), 0);
+
+  fake_work_run();
+  zassert_equal(fake_gpio_write_count,
+                CONFIG_APP_ACTUATOR_QUEUE_SIZE * FAKE_GPIO_PORTS);
+  check_levels(0);
+
+  zassert_equal(actuator_submit(&change, 0), 0);
+  zassert_equal(actuator_state(), BIT(0));
+}
+
+ZTEST_SUITE(actuator, NULL, NULL, before, NULL, NULL);
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Send command vectors to the LED resource of a node with four LEDs on two
+ * fake GPIO ports, and check the responses and the writes to the ports.
+ */
+
+#include <string.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include "actuator.h"
+#include "fake_gpio.h"
+#include "fake_kernel.h"
+#include "fake_openthread.h"
+
+#define PEER 1
+#define LEDS 4
+
+int led_main(void);
+
+/*
+ * Send a request to the LED resource, with the payload if it isn't NULL.
+ * Returns the response, which must be the last sent message.
+ */
+static const otMessage *request_led(otCoapCode code, const char *p_payload) {
+  uint8_t token = PEER;
+  otMessage *p_request =
+      fake_request(OT_COAP_TYPE_CONFIRMABLE, code, &token, 1);
+  otMessageInfo info = fake_peer(PEER);
+  size_t sent = fake_sent_count;
+
+  if (p_payload != NULL) {
+    otCoapMessageSetPayloadMarker(p_request);
+    otMessageAppend(p_request, p_payload, strlen(p_payload));
+  }
+  zassert_true(fake_deliver("led", p_request, &info));
+  zassert_equal(fake_sent_count, sent + 1);
+  zassert_equal(fake_sent[sent].p_message->type, OT_COAP_TYPE_ACKNOWLEDGMENT);
+  return fake_sent[sent].p_message;
+}
+
+/* PUT a vector and check the state vector in the response. */
+static void put_vector(const char *p_vector, const char *p_state) {
+  const otMessage *p_response = request_led(OT_COAP_CODE_PUT, p_vector);
+
+  zassert_equal(p_response->code, OT_COAP_CODE_CHANGED, "%s", p_vector);
+  zassert_equal(p_response->payload_len, LEDS, "%s", p_vector);
+  zassert_mem_equal(p_response->payload, p_state, LEDS, "%s", p_vector);
+}
+
+/* Check the levels of the LED pins in the fake devicetree. */
+static void check_levels(gpio_port_value_t port0, gpio_port_value_t port1) {
+  zassert_equal(fake_gpio_levels[0], port0);
+  zassert_equal(fake_gpio_levels[1], port1);
+}
+
+/* Start each test with all LEDs off on a freshly started node. */
+static void before(void *fixture) {
+  struct led_change off = {.off = BIT_MASK(LEDS)};
+
+  fake_kernel_reset();
+  zassert_equal(actuator_submit(&off, 0), 0);
+  fake_work_run();
+  fake_gpio_reset();
+  fake_openthread_reset();
+  led_main();
+}
+
+/* A vector with a character per LED sets all LEDs with one write per port. */
+ZTEST(command_vector, test_vector_sets_all_leds_at_once) {
+  put_vector("1-11", "1011");
+  zassert_equal(fake_gpio_write_count, 0);
+  fake_work_run();
+  zassert_equal(fake_gpio_write_count, FAKE_GPIO_PORTS);
+  check_levels(BIT(6) | BIT(12), BIT(9));
+
+  put_vector("0120", "0100");
+  fake_work_run();
+  zassert_equal(fake_gpio_write_count, 2 * FAKE_GPIO_PORTS);
+  check_levels(BIT(8), 0);
+}
+
+/* The LEDs after the end of a short vector are left as they are. */
+ZTEST(command_vector, test_short_vector_leaves_other_leds) {
+  put_vector("---1", "0001");
+  put_vector("1", "1001");
+  put_vector("22", "0101");
+  fake_work_run();
+  check_levels(BIT(8) | BIT(12), 0);
+}
+
+ZTEST(command_vector, test_invalid_vector_is_bad_request) {
+  static const char *const vectors[] = {"", "11111", "1x", "3", "1 "};
+
+  put_vector("1", "1000");
+  for (size_t i = 0; i < ARRAY_SIZE(vectors); i++) {
+    const otMessage *p_response = request_led(OT_COAP_CODE_PUT, vectors[i]);
+
+    zassert_equal(p_response->code, OT_COAP_CODE_BAD_REQUEST, "'%s'",
+                  vectors[i]);
+    zassert_equal(p_response->payload_len, 0, "'%s'", vectors[i]);
+  }
+  zassert_equal(actuator_state(), BIT(0));
+}
+
+ZTEST(command_vector, test_get_returns_state_vector) {
+  const otMessage *p_response;
+
+  put_vector("0110", "0110");
+  p_response = request_led(OT_COAP_CODE_GET, NULL);
+  zassert_equal(p_response->code, OT_COAP_CODE_CONTENT);
+  zassert_equal(p_response->payload_len, LEDS);
+  zassert_mem_equal(p_response->payload, "0110", LEDS);
+}
+
+/* A full actuator queue is temporary, so the client may try again later. */
+ZTEST(command_vector, test_full_queue_is_service_unavailable) {
+  const otMessage *p_response;
+
+  for (int i = 0; i < CONFIG_APP_ACTUATOR_QUEUE_SIZE; i++) {
+    put_vector("2", i % 2 == 0 ? "1000" : "0000");
+  }
+
+  p_response = request_led(OT_COAP_CODE_PUT, "2");
+  zassert_equal(p_response->code, OT_COAP_CODE_SERVICE_UNAVAILABLE);
+  zassert_equal(actuator_state(), 0);
+
+  fake_work_run();
+  put_vector("2", "1000");
+}
+
+ZTEST_SUITE(command_vector, NULL, NULL, before, NULL, NULL);
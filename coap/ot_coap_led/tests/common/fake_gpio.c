@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fake_gpio.h"
+
+#include <errno.h>
+#include <string.h>
+
+const struct device fake_gpio_ports[FAKE_GPIO_PORTS] = {{.name = "gpio0"},
+                                                        {.name = "gpio1"}};
+
+struct fake_gpio_write fake_gpio_writes[FAKE_GPIO_WRITES];
+size_t fake_gpio_write_count;
+gpio_flags_t fake_gpio_flags[FAKE_GPIO_PORTS][FAKE_GPIO_PINS];
+gpio_port_value_t fake_gpio_levels[FAKE_GPIO_PORTS];
+
+void fake_gpio_reset(void) {
+  memset(fake_gpio_writes, 0, sizeof(fake_gpio_writes));
+  fake_gpio_write_count = 0;
+  memset(fake_gpio_flags, 0, sizeof(fake_gpio_flags));
+  memset(fake_gpio_levels, 0, sizeof(fake_gpio_levels));
+}
+
+/* Index of a port in fake_gpio_ports, or -1 if it's another device */
+static int port_index(const struct device *port) {
+  for (int i = 0; i < FAKE_GPIO_PORTS; i++) {
+    if (port == &fake_gpio_ports[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool gpio_is_ready_dt(const struct gpio_dt_spec *spec) {
+  return port_index(spec->port) >= 0 && spec->pin < FAKE_GPIO_PINS;
+}
+
+int gpio_pin_configure_dt(const struct gpio_dt_spec *spec,
+                          gpio_flags_t extra_flags) {
+  int port = port_index(spec->port);
+
+  if (port < 0 || spec->pin >= FAKE_GPIO_PINS) {
+    return -EINVAL;
+  }
+
+  fake_gpio_flags[port][spec->pin] = extra_flags;
+  if (extra_flags & GPIO_OUTPUT_INIT_HIGH) {
+    fake_gpio_levels[port] |= BIT(spec->pin);
+  } else if (extra_flags & GPIO_OUTPUT_INIT_LOW) {
+    fake_gpio_levels[port] &= ~BIT(spec->pin);
+  }
+  return 0;
+}
+
+int gpio_port_set_masked(const struct device *port, gpio_port_pins_t mask,
+                         gpio_port_value_t value) {
+  int index = port_index(port);
+
+  if (index < 0 || fake_gpio_write_count == FAKE_GPIO_WRITES) {
+    return -EIO;
+  }
+
+  fake_gpio_writes[fake_gpio_write_count++] =
+      (struct fake_gpio_write){port, mask, value};
+  fake_gpio_levels[index] = (fake_gpio_levels[index] & ~mask) | (value & mask);
+  return 0;
+}
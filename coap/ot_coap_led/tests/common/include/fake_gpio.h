@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * GPIO ports for the unit tests, which remember the configuration and
+ * level of their pins and the masked writes to them.
+ */
+
+#ifndef FAKE_GPIO_H_
+#define FAKE_GPIO_H_
+
+#include <stddef.h>
+#include <zephyr/drivers/gpio.h>
+
+#define FAKE_GPIO_PORTS 2
+#define FAKE_GPIO_PINS 32
+#define FAKE_GPIO_WRITES 64
+
+struct fake_gpio_write {
+  const struct device *port;
+  gpio_port_pins_t mask;
+  gpio_port_value_t value;
+};
+
+extern struct fake_gpio_write fake_gpio_writes[FAKE_GPIO_WRITES];
+extern size_t fake_gpio_write_count;
+
+/* Flags of the last gpio_pin_configure_dt() of each pin, or 0 */
+extern gpio_flags_t fake_gpio_flags[FAKE_GPIO_PORTS][FAKE_GPIO_PINS];
+
+/* Level of the pins of each port */
+extern gpio_port_value_t fake_gpio_levels[FAKE_GPIO_PORTS];
+
+/* Unconfigure all pins, set them low and forget the writes. */
+void fake_gpio_reset(void);
+
+#endif /* FAKE_GPIO_H_ */
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * The devicetree of the unit tests has one gpio-leds node with four LEDs,
+ * on two GPIO ports so a state needs two masked writes. A child node is a
+ * (port, pin) tuple, which GPIO_DT_SPEC_GET() in the fake GPIO API expands.
+ */
+
+#ifndef FAKE_ZEPHYR_DEVICETREE_H_
+#define FAKE_ZEPHYR_DEVICETREE_H_
+
+#define FAKE_LEDS_NODE fake_leds
+
+#define DT_FOREACH_STATUS_OKAY(compat, fn) fn(FAKE_LEDS_NODE)
+#define DT_FOREACH_CHILD_STATUS_OKAY(node_id, fn)                              \
+  fn((0, 6)) fn((0, 8)) fn((1, 9)) fn((0, 12))
+
+#endif /* FAKE_ZEPHYR_DEVICETREE_H_ */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * The part of the GPIO API that the actuator uses, on the ports of
+ * fake_gpio.h. The unit tests leave out the button.
+ */
+
+#ifndef FAKE_ZEPHYR_DRIVERS_GPIO_H_
+#define FAKE_ZEPHYR_DRIVERS_GPIO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/device.h>
+#include <zephyr/sys/util.h>
+
+#define GPIO_INPUT BIT(16)
+#define GPIO_OUTPUT BIT(17)
+#define GPIO_OUTPUT_INIT_LOW BIT(18)
+#define GPIO_OUTPUT_INIT_HIGH BIT(19)
+#define GPIO_OUTPUT_INIT_LOGICAL BIT(20)
+#define GPIO_OUTPUT_INACTIVE                                                   \
+  (GPIO_OUTPUT | GPIO_OUTPUT_INIT_LOW | GPIO_OUTPUT_INIT_LOGICAL)
+
+typedef uint32_t gpio_flags_t;
+typedef uint32_t gpio_port_pins_t;
+typedef uint32_t gpio_port_value_t;
+typedef uint8_t gpio_pin_t;
+typedef uint16_t gpio_dt_flags_t;
+
+struct gpio_dt_spec {
+  const struct device *port;
+  gpio_pin_t pin;
+  gpio_dt_flags_t dt_flags;
+};
+
+extern const struct device fake_gpio_ports[];
+
+/* A devicetree node of the fake devicetree is a (port, pin) tuple. */
+#define FAKE_GPIO_DT_SPEC(port_index, pin_number)                              \
+  {.port = &fake_gpio_ports[port_index], .pin = (pin_number), .dt_flags = 0}
+#define GPIO_DT_SPEC_GET(node_id, prop) FAKE_GPIO_DT_SPEC node_id
+
+bool gpio_is_ready_dt(const struct gpio_dt_spec *spec);
+
+int gpio_pin_configure_dt(const struct gpio_dt_spec *spec,
+                          gpio_flags_t extra_flags);
+
+int gpio_port_set_masked(const struct device *port, gpio_port_pins_t mask,
+                         gpio_port_value_t value);
+
+#endif /* FAKE_ZEPHYR_DRIVERS_GPIO_H_ */
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Send requests with and without a No-Response option (RFC 7967) to the LED
+ * resource against an in-memory OpenThread and actuator, and check what the
+ * node answers.
+ */
+
+#include <string.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include "actuator.h"
+#include "fake_openthread.h"
+
+#define COAP_OPTION_NO_RESPONSE 258
+#define NO_RESPONSE_SUCCESS 2
+#define PEER 1
+#define LEDS 2
+
+static uint32_t state;
+
+void init_coap(void);
+
+/* Actuator that applies a change right away */
+int actuator_init(void) { return 0; }
+
+size_t actuator_count(void) { return LEDS; }
+
+int actuator_submit(const struct led_change *p_change, timing_t start) {
+  state = ((state & ~p_change->off) | p_change->on) ^ p_change->toggle;
+  return 0;
+}
+
+uint32_t actuator_state(void) { return state; }
+
+size_t actuator_state_vector(char *buf) {
+  for (size_t i = 0; i < LEDS; i++) {
+    buf[i] = state & BIT(i) ? '1' : '0';
+  }
+  return LEDS;
+}
+
+/*
+ * Send a request to the LED resource, with a No-Response option if
+ * no_response isn't 0. Returns the message ID of the request.
+ */
+static uint16_t request_led(otCoapType type, otCoapCode code,
+                            const char *p_payload, uint8_t no_response) {
+  uint8_t token = PEER;
+  otMessage *p_request = fake_request(type, code, &token, 1);
+  otMessageInfo info = fake_peer(PEER);
+  uint16_t message_id = otCoapMessageGetMessageId(p_request);
+
+  if (no_response != 0) {
+    otCoapMessageAppendUintOption(p_request, COAP_OPTION_NO_RESPONSE,
+                                  no_response);
+  }
+  if (p_payload != NULL) {
+    otCoapMessageSetPayloadMarker(p_request);
+    otMessageAppend(p_request, p_payload, strlen(p_payload));
+  }
+  zassert_true(fake_deliver("led", p_request, &info));
+  return message_id;
+}
+
+static void before(void *fixture) {
+  fake_openthread_reset();
+  init_coap();
+  state = 0;
+}
+
+ZTEST(no_response, test_confirmable_gets_piggybacked_response) {
+  uint16_t message_id = request_led(OT_COAP_TYPE_CONFIRMABLE,
+                                    OT_COAP_CODE_PUT, "1", 0);
+  const otMessage *p_response;
+
+  zassert_equal(fake_sent_count, 1);
+  p_response = fake_sent[0].p_message;
+  zassert_equal(p_response->type, OT_COAP_TYPE_ACKNOWLEDGMENT);
+  zassert_equal(p_response->code, OT_COAP_CODE_CHANGED);
+  zassert_equal(p_response->message_id, message_id);
+  zassert_equal(p_response->payload_len, LEDS);
+  zassert_mem_equal(p_response->payload, "10", LEDS);
+}
+
+ZTEST(no_response, test_confirmable_gets_empty_ack) {
+  uint16_t message_id = request_led(
+      OT_COAP_TYPE_CONFIRMABLE, OT_COAP_CODE_PUT, "1", NO_RESPONSE_SUCCESS);
+  const otMessage *p_ack;
+
+  zassert_equal(state, BIT(0));
+  zassert_equal(fake_sent_count, 1);
+  p_ack = fake_sent[0].p_message;
+  zassert_true(fake_sent[0].response);
+  zassert_equal(p_ack->type, OT_COAP_TYPE_ACKNOWLEDGMENT);
+  zassert_equal(p_ack->code, OT_COAP_CODE_EMPTY);
+  zassert_equal(p_ack->message_id, message_id);
+  zassert_equal(p_ack->option_count, 0);
+  zassert_false(p_ack->payload_marker);
+  zassert_equal(p_ack->payload_len, 0);
+
+  request_led(OT_COAP_TYPE_CONFIRMABLE, OT_COAP_CODE_GET, NULL,
+              NO_RESPONSE_SUCCESS);
+  zassert_equal(fake_sent_count, 2);
+  zassert_equal(fake_sent[1].p_message->code, OT_COAP_CODE_EMPTY);
+  zassert_equal(fake_sent[1].p_message->payload_len, 0);
+}
+
+ZTEST(no_response, test_non_confirmable_gets_nothing) {
+  request_led(OT_COAP_TYPE_NON_CONFIRMABLE, OT_COAP_CODE_GET, NULL,
+              NO_RESPONSE_SUCCESS);
+  zassert_equal(fake_sent_count, 0);
+
+  request_led(OT_COAP_TYPE_NON_CONFIRMABLE, OT_COAP_CODE_GET, NULL, 0);
+  zassert_equal(fake_sent_count, 1);
+  zassert_equal(fake_sent[0].p_message->type, OT_COAP_TYPE_NON_CONFIRMABLE);
+  zassert_equal(fake_sent[0].p_message->code, OT_COAP_CODE_CONTENT);
+}
+
+/* The option only suppresses the success responses. */
+ZTEST(no_response, test_errors_are_sent) {
+  request_led(OT_COAP_TYPE_CONFIRMABLE, OT_COAP_CODE_PUT, "x",
+              NO_RESPONSE_SUCCESS);
+  zassert_equal(fake_sent_count, 1);
+  zassert_equal(fake_sent[0].p_message->type, OT_COAP_TYPE_ACKNOWLEDGMENT);
+  zassert_equal(fake_sent[0].p_message->code, OT_COAP_CODE_BAD_REQUEST);
+  zassert_equal(state, 0);
+}
+
+ZTEST_SUITE(no_response, NULL, NULL, before, NULL, NULL);
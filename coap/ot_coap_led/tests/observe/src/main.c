@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2024 Koen Vervloesem
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Register observers of the LED resource, change the LEDs with PUT requests
+ * of another peer, and check the notifications that the work queue sends
+ * after the holdoff.
+ */
+
+#include <string.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include "actuator.h"
+#include "fake_gpio.h"
+#include "fake_kernel.h"
+#include "fake_openthread.h"
+
+#define PEER_A 1
+#define PEER_B 2
+#define PEER_C 3
+/* Peer that changes the LEDs without observing them */
+#define PEER_CLIENT 4
+#define LEDS 4
+
+int led_main(void);
+
+/* Send a request of the peer to the LED resource and return the response. */
+static const otMessage *request_led(uint8_t peer, otCoapCode code,
+                                    const char *p_payload, bool observe) {
+  otMessage *p_request = fake_request(OT_COAP_TYPE_CONFIRMABLE, code, &peer,
+                                      sizeof(peer));
+  otMessageInfo info = fake_peer(peer);
+  size_t index = fake_sent_count;
+
+  if (observe) {
+    otCoapMessageAppendObserveOption(p_request, 0);
+  }
+  if (p_payload != NULL) {
+    otCoapMessageSetPayloadMarker(p_request);
+    otMessageAppend(p_request, p_payload, strlen(p_payload));
+  }
+  zassert_true(fake_deliver("led", p_request, &info));
+  zassert_equal(fake_sent_count, index + 1);
+  zassert_true(fake_sent[index].response);
+  return fake_sent[index].p_message;
+}
+
+/* Send a GET request of the peer that registers or deregisters it. */
+static bool get_led(uint8_t peer, bool observe) {
+  const otMessage *p_response = request_led(peer, OT_COAP_CODE_GET, NULL,
+                                            observe);
+  uint64_t sequence;
+
+  return fake_uint_option(p_response, OT_COAP_OPTION_OBSERVE, &sequence);
+}
+
+static void put_led(const char *p_vector) {
+  const otMessage *p_response =
+      request_led(PEER_CLIENT, OT_COAP_CODE_PUT, p_vector, false);
+
+  zassert_equal(p_response->code, OT_COAP_CODE_CHANGED, "%s", p_vector);
+}
+
+/* Index of the first message to the peer from index on, or -1 */
+static int sent_to(uint8_t peer, size_t index) {
+  for (size_t i = index; i < fake_sent_count; i++) {
+    if (fake_sent[i].info.mPeerPort == fake_peer(peer).mPeerPort) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/* Check a notification to the peer with the state vector. */
+static void check_notification(int index, uint8_t peer, const char *p_state) {
+  const otMessage *p_message;
+  uint64_t sequence;
+
+  zassert_true(index >= 0);
+  p_message = fake_sent[index].p_message;
+  zassert_false(fake_sent[index].response);
+  zassert_equal(p_message->code, OT_COAP_CODE_CONTENT);
+  zassert_equal(p_message->token_len, 1);
+  zassert_equal(p_message->token[0], peer);
+  zassert_true(
+      fake_uint_option(p_message, OT_COAP_OPTION_OBSERVE, &sequence));
+  zassert_equal(p_message->payload_len, LEDS);
+  zassert_mem_equal(p_message->payload, p_state, LEDS);
+}
+
+/*
+ * Toggle LED 0 and notify until the notification to the peer is
+ * confirmable, and return the index of that one.
+ */
+static int notify_until_confirmable(uint8_t peer) {
+  for (int i = 0; i < CONFIG_APP_OBSERVE_CON_INTERVAL; i++) {
+    size_t index = fake_sent_count;
+    int sent;
+
+    put_led("2");
+    fake_work_run();
+    sent = sent_to(peer, index);
+    zassert_true(sent >= 0);
+    if (fake_sent[sent].p_message->type == OT_COAP_TYPE_CONFIRMABLE) {
+      return sent;
+    }
+  }
+
+  zassert_unreachable("No confirmable notification");
+  return -1;
+}
+
+/* Acknowledge the confirmable notification to the peer from index on. */
+static void acknowledge(uint8_t peer, size_t index) {
+  int con = sent_to(peer, index);
+
+  zassert_true(con >= 0);
+  zassert_equal(fake_sent[con].p_message->type, OT_COAP_TYPE_CONFIRMABLE);
+  fake_respond(con, OT_ERROR_NONE);
+}
+
+/* Start each test with all LEDs off on a freshly started node. */
+static void before(void *fixture) {
+  struct led_change off = {.off = BIT_MASK(LEDS)};
+
+  fake_kernel_reset();
+  zassert_equal(actuator_submit(&off, 0), 0);
+  fake_work_run();
+  fake_gpio_reset();
+  fake_openthread_reset();
+  led_main();
+}
+
+/* Deregister every observer, so the next test starts without any. */
+static void after(void *fixture) {
+  get_led(PEER_A, false);
+  get_led(PEER_B, false);
+  get_led(PEER_C, false);
+  zassert_equal(fake_api_mutex_depth, 0);
+}
+
+ZTEST(observe, test_register_and_deregister) {
+  size_t index;
+
+  zassert_true(get_led(PEER_A, true));
+  put_led("1");
+  fake_work_run();
+  check_notification(fake_sent_count - 1, PEER_A, "1000");
+
+  zassert_false(get_led(PEER_A, false));
+  index = fake_sent_count;
+  put_led("0");
+  fake_work_run();
+  zassert_equal(sent_to(PEER_A, index), -1);
+}
+
+ZTEST(observe, test_full_observer_list) {
+  zassert_true(get_led(PEER_A, true));
+  zassert_true(get_led(PEER_B, true));
+  zassert_false(get_led(PEER_C, true));
+}
+
+/* A burst of changes within the holdoff is one notification. */
+ZTEST(observe, test_burst_is_coalesced) {
+  size_t index;
+
+  zassert_true(get_led(PEER_A, true));
+  zassert_true(get_led(PEER_B, true));
+  index = fake_sent_count;
+  put_led("1");
+  put_led("-1");
+  put_led("--1");
+  zassert_equal(sent_to(PEER_A, index), -1);
+
+  zassert_equal(fake_work_run(), 2);
+  zassert_equal(fake_sent_to(PEER_A, index), 1);
+  zassert_equal(fake_sent_to(PEER_B, index), 1);
+  check_notification(sent_to(PEER_A, index), PEER_A, "1110");
+  check_notification(sent_to(PEER_B, index), PEER_B, "1110");
+}
+
+/* Only a change of the state is notified. */
+ZTEST(observe, test_put_without_change_is_not_notified) {
+  size_t index;
+
+  zassert_true(get_led(PEER_A, true));
+  index = fake_sent_count;
+  put_led("0-00");
+  fake_work_run();
+  zassert_equal(sent_to(PEER_A, index), -1);
+}
+
+ZTEST(observe, test_every_nth_notification_is_confirmable) {
+  int con;
+
+  zassert_true(get_led(PEER_A, true));
+  con = notify_until_confirmable(PEER_A);
+  fake_respond(con, OT_ERROR_NONE);
+
+  for (int i = 1; i <= CONFIG_APP_OBSERVE_CON_INTERVAL; i++) {
+    size_t index = fake_sent_count;
+    int sent;
+
+    put_led("2");
+    fake_work_run();
+    sent = sent_to(PEER_A, index);
+    zassert_true(sent >= 0);
+    zassert_equal(fake_sent[sent].p_message->type,
+                  i == CONFIG_APP_OBSERVE_CON_INTERVAL
+                      ? OT_COAP_TYPE_CONFIRMABLE
+                      : OT_COAP_TYPE_NON_CONFIRMABLE,
+                  "notification %d", i);
+  }
+}
+
+/*
+ * An observer with an unacknowledged confirmable notification gets the
+ * latest state once it acknowledges it, instead of every change.
+ */
+ZTEST(observe, test_pending_confirmable_holds_back_changes) {
+  char state[ACTUATOR_MAX_LEDS];
+  size_t index;
+  int con;
+  int sent;
+
+  zassert_true(get_led(PEER_A, true));
+  zassert_true(get_led(PEER_B, true));
+  con = notify_until_confirmable(PEER_A);
+  acknowledge(PEER_B, con);
+
+  index = fake_sent_count;
+  put_led("-1");
+  fake_work_run();
+  put_led("--1");
+  fake_work_run();
+  zassert_equal(sent_to(PEER_A, index), -1);
+  zassert_equal(fake_sent_to(PEER_B, index), 2);
+
+  actuator_state_vector(state);
+  index = fake_sent_count;
+  fake_respond(con, OT_ERROR_NONE);
+  zassert_equal(fake_sent_to(PEER_A, index), 1);
+  sent = sent_to(PEER_A, index);
+  check_notification(sent, PEER_A, state);
+  zassert_equal(fake_sent[sent].p_message->type,
+                OT_COAP_TYPE_NON_CONFIRMABLE);
+}
+
+/* An observer that doesn't acknowledge a confirmable one is removed. */
+ZTEST(observe, test_unacknowledged_confirmable_removes_observer) {
+  size_t index;
+  int con;
+
+  zassert_true(get_led(PEER_A, true));
+  zassert_true(get_led(PEER_B, true));
+  con = notify_until_confirmable(PEER_A);
+  acknowledge(PEER_B, con);
+  fake_respond(con, OT_ERROR_RESPONSE_TIMEOUT);
+
+  index = fake_sent_count;
+  put_led("-1");
+  fake_work_run();
+  zassert_equal(sent_to(PEER_A, index), -1);
+  zassert_true(sent_to(PEER_B, index) >= 0);
+
+  /* A's place is free again. */
+  zassert_true(get_led(PEER_C, true));
+}
+
+ZTEST_SUITE(observe, NULL, NULL, before, after, NULL);
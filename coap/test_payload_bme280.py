@@ -0,0 +1,90 @@
+"""Decode the JSON and CBOR reports of the BME280 node with the collector.
+
+Copyright (c) 2024 Koen Vervloesem
+
+SPDX-License-Identifier: MIT
+
+The payloads are the ones that the report test of ot_coap_bme280 checks
+report.c against, so the collector is tested with what the node sends. Run
+it on the host with:
+
+    python3 test_payload_bme280.py -v
+"""
+import json
+import unittest
+
+import coap_server_bme280 as collector
+
+# Payloads of report.c in tests/report/src/main.c of ot_coap_bme280, and
+# their readings in °C, hPa and % per sensor
+REPORTS = {
+    "typical": {
+        "json": '{"id":"F4CE36A1B2C3D4E5","seq":1234,"boot":1513920225,'
+        '"temp":21.50,"press":1013.25,"hum":45.00}',
+        "cbor": "a60048f4ce36a1b2c3d4e50a1904d20b1a5a3c96e101190866021a00018bcd"
+        "03191194",
+        "readings": [(21.5, 1013.25, 45.0)],
+    },
+    "cold": {
+        "json": '{"id":"F4CE36A1B2C3D4E5","seq":17,"boot":1,"temp":-15.25,'
+        '"press":987.90,"hum":82.10}',
+        "cbor": "a60048f4ce36a1b2c3d4e50a110b01013905f4021a000181e603192012",
+        "readings": [(-15.25, 987.9, 82.1)],
+    },
+    "largest": {
+        "json": '{"id":"F4CE36A1B2C3D4E5","seq":4294967295,"boot":4294967295,'
+        '"temp":-40.00,"press":1100.00,"hum":100.00}',
+        "cbor": "a60048f4ce36a1b2c3d4e50a1affffffff0b1affffffff01390f9f021a00"
+        "01adb003192710",
+        "readings": [(-40.0, 1100.0, 100.0)],
+    },
+    "two sensors": {
+        "json": '{"id":"F4CE36A1B2C3D4E5","seq":1234,"boot":1513920225,'
+        '"sensors":{"0":[21.50,1013.25,45.00],"1":[21.63,1013.31,44.20]}}',
+        "cbor": "a40048f4ce36a1b2c3d4e50a1904d20b1a5a3c96e107a200831908661a00"
+        "018bcd19119401831908731a00018bd3191144",
+        "readings": [(21.5, 1013.25, 45.0), (21.63, 1013.31, 44.2)],
+    },
+}
+
+
+class CollectorDecodeTest(unittest.TestCase):
+    def test_collector_decodes_both_formats_alike(self):
+        for name, report in REPORTS.items():
+            with self.subTest(name):
+                from_json = json.loads(report["json"])
+                from_cbor = collector.decode_cbor(bytes.fromhex(report["cbor"]))
+                self.assertEqual(from_cbor, from_json)
+                collector.check_report(from_cbor)
+                self.assertEqual(
+                    collector.report_readings(from_cbor),
+                    report["readings"],
+                )
+
+    def test_collector_refuses_malformed_reports(self):
+        report = json.loads(REPORTS["typical"]["json"])
+
+        def without(field):
+            return {key: value for key, value in report.items() if key != field}
+
+        malformed = {
+            "not a map": [report],
+            "no id": without("id"),
+            "string reading": {**report, "temp": "21.50"},
+            "boolean reading": {**report, "hum": True},
+            "no pressure": without("press"),
+            "negative seq": {**report, "seq": -1},
+            "seq without boot": without("boot"),
+            "short sensor": {**report, "sensors": {"0": [21.5, 1013.25]}},
+            "batch without samples": {**report, "ts": 0, "samples": []},
+            "batch sample without delta": {**report, "ts": 0, "samples": [[21.5]]},
+            "stats without uptime": {**report, "ts": 0, "n": 1, "stats": [[0] * 4] * 3},
+        }
+        for name, payload in malformed.items():
+            with self.subTest(name):
+                with self.assertRaises(ValueError):
+                    collector.check_report(payload)
+
+
+if __name__ == "__main__":
+    unittest.main()